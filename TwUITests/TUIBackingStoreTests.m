@@ -0,0 +1,127 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+#import "TUIBackingStore.h"
+#import "TUIView+Private.h"
+
+#define BENCHMARK_SIZE 512
+#define BENCHMARK_DRAW_COUNT 2000
+
+@interface TUIBackingStoreTests : SenTestCase
+@end
+
+static uint32_t TUIBackingStoreTestsPixel(CGImageRef image, size_t x, size_t y)
+{
+	CFDataRef data = CGDataProviderCopyData(CGImageGetDataProvider(image));
+	const uint8_t *bytes = CFDataGetBytePtr(data);
+	uint32_t pixel = *(const uint32_t *)(bytes + y * CGImageGetBytesPerRow(image) + x * 4);
+	CFRelease(data);
+	return pixel;
+}
+
+static TUIViewDirtyRegion TUIBackingStoreTestsRegion(CGRect r)
+{
+	TUIViewDirtyRegion region;
+	region.everything = NO;
+	region.count = 0;
+	TUIViewDirtyRegionAddRect(&region, r);
+	return region;
+}
+
+@implementation TUIBackingStoreTests
+
+- (void)testOverlappingDrawsGetTheirOwnBuffers
+{
+	TUIBackingStore *store = [[TUIBackingStore alloc] initWithPixelWidth:10 height:10 opaque:YES scale:1.0];
+	TUIViewDirtyRegion firstRegion = TUIBackingStoreTestsRegion(CGRectMake(0, 0, 10, 10));
+	TUIViewDirtyRegion secondRegion = TUIBackingStoreTestsRegion(CGRectMake(0, 0, 5, 5));
+	
+	TUIBackingStoreDrawing first = [store beginDrawingInRegion:&firstRegion];
+	TUIBackingStoreDrawing second = [store beginDrawingInRegion:&secondRegion];
+	STAssertTrue(first.context != second.context, @"overlapping draws must not share a buffer");
+	STAssertTrue(secondRegion.everything, @"a buffer that has never been drawn needs everything");
+	
+	CGContextSetRGBFillColor(first.context, 1, 0, 0, 1);
+	CGContextFillRect(first.context, CGRectMake(0, 0, 10, 10));
+	CGContextSetRGBFillColor(second.context, 0, 0, 1, 1);
+	CGContextFillRect(second.context, CGRectMake(0, 0, 10, 10));
+	
+	// finished in the opposite order to how they began
+	CGImageRef secondImage = [store copyImageAndFinishDrawing:&second];
+	CGImageRef firstImage = [store copyImageAndFinishDrawing:&first];
+	STAssertTrue(firstImage != NULL && secondImage != NULL, nil);
+	STAssertTrue(TUIBackingStoreTestsPixel(firstImage, 5, 5) != TUIBackingStoreTestsPixel(secondImage, 5, 5), @"each image should show its own draw");
+	CGImageRelease(firstImage);
+	CGImageRelease(secondImage);
+	
+	STAssertTrue([store copyImageAndFinishDrawing:&first] == NULL, @"a drawing can only be finished once");
+}
+
+- (void)testMoreOverlappingDrawsThanBuffers
+{
+	TUIBackingStore *store = [[TUIBackingStore alloc] initWithPixelWidth:10 height:10 opaque:YES scale:1.0];
+	TUIBackingStoreDrawing drawings[TUIBackingStoreBufferCount + 1];
+	for(NSUInteger i = 0; i <= TUIBackingStoreBufferCount; ++i) {
+		TUIViewDirtyRegion region = TUIBackingStoreTestsRegion(CGRectMake(0, 0, 10, 10));
+		drawings[i] = [store beginDrawingInRegion:&region];
+		STAssertTrue(drawings[i].context != NULL, nil);
+		for(NSUInteger j = 0; j < i; ++j)
+			STAssertTrue(drawings[i].context != drawings[j].context, @"draw %lu shares a bitmap with draw %lu", (unsigned long)i, (unsigned long)j);
+	}
+	for(NSUInteger i = 0; i <= TUIBackingStoreBufferCount; ++i) {
+		CGImageRef image = [store copyImageAndFinishDrawing:&drawings[i]];
+		STAssertTrue(image != NULL, nil);
+		CGImageRelease(image);
+	}
+}
+
+/**
+ * Redraw a small dirty rect over and over, keeping the last image onscreen the way
+ * a layer would.  Reports the draw latency and the bytes copied into newly taken
+ * bitmaps, which should stay at zero once the buffers are warm.
+ */
+- (void)testPartialRedrawBenchmark
+{
+	TUIBackingStore *store = [[TUIBackingStore alloc] initWithPixelWidth:BENCHMARK_SIZE height:BENCHMARK_SIZE opaque:YES scale:1.0];
+	CGImageRef onscreen = NULL;
+	NSUInteger bytesCopiedBefore = TUIBackingStoreGetPoolUsage().bytesCopied;
+	CFAbsoluteTime worst = 0.0;
+	
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	for(NSUInteger i = 0; i < BENCHMARK_DRAW_COUNT; ++i) {
+		CFAbsoluteTime drawStart = CFAbsoluteTimeGetCurrent();
+		TUIViewDirtyRegion region = TUIBackingStoreTestsRegion(CGRectMake((i * 37) % (BENCHMARK_SIZE - 32), (i * 53) % (BENCHMARK_SIZE - 32), 32, 32));
+		TUIBackingStoreDrawing drawing = [store beginDrawingInRegion:&region];
+		CGContextSetRGBFillColor(drawing.context, (i % 7) / 7.0, 0, 0, 1);
+		CGContextFillRect(drawing.context, CGRectMake(0, 0, BENCHMARK_SIZE, BENCHMARK_SIZE));
+		CGImageRef image = [store copyImageAndFinishDrawing:&drawing];
+		CGImageRelease(onscreen);
+		onscreen = image;
+		worst = MAX(worst, CFAbsoluteTimeGetCurrent() - drawStart);
+	}
+	CFAbsoluteTime finished = CFAbsoluteTimeGetCurrent();
+	CGImageRelease(onscreen);
+	
+	NSUInteger bytesCopied = TUIBackingStoreGetPoolUsage().bytesCopied - bytesCopiedBefore;
+	NSLog(@"%d partial redraws of %dx%d: %.3fms each, %.3fms worst, %lu bytes copied", BENCHMARK_DRAW_COUNT, BENCHMARK_SIZE, BENCHMARK_SIZE,
+		  (finished - start) * 1000.0 / BENCHMARK_DRAW_COUNT, worst * 1000.0, (unsigned long)bytesCopied);
+	
+	STAssertTrue(bytesCopied <= (NSUInteger)BENCHMARK_SIZE * BENCHMARK_SIZE * 4 * TUIBackingStoreBufferCount, @"bitmaps should only be copied while the buffers warm up");
+}
+
+@end
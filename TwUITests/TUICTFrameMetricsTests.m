@@ -0,0 +1,302 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+#import "CoreText+Additions.h"
+
+#define MAXIMUM_RECTS 64
+#define BENCHMARK_PARAGRAPHS 400
+#define BENCHMARK_ITERATIONS 20
+
+@interface TUICTFrameMetricsTests : SenTestCase
+@end
+
+/*
+ The linear lookups the metrics replaced, kept here as they were so the
+ metrics have something independent to be checked against.
+ */
+
+static CGFloat TUICTFrameMetricsTestsLinearHeight(CTFrameRef f)
+{
+	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(f);
+	NSInteger n = (NSInteger)[lines count];
+	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * MAX(n, 1));
+	CTFrameGetLineOrigins(f, CFRangeMake(0, n), lineOrigins);
+
+	CGPoint first = CGPointZero;
+	CGFloat h = 0.0;
+	for(NSInteger i = 0; i < n; ++i) {
+		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
+		CGFloat ascent, descent, leading;
+		CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
+		if(i == 0) {
+			first = lineOrigins[i];
+			h += ascent;
+			h += descent;
+		}
+		if(i == n-1) {
+			h += first.y - lineOrigins[i].y;
+			h += descent;
+			free(lineOrigins);
+			return ceil(h);
+		}
+	}
+	free(lineOrigins);
+	return 0.0;
+}
+
+static CFIndex TUICTFrameMetricsTestsLinearStringIndexForPosition(CTFrameRef frame, CGPoint p)
+{
+	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
+	CFIndex linesCount = [lines count];
+	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * MAX(linesCount, 1));
+	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
+
+	for(CFIndex i = 0; i < linesCount; ++i) {
+		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
+		CGPoint lineOrigin = lineOrigins[i];
+		CGFloat descent, ascent;
+		CTLineGetTypographicBounds(line, &ascent, &descent, NULL);
+		if(p.y > (floor(lineOrigin.y) - floor(descent))) { // above bottom of line
+			free(lineOrigins);
+			if(i == 0 && (p.y > (ceil(lineOrigin.y) + ceil(ascent)))) // above top of first line
+				return 0;
+			p.x -= lineOrigin.x;
+			p.y -= lineOrigin.y;
+			return CTLineGetStringIndexForPosition(line, p);
+		}
+	}
+
+	free(lineOrigins);
+	return CTFrameGetStringRange(frame).length; // beneath the last line
+}
+
+static BOOL TUICTFrameMetricsTestsRangeContainsIndex(CFRange range, CFIndex index)
+{
+	return (index >= range.location) && (index <= (range.location + range.length));
+}
+
+static void TUICTFrameMetricsTestsLinearRectsForRange(CTFrameRef frame, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
+{
+	CGRect bounds;
+	CGPathIsRect(CTFrameGetPath(frame), &bounds);
+
+	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
+	CFIndex linesCount = [lines count];
+	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * MAX(linesCount, 1));
+	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
+
+	CFIndex maxRects = *rectCount;
+	CFIndex rectIndex = 0;
+	CFIndex startIndex = range.location;
+	CFIndex endIndex = startIndex + range.length;
+
+	for(CFIndex i = 0; i < linesCount; ++i) {
+		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
+		CFRange lineRange = CTLineGetStringRange(line);
+		BOOL containsStartIndex = TUICTFrameMetricsTestsRangeContainsIndex(lineRange, startIndex);
+		BOOL containsEndIndex = TUICTFrameMetricsTestsRangeContainsIndex(lineRange, endIndex);
+		if(!containsStartIndex && !containsEndIndex && !TUICTFrameMetricsTestsRangeContainsIndex(range, lineRange.location))
+			continue;
+		if(containsStartIndex && !containsEndIndex && startIndex == lineRange.location + lineRange.length)
+			continue;
+
+		CGPoint lineOrigin = lineOrigins[i];
+		CGFloat ascent, descent, leading;
+		CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
+		BOOL useRealHeight = i < linesCount - 1;
+		CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount - 1 > i ? lineOrigins[i + 1].y : 0.0f);
+		CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
+		CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
+
+		CGRect r;
+		if(containsStartIndex && containsEndIndex) {
+			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
+			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
+			r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, endOffset - startOffset, lineHeight);
+			if(aggregationType == AB_CTLineRectAggregationTypeBlock)
+				r.size.width = bounds.size.width - startOffset;
+		} else if(containsStartIndex) {
+			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
+			r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, bounds.size.width - startOffset, lineHeight);
+		} else if(containsEndIndex) {
+			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
+			r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, endOffset, lineHeight);
+			if(aggregationType == AB_CTLineRectAggregationTypeBlock)
+				r.size.width = bounds.size.width;
+		} else {
+			r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, bounds.size.width, lineHeight);
+		}
+
+		if(rectIndex < maxRects)
+			rects[rectIndex++] = r;
+		if(containsStartIndex && containsEndIndex)
+			break;
+	}
+
+	free(lineOrigins);
+	*rectCount = rectIndex;
+}
+
+static CTFrameRef TUICTFrameMetricsTestsCreateFrame(NSAttributedString *string, CGRect rect)
+{
+	CTFramesetterRef framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)string);
+	CGMutablePathRef path = CGPathCreateMutable();
+	CGPathAddRect(path, NULL, rect);
+	CTFrameRef frame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0, 0), path, NULL);
+	CGPathRelease(path);
+	CFRelease(framesetter);
+	return frame;
+}
+
+static TUIAttributedString *TUICTFrameMetricsTestsString(NSString *string)
+{
+	TUIAttributedString *s = [TUIAttributedString stringWithString:string];
+	s.font = [TUIFont systemFontOfSize:12];
+	s.color = [TUIColor blackColor];
+	return s;
+}
+
+@implementation TUICTFrameMetricsTests
+
+- (void)_assertMetricsMatchLinearLookupsForString:(NSAttributedString *)string inRect:(CGRect)rect
+{
+	CTFrameRef frame = TUICTFrameMetricsTestsCreateFrame(string, rect);
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	NSString *name = [[string string] length] > 24 ? [[[string string] substringToIndex:24] stringByAppendingString:@"..."] : [string string];
+
+	CGFloat height = TUICTFrameMetricsTestsLinearHeight(frame);
+	STAssertEquals(AB_CTFrameMetricsGetHeight(metrics), height, @"height of \"%@\"", name);
+	STAssertEquals(AB_CTFrameGetHeight(frame), height, @"height of \"%@\"", name);
+
+	// every point in and around the frame, including above the first line and below the last
+	for(CGFloat y = CGRectGetMinY(rect) - 20.0; y <= CGRectGetMaxY(rect) + 20.0; y += 1.5) {
+		for(CGFloat x = CGRectGetMinX(rect) - 10.0; x <= CGRectGetMaxX(rect) + 10.0; x += 5.0) {
+			CGPoint p = CGPointMake(x, y);
+			CFIndex expected = TUICTFrameMetricsTestsLinearStringIndexForPosition(frame, p);
+			STAssertEquals(AB_CTFrameMetricsGetStringIndexForPosition(metrics, p), expected, @"index at %@ in \"%@\"", NSStringFromPoint(p), name);
+		}
+	}
+
+	// every range of the frame's string, with room for all the rects and with too little
+	CFIndex length = CTFrameGetStringRange(frame).length;
+	AB_CTLineRectAggregationType types[] = {AB_CTLineRectAggregationTypeInline, AB_CTLineRectAggregationTypeBlock};
+	for(NSUInteger t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+		for(CFIndex location = 0; location <= length; ++location) {
+			for(CFIndex rangeLength = 0; location + rangeLength <= length; ++rangeLength) {
+				CFRange range = CFRangeMake(location, rangeLength);
+				CFIndex maxRects[] = {MAXIMUM_RECTS, 2};
+				for(NSUInteger m = 0; m < sizeof(maxRects) / sizeof(maxRects[0]); ++m) {
+					CGRect expectedRects[MAXIMUM_RECTS];
+					CFIndex expectedCount = maxRects[m];
+					TUICTFrameMetricsTestsLinearRectsForRange(frame, range, types[t], expectedRects, &expectedCount);
+
+					CGRect rects[MAXIMUM_RECTS];
+					CFIndex count = maxRects[m];
+					AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, range, types[t], rects, &count);
+					STAssertEquals(count, expectedCount, @"rect count for {%ld, %ld} in \"%@\"", (long)location, (long)rangeLength, name);
+					for(CFIndex i = 0; i < MIN(count, expectedCount); ++i)
+						STAssertTrue(CGRectEqualToRect(rects[i], expectedRects[i]), @"rect %ld for {%ld, %ld} in \"%@\": %@ instead of %@", (long)i, (long)location, (long)rangeLength, name, NSStringFromRect(rects[i]), NSStringFromRect(expectedRects[i]));
+
+					count = maxRects[m];
+					AB_CTFrameGetRectsForRangeWithAggregationType(frame, range, types[t], rects, &count);
+					STAssertEquals(count, expectedCount, @"frame rect count for {%ld, %ld} in \"%@\"", (long)location, (long)rangeLength, name);
+				}
+			}
+		}
+	}
+
+	AB_CTFrameMetricsRelease(metrics);
+	CFRelease(frame);
+}
+
+- (void)testEmptyFrame
+{
+	[self _assertMetricsMatchLinearLookupsForString:TUICTFrameMetricsTestsString(@"") inRect:CGRectMake(0, 0, 200, 100)];
+}
+
+- (void)testSingleLine
+{
+	[self _assertMetricsMatchLinearLookupsForString:TUICTFrameMetricsTestsString(@"One short line") inRect:CGRectMake(0, 0, 200, 100)];
+}
+
+- (void)testWrappedLines
+{
+	TUIAttributedString *s = TUICTFrameMetricsTestsString(@"A few lines of text that wrap at this width, so the lookups have more than one line to search through.");
+	[self _assertMetricsMatchLinearLookupsForString:s inRect:CGRectMake(0, 0, 120, 400)];
+	[self _assertMetricsMatchLinearLookupsForString:s inRect:CGRectMake(17, 29, 120, 400)];
+}
+
+- (void)testParagraphsAndEmptyLines
+{
+	TUIAttributedString *s = TUICTFrameMetricsTestsString(@"First paragraph\n\nThird line after an empty one\nlast");
+	s.alignment = TUITextAlignmentCenter;
+	[self _assertMetricsMatchLinearLookupsForString:s inRect:CGRectMake(5, 11, 150, 300)];
+}
+
+- (void)testMixedFontSizes
+{
+	TUIAttributedString *s = TUICTFrameMetricsTestsString(@"Small then LARGE text then small again, wrapped over lines of different heights.");
+	[s setFont:[TUIFont boldSystemFontOfSize:28] inRange:NSMakeRange(11, 5)];
+	[s setFont:[TUIFont systemFontOfSize:8] inRange:NSMakeRange(40, 20)];
+	[self _assertMetricsMatchLinearLookupsForString:s inRect:CGRectMake(0, 0, 130, 400)];
+}
+
+- (void)testTruncatedFrame
+{
+	// the frame only holds the first few lines of the string
+	TUIAttributedString *s = TUICTFrameMetricsTestsString(@"More text than fits in the frame, so the frame's string range is shorter than the string it was made from.");
+	[self _assertMetricsMatchLinearLookupsForString:s inRect:CGRectMake(0, 0, 100, 40)];
+}
+
+/**
+ * Not a test of correctness: hit testing a long frame line by line, with the
+ * linear lookup and with metrics made once for the frame.
+ */
+- (void)testStringIndexForPositionBenchmark
+{
+	NSMutableString *text = [NSMutableString string];
+	for(NSUInteger i = 0; i < BENCHMARK_PARAGRAPHS; ++i)
+		[text appendFormat:@"Paragraph %lu of a long frame\n", (unsigned long)i];
+	CGRect rect = CGRectMake(0, 0, 300, BENCHMARK_PARAGRAPHS * 20);
+	CTFrameRef frame = TUICTFrameMetricsTestsCreateFrame(TUICTFrameMetricsTestsString(text), rect);
+	CFIndex sink = 0;
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i) {
+		for(CGFloat y = 0; y < rect.size.height; y += 10.0)
+			sink += TUICTFrameMetricsTestsLinearStringIndexForPosition(frame, CGPointMake(50, y));
+	}
+	CFAbsoluteTime linear = CFAbsoluteTimeGetCurrent();
+
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i) {
+		for(CGFloat y = 0; y < rect.size.height; y += 10.0)
+			sink += AB_CTFrameMetricsGetStringIndexForPosition(metrics, CGPointMake(50, y));
+	}
+	CFAbsoluteTime measured = CFAbsoluteTimeGetCurrent();
+	AB_CTFrameMetricsRelease(metrics);
+	CFRelease(frame);
+
+	NSUInteger lookups = BENCHMARK_ITERATIONS * (NSUInteger)(rect.size.height / 10.0);
+	NSLog(@"%lu lookups in %d lines: %.2fus linear, %.2fus with metrics (%ld)", (unsigned long)lookups, BENCHMARK_PARAGRAPHS,
+		  (linear - start) * 1e6 / lookups,
+		  (measured - linear) * 1e6 / lookups,
+		  (long)sink);
+}
+
+@end
@@ -0,0 +1,153 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIDrawScheduler.h"
+
+@interface TUIDrawSchedulerTests : SenTestCase
+{
+	TUIDrawScheduler *scheduler;
+	NSMutableArray *order;
+	dispatch_semaphore_t gate;   // holds the one draw slot until signalled
+	dispatch_semaphore_t done;   // signalled by every draw
+}
+@end
+
+@implementation TUIDrawSchedulerTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	scheduler = [[TUIDrawScheduler alloc] init]; // not the shared one, so nothing else touches it
+	scheduler.maximumConcurrentDraws = 1;
+	order = [NSMutableArray array];
+	gate = dispatch_semaphore_create(0);
+	done = dispatch_semaphore_create(0);
+}
+
+- (void)tearDown
+{
+	scheduler = nil;
+	order = nil;
+	dispatch_release(gate);
+	dispatch_release(done);
+	[super tearDown];
+}
+
+- (TUIDrawSchedulerBlock)_drawNamed:(NSString *)name
+{
+	NSMutableArray *o = order;
+	dispatch_semaphore_t d = done;
+	return [^BOOL{
+		@synchronized(o) {
+			[o addObject:name];
+		}
+		dispatch_semaphore_signal(d);
+		return YES;
+	} copy];
+}
+
+/**
+ * @brief Take the only draw slot, so everything scheduled after waits in line
+ */
+- (void)_blockScheduler
+{
+	dispatch_semaphore_t g = gate;
+	dispatch_semaphore_t d = done;
+	[scheduler scheduleDrawForTarget:@"blocker" priority:TUIDrawPriorityHigh block:^BOOL{
+		dispatch_semaphore_wait(g, DISPATCH_TIME_FOREVER);
+		dispatch_semaphore_signal(d);
+		return YES;
+	}];
+}
+
+- (void)_waitForDraws:(NSUInteger)count
+{
+	dispatch_semaphore_signal(gate);
+	for(NSUInteger i = 0; i < count + 1; ++i)
+		STAssertEquals(dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0L, @"draws didn't finish");
+}
+
+- (void)testPriorityThenOrder
+{
+	id a = @"a", b = @"b", c = @"c", d = @"d";
+	[self _blockScheduler];
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityLow block:[self _drawNamed:@"a"]];
+	[scheduler scheduleDrawForTarget:b priority:TUIDrawPriorityHigh block:[self _drawNamed:@"b"]];
+	[scheduler scheduleDrawForTarget:c priority:TUIDrawPriorityDefault block:[self _drawNamed:@"c"]];
+	[scheduler scheduleDrawForTarget:d priority:TUIDrawPriorityHigh block:[self _drawNamed:@"d"]];
+	[self _waitForDraws:4];
+
+	STAssertEqualObjects(order, ([NSArray arrayWithObjects:@"b", @"d", @"c", @"a", nil]), nil);
+}
+
+- (void)testCoalescingRaisesPriority
+{
+	id a = @"a", b = @"b", c = @"c";
+	[self _blockScheduler];
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityLow block:[self _drawNamed:@"a"]];
+	[scheduler scheduleDrawForTarget:b priority:TUIDrawPriorityDefault block:[self _drawNamed:@"b"]];
+	[scheduler scheduleDrawForTarget:c priority:TUIDrawPriorityLow block:[self _drawNamed:@"c"]];
+	[scheduler scheduleDrawForTarget:c priority:TUIDrawPriorityHigh block:[self _drawNamed:@"c again"]];
+	[self _waitForDraws:3];
+
+	STAssertEqualObjects(order, ([NSArray arrayWithObjects:@"c again", @"b", @"a", nil]), @"a coalesced request runs once, at the higher priority, with the newest block");
+	TUIDrawSchedulerStatistics statistics = [scheduler statistics];
+	STAssertEquals(statistics.coalesced, (NSUInteger)1, nil);
+	STAssertEquals(statistics.completed, (NSUInteger)4, nil);
+}
+
+- (void)testCancelledDrawsDontRun
+{
+	id a = @"a", b = @"b", c = @"c";
+	[self _blockScheduler];
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityHigh block:[self _drawNamed:@"a"]];
+	[scheduler scheduleDrawForTarget:b priority:TUIDrawPriorityHigh block:[self _drawNamed:@"b"]];
+	[scheduler cancelDrawForTarget:a];
+	// a new request for a cancelled target goes to the back of the line
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityHigh block:[self _drawNamed:@"a again"]];
+	[scheduler scheduleDrawForTarget:c priority:TUIDrawPriorityLow block:[self _drawNamed:@"c"]];
+	[scheduler cancelDrawForTarget:c];
+	[self _waitForDraws:2];
+
+	STAssertEqualObjects(order, ([NSArray arrayWithObjects:@"b", @"a again", nil]), nil);
+	TUIDrawSchedulerStatistics statistics = [scheduler statistics];
+	STAssertEquals(statistics.cancelled, (NSUInteger)2, nil);
+	STAssertEquals(statistics.queueDepth, (NSUInteger)0, nil);
+}
+
+- (void)testSameTargetWaitsForItsDraw
+{
+	id a = @"a", b = @"b";
+	dispatch_semaphore_t g = gate;
+	dispatch_semaphore_t d = done;
+	scheduler.maximumConcurrentDraws = 2;
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityHigh block:^BOOL{
+		dispatch_semaphore_wait(g, DISPATCH_TIME_FOREVER);
+		dispatch_semaphore_signal(d);
+		return YES;
+	}];
+	// a is being drawn, so its next draw is set aside and b goes ahead
+	[scheduler scheduleDrawForTarget:a priority:TUIDrawPriorityHigh block:[self _drawNamed:@"a"]];
+	[scheduler scheduleDrawForTarget:b priority:TUIDrawPriorityLow block:[self _drawNamed:@"b"]];
+	STAssertEquals(dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC)), 0L, @"b should draw while a is busy");
+	[self _waitForDraws:1];
+
+	STAssertEqualObjects(order, ([NSArray arrayWithObjects:@"b", @"a", nil]), nil);
+}
+
+@end
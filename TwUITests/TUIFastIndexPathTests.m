@@ -0,0 +1,135 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIFastIndexPath.h"
+
+#define BENCHMARK_ITERATIONS 1000000
+#define HASH_BUCKET_COUNT 64
+
+@interface TUIFastIndexPathTests : SenTestCase
+@end
+
+@implementation TUIFastIndexPathTests
+
+- (void)testPackedMakeAndGet
+{
+	NSUInteger values[] = {0, 1, 2, 1023, 1024, 10239, 10240, 65535, 65536, 1000000, 0x7fffffff, 0xffffffff};
+	NSUInteger count = sizeof(values) / sizeof(values[0]);
+	for(NSUInteger i = 0; i < count; ++i) {
+		for(NSUInteger j = 0; j < count; ++j) {
+			TUIPackedIndexPath p = TUIPackedIndexPathMake(values[i], values[j]);
+			STAssertEquals(TUIPackedIndexPathGetSection(p), values[i], @"section didn't survive packing");
+			STAssertEquals(TUIPackedIndexPathGetRow(p), values[j], @"row didn't survive packing");
+
+			TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathWithPackedIndexPath:p];
+			STAssertEquals(indexPath.section, values[i], @"boxed section doesn't match");
+			STAssertEquals(indexPath.row, values[j], @"boxed row doesn't match");
+			STAssertEquals(indexPath.packedIndexPath, p, @"unboxing doesn't give back the packed index path");
+		}
+	}
+	STAssertTrue(TUIPackedIndexPathNotFound != TUIPackedIndexPathMake(0, 0), @"not found collides with a real index path");
+}
+
+- (void)testPackedCompareMatchesObjectCompare
+{
+	NSUInteger values[] = {0, 1, 5, 1024, 10240, 0xffffffff};
+	NSUInteger count = sizeof(values) / sizeof(values[0]);
+	for(NSUInteger a = 0; a < count * count; ++a) {
+		for(NSUInteger b = 0; b < count * count; ++b) {
+			TUIFastIndexPath *x = [TUIFastIndexPath indexPathForRow:values[a % count] inSection:values[a / count]];
+			TUIFastIndexPath *y = [TUIFastIndexPath indexPathForRow:values[b % count] inSection:values[b / count]];
+			STAssertEquals(TUIPackedIndexPathCompare(x.packedIndexPath, y.packedIndexPath), [x compare:y], @"%@ vs %@", x, y);
+			STAssertEquals([x isEqual:y], (BOOL)(x.packedIndexPath == y.packedIndexPath), @"%@ vs %@", x, y);
+		}
+	}
+}
+
+- (void)testHash
+{
+	// equal index paths hash the same, whether cached, allocated or packed
+	TUIFastIndexPath *cached = [TUIFastIndexPath indexPathForRow:3 inSection:2];
+	TUIFastIndexPath *decoded = [NSKeyedUnarchiver unarchiveObjectWithData:[NSKeyedArchiver archivedDataWithRootObject:cached]];
+	STAssertTrue(cached != decoded, @"decoding should make a new instance");
+	STAssertEquals([cached hash], [decoded hash], @"equal index paths hash differently");
+	STAssertEquals([cached hash], TUIPackedIndexPathHash(cached.packedIndexPath), @"object and packed hashes differ");
+
+	// nearby rows across several sections spread evenly over a small table
+	NSUInteger buckets[HASH_BUCKET_COUNT] = {0};
+	NSUInteger total = 0;
+	NSMutableSet *hashes = [NSMutableSet set];
+	for(NSUInteger s = 0; s < 16; ++s) {
+		for(NSUInteger r = 0; r < 1024; ++r) {
+			NSUInteger h = TUIPackedIndexPathHash(TUIPackedIndexPathMake(s, r));
+			buckets[h % HASH_BUCKET_COUNT]++;
+			[hashes addObject:[NSNumber numberWithUnsignedInteger:h]];
+			++total;
+		}
+	}
+	STAssertEquals([hashes count], total, @"hashes of neighbouring index paths collide");
+	for(NSUInteger i = 0; i < HASH_BUCKET_COUNT; ++i)
+		STAssertTrue(buckets[i] < 2 * total / HASH_BUCKET_COUNT, @"bucket %lu holds %lu of %lu", (unsigned long)i, (unsigned long)buckets[i], (unsigned long)total);
+}
+
+- (void)testCommonIndexPathsAreShared
+{
+	STAssertTrue([TUIFastIndexPath indexPathForRow:10239 inSection:0] == [TUIFastIndexPath indexPathForRow:10239 inSection:0], @"first section rows should be preallocated");
+	STAssertTrue([TUIFastIndexPath indexPathForRow:1023 inSection:7] == [TUIFastIndexPath indexPathForRow:1023 inSection:7], @"first rows of the next sections should be preallocated");
+	STAssertEqualObjects([TUIFastIndexPath indexPathForRow:10240 inSection:0], [TUIFastIndexPath indexPathForRow:10240 inSection:0], @"allocated index paths should still be equal");
+}
+
+/**
+ * Not a test of correctness: how much the object paths cost next to packed ones,
+ * for rows outside the preallocated ranges.
+ */
+- (void)testIndexPathBenchmark
+{
+	NSUInteger sink = 0;
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	@autoreleasepool {
+		for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i) {
+			TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:20000 + i inSection:0];
+			sink += [indexPath hash];
+		}
+	}
+	CFAbsoluteTime objects = CFAbsoluteTimeGetCurrent();
+
+	for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i)
+		sink += TUIPackedIndexPathHash(TUIPackedIndexPathMake(0, 20000 + i));
+	CFAbsoluteTime packed = CFAbsoluteTimeGetCurrent();
+
+	TUIFastIndexPath *a = [TUIFastIndexPath indexPathForRow:20000 inSection:3];
+	TUIFastIndexPath *b = [TUIFastIndexPath indexPathForRow:20001 inSection:3];
+	for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i)
+		sink += [a compare:b] + [b compare:a];
+	CFAbsoluteTime objectCompares = CFAbsoluteTimeGetCurrent();
+
+	TUIPackedIndexPath pa = a.packedIndexPath;
+	TUIPackedIndexPath pb = b.packedIndexPath;
+	for(NSUInteger i = 0; i < BENCHMARK_ITERATIONS; ++i)
+		sink += TUIPackedIndexPathCompare(pa, pb + (i & 1)) + TUIPackedIndexPathCompare(pb, pa);
+	CFAbsoluteTime packedCompares = CFAbsoluteTimeGetCurrent();
+
+	NSLog(@"%d index paths: make+hash %.1fns objects, %.1fns packed; compare %.1fns objects, %.1fns packed (%lu)", BENCHMARK_ITERATIONS,
+		  (objects - start) * 1e9 / BENCHMARK_ITERATIONS,
+		  (packed - objects) * 1e9 / BENCHMARK_ITERATIONS,
+		  (objectCompares - packed) * 1e9 / BENCHMARK_ITERATIONS,
+		  (packedCompares - objectCompares) * 1e9 / BENCHMARK_ITERATIONS,
+		  (unsigned long)sink);
+}
+
+@end
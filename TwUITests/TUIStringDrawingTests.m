@@ -0,0 +1,135 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <libkern/OSAtomic.h>
+#import "TUIKit.h"
+#import "TUITextLayout.h"
+
+#define STRING_COUNT 64
+#define STRESS_ITERATIONS 2000
+#define DRAW_WIDTH 160
+#define DRAW_HEIGHT 120
+
+@interface TUIStringDrawingTests : SenTestCase
+{
+	NSMutableArray *strings;
+	CGFloat widths[STRING_COUNT];
+}
+@end
+
+/**
+ * @brief Draw @p string into a fresh bitmap and hash the pixels
+ */
+static uint64_t TUIStringDrawingTestsDrawAndHash(NSAttributedString *string)
+{
+	size_t bytesPerRow = 4 * DRAW_WIDTH;
+	void *bytes = calloc(1, bytesPerRow * DRAW_HEIGHT);
+	CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+	CGContextRef context = CGBitmapContextCreate(bytes, DRAW_WIDTH, DRAW_HEIGHT, 8, bytesPerRow, colorSpace, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+	CGColorSpaceRelease(colorSpace);
+
+	CGContextSetRGBFillColor(context, 1, 1, 1, 1);
+	CGContextFillRect(context, CGRectMake(0, 0, DRAW_WIDTH, DRAW_HEIGHT));
+	[string ab_drawInRect:CGRectMake(0, 0, DRAW_WIDTH, DRAW_HEIGHT) context:context];
+
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	const uint8_t *p = bytes;
+	for(size_t i = 0; i < bytesPerRow * DRAW_HEIGHT; ++i) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+
+	CGContextRelease(context);
+	free(bytes);
+	return hash;
+}
+
+@implementation TUIStringDrawingTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	NSString *words = @"Measuring and drawing text from many queues at once should give exactly the same sizes and pixels as doing it on one thread";
+	strings = [NSMutableArray arrayWithCapacity:STRING_COUNT];
+	for(NSUInteger i = 0; i < STRING_COUNT; ++i) {
+		TUIAttributedString *s = [TUIAttributedString stringWithString:[words substringToIndex:10 + (i * 7) % ([words length] - 10)]];
+		s.font = (i % 3 == 0) ? [TUIFont boldSystemFontOfSize:11 + i % 5] : [TUIFont systemFontOfSize:11 + i % 5];
+		s.color = [TUIColor blackColor];
+		if(i % 4 == 1)
+			s.alignment = TUITextAlignmentCenter;
+		[strings addObject:s];
+		widths[i] = 60 + (i * 13) % 140;
+	}
+
+	[[TUITextLayoutCache sharedCache] removeAllLayouts];
+}
+
+- (void)tearDown
+{
+	[[TUITextLayoutCache sharedCache] removeAllLayouts];
+	strings = nil;
+
+	[super tearDown];
+}
+
+/**
+ * Run the same measurements and draws on every global queue at once and check
+ * them against the results of running them one at a time.  A small cache limit
+ * keeps layouts being evicted and recreated while other threads use them.
+ */
+- (void)testConcurrentMeasuringAndDrawingMatchesSerial
+{
+	CGSize expectedSizes[STRING_COUNT];
+	uint64_t expectedHashes[STRING_COUNT];
+	for(NSUInteger i = 0; i < STRING_COUNT; ++i) {
+		NSAttributedString *s = [strings objectAtIndex:i];
+		expectedSizes[i] = [s ab_sizeConstrainedToWidth:widths[i]];
+		expectedHashes[i] = TUIStringDrawingTestsDrawAndHash(s);
+		STAssertTrue(expectedSizes[i].width > 0 && expectedSizes[i].height > 0, @"string %lu measured empty", (unsigned long)i);
+	}
+
+	TUITextLayoutCache *cache = [TUITextLayoutCache sharedCache];
+	NSUInteger byteLimit = cache.byteLimit;
+	cache.byteLimit = 64 * 1024;
+	[cache removeAllLayouts];
+
+	__block volatile int32_t sizeMismatches = 0;
+	__block volatile int32_t pixelMismatches = 0;
+	NSArray *s = strings;
+	CGFloat *w = widths;
+	CGSize *sizes = expectedSizes;
+	uint64_t *hashes = expectedHashes;
+	dispatch_apply(STRESS_ITERATIONS, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t iteration) {
+		@autoreleasepool {
+			NSUInteger i = (iteration * 31) % STRING_COUNT;
+			NSAttributedString *string = [s objectAtIndex:i];
+			if(!CGSizeEqualToSize([string ab_sizeConstrainedToWidth:w[i]], sizes[i]))
+				OSAtomicIncrement32Barrier(&sizeMismatches);
+			if(iteration % 8 == 0 && TUIStringDrawingTestsDrawAndHash(string) != hashes[i])
+				OSAtomicIncrement32Barrier(&pixelMismatches);
+		}
+	});
+
+	cache.byteLimit = byteLimit;
+
+	STAssertTrue(sizeMismatches == 0, @"%d sizes measured concurrently differ from serial ones", (int)sizeMismatches);
+	STAssertTrue(pixelMismatches == 0, @"%d strings drawn concurrently differ from serial drawing", (int)pixelMismatches);
+}
+
+@end
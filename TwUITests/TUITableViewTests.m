@@ -0,0 +1,273 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+
+#define BENCHMARK_ROW_COUNT 1000000
+#define BENCHMARK_JUMP_COUNT 2000
+#define BENCHMARK_STEP_COUNT 2000
+
+@interface TUITableViewTests : SenTestCase <TUITableViewDataSource, TUITableViewDelegate>
+{
+	TUITableView *tableView;
+	NSMutableArray *sections; // NSMutableArray of NSNumber row heights per section
+	NSUInteger rowCount;      // when set, one section of rowCount rows with computed heights
+	BOOL calculatesConcurrently;
+	NSUInteger cellRequests;
+}
+@end
+
+static CGFloat TUITableViewTestsHeightForRow(NSUInteger row)
+{
+	return 20 + (row * 7) % 31;
+}
+
+@implementation TUITableViewTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	tableView = [[TUITableView alloc] initWithFrame:CGRectMake(0, 0, 320, 480) style:TUITableViewStylePlain];
+	tableView.dataSource = self;
+	tableView.delegate = self;
+
+	sections = [NSMutableArray array];
+	for(NSUInteger s = 0; s < 3; ++s) {
+		NSMutableArray *rows = [NSMutableArray array];
+		for(NSUInteger r = 0; r < 50 + s * 37; ++r)
+			[rows addObject:[NSNumber numberWithFloat:TUITableViewTestsHeightForRow(r + s * 1000)]];
+		[sections addObject:rows];
+	}
+	rowCount = 0;
+	calculatesConcurrently = NO;
+	cellRequests = 0;
+}
+
+- (void)tearDown
+{
+	tableView.dataSource = nil;
+	tableView.delegate = nil;
+	tableView = nil;
+	sections = nil;
+
+	[super tearDown];
+}
+
+- (NSInteger)numberOfSectionsInTableView:(TUITableView *)table
+{
+	return (rowCount > 0) ? 1 : [sections count];
+}
+
+- (NSInteger)tableView:(TUITableView *)table numberOfRowsInSection:(NSInteger)section
+{
+	return (rowCount > 0) ? rowCount : [[sections objectAtIndex:section] count];
+}
+
+- (CGFloat)tableView:(TUITableView *)table heightForRowAtIndexPath:(TUIFastIndexPath *)indexPath
+{
+	if(rowCount > 0)
+		return TUITableViewTestsHeightForRow(indexPath.row);
+	return [[[sections objectAtIndex:indexPath.section] objectAtIndex:indexPath.row] floatValue];
+}
+
+- (BOOL)tableViewCanCalculateRowHeightsConcurrently:(TUITableView *)table
+{
+	return calculatesConcurrently;
+}
+
+- (TUITableViewCell *)tableView:(TUITableView *)table cellForRowAtIndexPath:(TUIFastIndexPath *)indexPath
+{
+	++cellRequests;
+	TUITableViewCell *cell = [table dequeueReusableCellWithIdentifier:@"cell"];
+	if(cell == nil)
+		cell = [[TUITableViewCell alloc] initWithStyle:TUITableViewCellStyleDefault reuseIdentifier:@"cell"];
+	return cell;
+}
+
+/**
+ * @brief Check every row against the model: the right height, stacked top to bottom with no gaps
+ */
+- (void)_assertRowRectsMatchModel
+{
+	CGFloat top = tableView.contentSize.height;
+	for(NSUInteger s = 0; s < [sections count]; ++s) {
+		NSArray *rows = [sections objectAtIndex:s];
+		for(NSUInteger r = 0; r < [rows count]; ++r) {
+			CGRect rect = [tableView rectForRowAtIndexPath:[TUIFastIndexPath indexPathForRow:r inSection:s]];
+			CGFloat height = [[rows objectAtIndex:r] floatValue];
+			STAssertEquals(rect.size.height, height, @"row %lu in section %lu has the wrong height", (unsigned long)r, (unsigned long)s);
+			STAssertEquals(CGRectGetMaxY(rect), top, @"row %lu in section %lu doesn't follow the row above it", (unsigned long)r, (unsigned long)s);
+			top = rect.origin.y;
+		}
+	}
+	STAssertEquals(top, (CGFloat)0.0, @"rows don't add up to the content height");
+}
+
+- (void)testRowOffsets
+{
+	[tableView reloadData];
+	[self _assertRowRectsMatchModel];
+
+	// every point lands in the row that covers it
+	CGFloat height = tableView.contentSize.height;
+	for(CGFloat y = 0.5; y < height; y += 7.0) {
+		TUIFastIndexPath *indexPath = [tableView indexPathForRowAtVerticalOffset:y];
+		STAssertNotNil(indexPath, @"no row at %f", y);
+		CGRect rect = [tableView rectForRowAtIndexPath:indexPath];
+		STAssertTrue(y >= CGRectGetMinY(rect) && y <= CGRectGetMaxY(rect), @"row %@ doesn't cover %f", indexPath, y);
+	}
+}
+
+- (void)testRowOffsetsAfterPrepending
+{
+	[tableView reloadData];
+
+	// enough prepends to outgrow the headroom more than once
+	NSMutableArray *rows = [sections objectAtIndex:1];
+	for(NSUInteger i = 0; i < 5; ++i) {
+		NSUInteger count = 3 + i * 40;
+		for(NSUInteger r = 0; r < count; ++r)
+			[rows insertObject:[NSNumber numberWithFloat:TUITableViewTestsHeightForRow(5000 + i * 100 + r)] atIndex:0];
+		[tableView prependRows:count toSection:1];
+		[self _assertRowRectsMatchModel];
+	}
+}
+
+- (void)testRowOffsetsAfterUpdates
+{
+	[tableView reloadData];
+
+	NSMutableArray *rows = [sections objectAtIndex:2];
+	[rows removeObjectsInRange:NSMakeRange(10, 5)];
+	[rows insertObject:[NSNumber numberWithFloat:77] atIndex:3];
+	[rows replaceObjectAtIndex:20 withObject:[NSNumber numberWithFloat:99]];
+
+	[tableView beginUpdates];
+	NSMutableArray *deleted = [NSMutableArray array];
+	for(NSUInteger r = 10; r < 15; ++r)
+		[deleted addObject:[TUIFastIndexPath indexPathForRow:r inSection:2]];
+	[tableView deleteRowsAtIndexPaths:deleted animated:NO];
+	[tableView insertRowsAtIndexPaths:[NSArray arrayWithObject:[TUIFastIndexPath indexPathForRow:3 inSection:2]] animated:NO];
+	[tableView reloadRowsAtIndexPaths:[NSArray arrayWithObject:[TUIFastIndexPath indexPathForRow:24 inSection:2]] animated:NO];
+	[tableView endUpdates];
+
+	[self _assertRowRectsMatchModel];
+}
+
+- (void)testVisibleCellsMatchTheirIndexPaths
+{
+	// far enough down that index paths aren't the preallocated ones
+	rowCount = 50000;
+	[tableView reloadData];
+	CGFloat maximumY = tableView.contentSize.height - tableView.bounds.size.height;
+	tableView.contentOffset = CGPointMake(0, -floor(maximumY / 2));
+	[tableView layoutSubviews];
+
+	NSArray *indexPaths = [tableView indexPathsForVisibleRows];
+	NSArray *cells = [tableView visibleCells];
+	STAssertTrue([indexPaths count] > 0, @"no visible rows");
+	STAssertEquals([cells count], [indexPaths count], nil);
+	STAssertTrue(((TUIFastIndexPath *)[indexPaths objectAtIndex:0]).row > 10240, @"the test should be past the preallocated index paths");
+	for(NSUInteger i = 0; i < [cells count]; ++i) {
+		TUIFastIndexPath *indexPath = [indexPaths objectAtIndex:i];
+		TUITableViewCell *cell = [cells objectAtIndex:i];
+		STAssertEqualObjects([tableView indexPathForCell:cell], indexPath, nil);
+		STAssertTrue([tableView cellForRowAtIndexPath:indexPath] == cell, @"wrong cell for %@", indexPath);
+		STAssertTrue(CGRectEqualToRect(cell.frame, [tableView rectForRowAtIndexPath:indexPath]), @"cell for %@ is out of place", indexPath);
+	}
+	STAssertNil([tableView cellForRowAtIndexPath:[TUIFastIndexPath indexPathForRow:0 inSection:0]], @"rows outside the window have no cell");
+}
+
+- (void)testVisibleCellsStayDuringConcurrentReload
+{
+	[tableView reloadData];
+	NSArray *cells = [tableView visibleCells];
+	NSMutableArray *frames = [NSMutableArray array];
+	for(TUITableViewCell *cell in cells)
+		[frames addObject:[NSValue valueWithRect:cell.frame]];
+	STAssertTrue([cells count] > 0, @"no visible rows");
+	
+	calculatesConcurrently = YES;
+	NSUInteger requestsBeforeReload = cellRequests;
+	[[sections objectAtIndex:0] insertObject:[NSNumber numberWithFloat:40] atIndex:0];
+	[tableView reloadData];
+	[tableView layoutSubviews];
+	
+	STAssertEquals(cellRequests, requestsBeforeReload, @"no cells should be requested until the new layout is in");
+	STAssertEqualObjects([tableView visibleCells], cells, nil);
+	for(NSUInteger i = 0; i < [cells count]; ++i) {
+		TUITableViewCell *cell = [cells objectAtIndex:i];
+		STAssertFalse(cell.hidden, @"cells should stay visible while the reload is pending");
+		STAssertTrue(cell.superview == tableView, nil);
+		STAssertTrue(CGRectEqualToRect(cell.frame, [[frames objectAtIndex:i] rectValue]), @"cells should stay where the old layout put them");
+	}
+	
+	// the new layout is swapped in on the main queue
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5.0];
+	while(cellRequests == requestsBeforeReload && [timeout timeIntervalSinceNow] > 0)
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+	STAssertTrue(cellRequests > requestsBeforeReload, @"cells should be requested once the reload finishes");
+	[self _assertRowRectsMatchModel];
+}
+
+/**
+ * Lay out a million rows, then scroll through them: jumps across the whole table,
+ * followed by small steps that move the visible window a few rows at a time.
+ * Each step is checked against the rows in the visible rect.
+ */
+- (void)testScrollingMillionRowsBenchmark
+{
+	rowCount = BENCHMARK_ROW_COUNT;
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	[tableView reloadData];
+	CFAbsoluteTime loaded = CFAbsoluteTimeGetCurrent();
+
+	CGFloat maximumY = tableView.contentSize.height - tableView.bounds.size.height;
+	for(NSUInteger i = 0; i < BENCHMARK_JUMP_COUNT; ++i) {
+		CGFloat y = floor(maximumY * ((i * 7919) % BENCHMARK_JUMP_COUNT) / BENCHMARK_JUMP_COUNT);
+		tableView.contentOffset = CGPointMake(0, -y);
+		[tableView layoutSubviews];
+	}
+	CFAbsoluteTime jumped = CFAbsoluteTimeGetCurrent();
+
+	CGFloat y = floor(maximumY / 2);
+	for(NSUInteger i = 0; i < BENCHMARK_STEP_COUNT; ++i) {
+		y += 13.0;
+		tableView.contentOffset = CGPointMake(0, -y);
+		[tableView layoutSubviews];
+
+		NSArray *expected = [tableView indexPathsForRowsInRect:[tableView visibleRect]];
+		NSArray *visible = [tableView indexPathsForVisibleRows];
+		STAssertEquals([visible count], [expected count], @"wrong number of visible cells at %f", y);
+		if([visible count] > 0 && [expected count] > 0)
+			STAssertEqualObjects([visible objectAtIndex:0], [expected objectAtIndex:0], @"wrong first visible row at %f", y);
+	}
+	CFAbsoluteTime stepped = CFAbsoluteTimeGetCurrent();
+
+	NSLog(@"%d rows: reload %.1fms, %d jumps %.3fms each, %d steps %.3fms each", BENCHMARK_ROW_COUNT,
+		  (loaded - start) * 1000.0,
+		  BENCHMARK_JUMP_COUNT, (jumped - loaded) * 1000.0 / BENCHMARK_JUMP_COUNT,
+		  BENCHMARK_STEP_COUNT, (stepped - jumped) * 1000.0 / BENCHMARK_STEP_COUNT);
+
+	// generous bounds, this is about catching per-frame work that grows with the row count
+	STAssertTrue((jumped - loaded) / BENCHMARK_JUMP_COUNT < 0.005, @"jumping to a row takes too long");
+	STAssertTrue((stepped - jumped) / BENCHMARK_STEP_COUNT < 0.005, @"scrolling a few rows takes too long");
+}
+
+@end
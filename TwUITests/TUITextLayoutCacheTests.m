@@ -0,0 +1,178 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+#import "TUITextLayout.h"
+
+@interface TUITextLayoutCacheTests : SenTestCase
+{
+	TUITextLayoutCache *cache;
+}
+@end
+
+static TUIAttributedString *TUITextLayoutCacheTestsString(NSString *string)
+{
+	TUIAttributedString *s = [TUIAttributedString stringWithString:string];
+	s.font = [TUIFont systemFontOfSize:12];
+	s.color = [TUIColor blackColor];
+	return s;
+}
+
+@implementation TUITextLayoutCacheTests
+
+- (void)setUp
+{
+	[super setUp];
+	cache = [[TUITextLayoutCache alloc] init]; // not the shared one, so nothing else touches it
+}
+
+- (void)tearDown
+{
+	cache = nil;
+	[super tearDown];
+}
+
+- (void)testEqualStringsShareALayout
+{
+	TUIAttributedString *s = TUITextLayoutCacheTestsString(@"The quick brown fox");
+	TUITextLayout *layout = [cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:0];
+	STAssertNotNil(layout, nil);
+
+	// a different instance with the same contents
+	TUITextLayout *again = [cache layoutForAttributedString:[s mutableCopy] size:CGSizeMake(200, 100) numberOfLines:0];
+	STAssertTrue(layout == again, @"equal strings in equal containers should share a layout");
+
+	TUITextLayoutCacheStatistics statistics = [cache statistics];
+	STAssertEquals(statistics.misses, (NSUInteger)1, nil);
+	STAssertEquals(statistics.hits, (NSUInteger)1, nil);
+	STAssertEquals(statistics.count, (NSUInteger)1, nil);
+	STAssertEquals(statistics.bytes, layout.cost, nil);
+}
+
+- (void)testKeyIncludesWidthLinesAndContents
+{
+	TUIAttributedString *s = TUITextLayoutCacheTestsString(@"The quick brown fox jumps over the lazy dog");
+	TUITextLayout *layout = [cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:0];
+
+	STAssertTrue(layout != [cache layoutForAttributedString:s size:CGSizeMake(100, 100) numberOfLines:0], @"width is part of the key");
+	STAssertTrue(layout != [cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:1], @"line limit is part of the key");
+
+	// the cache keeps its own copy, so changing the string afterwards is a different key
+	[s replaceCharactersInRange:NSMakeRange(0, 3) withString:@"A"];
+	TUITextLayout *changed = [cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:0];
+	STAssertTrue(layout != changed, @"contents are part of the key");
+	STAssertEqualObjects([layout.attributedString string], @"The quick brown fox jumps over the lazy dog", @"a cached layout's string shouldn't change with its source");
+}
+
+- (void)testFittingLayoutServesTallerContainers
+{
+	TUIAttributedString *s = TUITextLayoutCacheTestsString(@"Two lines of text, once it's wrapped at this width");
+	TUITextLayout *measured = [cache layoutForAttributedString:s size:CGSizeMake(150, 2000) numberOfLines:0];
+	STAssertTrue(measured.containsEntireString, nil);
+
+	// the row it's drawn in is just tall enough
+	CGFloat height = measured.size.height;
+	STAssertTrue([cache layoutForAttributedString:s size:CGSizeMake(150, height) numberOfLines:0] == measured, @"a layout that fits should serve any container it fits in");
+	STAssertTrue([cache layoutForAttributedString:s size:CGSizeMake(150, 3000) numberOfLines:0] == measured, @"a layout that fits should serve taller containers");
+	STAssertTrue([cache layoutForAttributedString:s size:CGSizeMake(150, floor(height / 2)) numberOfLines:0] != measured, @"a container the text doesn't fit needs its own layout");
+}
+
+- (void)testLeastRecentlyUsedIsEvicted
+{
+	CGSize size = CGSizeMake(200, 100);
+	TUITextLayout *a = [cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 1") size:size numberOfLines:0];
+	TUITextLayout *b = [cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 2") size:size numberOfLines:0];
+	TUITextLayout *c = [cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 3") size:size numberOfLines:0];
+	STAssertEquals(a.cost, b.cost, @"the test needs layouts of equal cost");
+	cache.byteLimit = a.cost + b.cost + c.cost;
+	STAssertEquals([cache statistics].count, (NSUInteger)3, nil);
+
+	// use a, so b is now the least recently used
+	STAssertTrue([cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 1") size:size numberOfLines:0] == a, nil);
+	[cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 4") size:size numberOfLines:0];
+
+	TUITextLayoutCacheStatistics statistics = [cache statistics];
+	STAssertEquals(statistics.evictions, (NSUInteger)1, nil);
+	STAssertEquals(statistics.count, (NSUInteger)3, nil);
+	STAssertTrue(statistics.bytes <= cache.byteLimit, nil);
+	STAssertTrue([cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 1") size:size numberOfLines:0] == a, @"a was used recently and should still be cached");
+	STAssertTrue([cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 3") size:size numberOfLines:0] == c, @"c should still be cached");
+	STAssertTrue([cache layoutForAttributedString:TUITextLayoutCacheTestsString(@"row 2") size:size numberOfLines:0] != b, @"b was least recently used and should have been evicted");
+}
+
+- (void)testLoweringTheLimitTrims
+{
+	for(NSUInteger i = 0; i < 20; ++i)
+		[cache layoutForAttributedString:TUITextLayoutCacheTestsString([NSString stringWithFormat:@"row %02lu", (unsigned long)i]) size:CGSizeMake(200, 100) numberOfLines:0];
+	STAssertEquals([cache statistics].count, (NSUInteger)20, nil);
+
+	cache.byteLimit = [cache statistics].bytes / 2;
+	TUITextLayoutCacheStatistics statistics = [cache statistics];
+	STAssertTrue(statistics.bytes <= cache.byteLimit, nil);
+	STAssertEquals(statistics.count + statistics.evictions, (NSUInteger)20, nil);
+
+	cache.byteLimit = 0;
+	STAssertEquals([cache statistics].count, (NSUInteger)0, nil);
+	STAssertEquals([cache statistics].bytes, (NSUInteger)0, nil);
+}
+
+- (void)testRemoveAllLayouts
+{
+	TUIAttributedString *s = TUITextLayoutCacheTestsString(@"The quick brown fox");
+	TUITextLayout *layout = [cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:0];
+	[cache removeAllLayouts];
+	STAssertEquals([cache statistics].count, (NSUInteger)0, nil);
+	STAssertEquals([cache statistics].bytes, (NSUInteger)0, nil);
+	STAssertTrue([cache layoutForAttributedString:s size:CGSizeMake(200, 100) numberOfLines:0] != layout, @"layouts should be made again after removing them all");
+}
+
+- (void)testSharedFrameCountsOnce
+{
+	// narrow enough to wrap, so one line is less than the whole layout
+	TUIAttributedString *s = TUITextLayoutCacheTestsString(@"The quick brown fox jumps over the lazy dog");
+	CGSize size = CGSizeMake(60, 200);
+	TUITextLayout *full = [cache layoutForAttributedString:s size:size numberOfLines:0];
+	TUITextLayout *oneLine = [cache layoutForAttributedString:s size:size numberOfLines:1];
+	STAssertTrue(oneLine.ctFrame == full.ctFrame, @"the test needs layouts sharing a frame");
+	STAssertEquals([cache statistics].count, (NSUInteger)2, nil);
+	STAssertTrue([cache statistics].bytes < full.cost + oneLine.cost, @"the shared frame should only count once");
+	
+	// the full layout is least recently used; once it's gone the one-line layout is all that holds the frame
+	cache.byteLimit = [cache statistics].bytes - 1;
+	STAssertEquals([cache statistics].count, (NSUInteger)1, nil);
+	STAssertEquals([cache statistics].bytes, oneLine.cost, @"the last layout holding the frame should be charged for it");
+}
+
+- (void)testRecencyAfterManyLookups
+{
+	// every other layout used again, then enough new ones to evict half
+	CGSize size = CGSizeMake(200, 100);
+	NSMutableArray *kept = [NSMutableArray array];
+	for(NSUInteger i = 0; i < 40; ++i)
+		[kept addObject:[cache layoutForAttributedString:TUITextLayoutCacheTestsString([NSString stringWithFormat:@"row %02lu", (unsigned long)i]) size:size numberOfLines:0]];
+	cache.byteLimit = [cache statistics].bytes;
+	for(NSUInteger i = 0; i < 40; i += 2)
+		[cache layoutForAttributedString:TUITextLayoutCacheTestsString([NSString stringWithFormat:@"row %02lu", (unsigned long)i]) size:size numberOfLines:0];
+	for(NSUInteger i = 0; i < 20; ++i)
+		[cache layoutForAttributedString:TUITextLayoutCacheTestsString([NSString stringWithFormat:@"new %02lu", (unsigned long)i]) size:size numberOfLines:0];
+
+	STAssertEquals([cache statistics].evictions, (NSUInteger)20, nil);
+	for(NSUInteger i = 0; i < 40; i += 2)
+		STAssertTrue([cache layoutForAttributedString:TUITextLayoutCacheTestsString([NSString stringWithFormat:@"row %02lu", (unsigned long)i]) size:size numberOfLines:0] == [kept objectAtIndex:i], @"row %lu was used recently and should still be cached", (unsigned long)i);
+}
+
+@end
@@ -0,0 +1,121 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+#import "TUIView+Private.h"
+
+@interface TUIViewDirtyRegionTests : SenTestCase
+@end
+
+static BOOL TUIViewDirtyRegionTestsContains(const TUIViewDirtyRegion *region, CGRect r)
+{
+	for(NSUInteger i = 0; i < region->count; ++i) {
+		if(CGRectContainsRect(region->rects[i], r))
+			return YES;
+	}
+	return NO;
+}
+
+@implementation TUIViewDirtyRegionTests
+
+- (void)testContainedRectIsDropped
+{
+	TUIViewDirtyRegion region = {NO, 0};
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(0, 0, 100, 100));
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(10, 10, 20, 20));
+	STAssertEquals(region.count, (NSUInteger)1, @"a rect inside another shouldn't be kept");
+	STAssertTrue(CGRectEqualToRect(region.rects[0], CGRectMake(0, 0, 100, 100)), @"the outer rect should be unchanged");
+}
+
+- (void)testDistantRectsStayApart
+{
+	TUIViewDirtyRegion region = {NO, 0};
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(0, 0, 10, 10));
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(200, 200, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)2, @"merging far apart rects would redraw everything between them");
+}
+
+- (void)testTouchingRectsMerge
+{
+	TUIViewDirtyRegion region = {NO, 0};
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(0, 0, 10, 10));
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(10, 0, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)1, @"side by side rects cost nothing to merge");
+	STAssertTrue(CGRectEqualToRect(region.rects[0], CGRectMake(0, 0, 20, 10)), @"merged rect should be their union");
+}
+
+- (void)testMergeCascades
+{
+	// the middle rect joins the left one, and the result then touches the right one
+	TUIViewDirtyRegion region = {NO, 0};
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(0, 0, 10, 10));
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(20, 0, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)2, nil);
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(10, 0, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)1, @"rects joined by a new one should end up as one");
+	STAssertTrue(CGRectEqualToRect(region.rects[0], CGRectMake(0, 0, 30, 10)), @"merged rect should cover all three");
+}
+
+- (void)testFullRegionMergesCheapest
+{
+	TUIViewDirtyRegion region = {NO, 0};
+	for(NSUInteger i = 0; i < TUIViewMaximumDirtyRects; ++i)
+		TUIViewDirtyRegionAddRect(&region, CGRectMake(i * 100, 0, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)TUIViewMaximumDirtyRects, nil);
+
+	// closest to the first rect, so that's the one that should grow
+	TUIViewDirtyRegionAddRect(&region, CGRectMake(0, 20, 10, 10));
+	STAssertEquals(region.count, (NSUInteger)TUIViewMaximumDirtyRects, @"a full region can't hold more rects");
+	STAssertTrue(TUIViewDirtyRegionTestsContains(&region, CGRectMake(0, 0, 10, 30)), @"the new rect should be merged with its nearest neighbour");
+	for(NSUInteger i = 1; i < TUIViewMaximumDirtyRects; ++i)
+		STAssertTrue(TUIViewDirtyRegionTestsContains(&region, CGRectMake(i * 100, 0, 10, 10)), @"other rects shouldn't grow");
+}
+
+- (void)testEveryRectStaysCovered
+{
+	srandom(42);
+	TUIViewDirtyRegion region = {NO, 0};
+	CGRect added[500];
+	for(NSUInteger i = 0; i < 500; ++i) {
+		added[i] = CGRectMake(random() % 1000, random() % 1000, 1 + random() % 60, 1 + random() % 60);
+		TUIViewDirtyRegionAddRect(&region, added[i]);
+		STAssertTrue(region.count >= 1 && region.count <= TUIViewMaximumDirtyRects, @"region holds %lu rects", (unsigned long)region.count);
+		for(NSUInteger j = 0; j <= i; ++j)
+			STAssertTrue(TUIViewDirtyRegionTestsContains(&region, added[j]), @"rect %lu fell out of the region after adding rect %lu", (unsigned long)j, (unsigned long)i);
+	}
+}
+
+- (void)testViewAccumulatesDirtyRects
+{
+	TUIView *view = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 100, 100)];
+	view->_context.dirtyRegion.everything = NO;
+	view->_context.dirtyRegion.count = 0;
+
+	[view setNeedsDisplayInRect:CGRectMake(10.5, 10.5, 10, 10)];
+	[view setNeedsDisplayInRect:CGRectMake(90, 90, 50, 50)];
+	[view setNeedsDisplayInRect:CGRectMake(200, 200, 10, 10)];
+	STAssertEquals(view->_context.dirtyRegion.count, (NSUInteger)2, @"rects outside the bounds should be dropped");
+	STAssertTrue(TUIViewDirtyRegionTestsContains(&view->_context.dirtyRegion, CGRectMake(10, 10, 11, 11)), @"rects should be made integral");
+	STAssertTrue(TUIViewDirtyRegionTestsContains(&view->_context.dirtyRegion, CGRectMake(90, 90, 10, 10)), @"rects should be clipped to the bounds");
+	STAssertFalse(TUIViewDirtyRegionTestsContains(&view->_context.dirtyRegion, CGRectMake(90, 90, 11, 11)), @"rects should be clipped to the bounds");
+
+	[view setNeedsDisplay];
+	[view setNeedsDisplayInRect:CGRectMake(0, 0, 10, 10)];
+	STAssertTrue(view->_context.dirtyRegion.everything, @"a rect added after a full invalidation shouldn't shrink it");
+}
+
+@end
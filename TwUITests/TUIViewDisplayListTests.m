@@ -0,0 +1,113 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+
+@interface TUIViewDisplayListTests : SenTestCase
+{
+	TUIView *view;
+	NSUInteger draws;
+	CGRect lastDrawRect;
+}
+@end
+
+@implementation TUIViewDisplayListTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	view = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 100, 100)];
+	view.recordsDisplayList = YES;
+	draws = 0;
+	__unsafe_unretained TUIViewDisplayListTests *test = self;
+	view.drawRect = ^(TUIView *v, CGRect rect) {
+		test->draws++;
+		test->lastDrawRect = rect;
+		[[TUIColor redColor] set];
+		CGContextFillRect(TUIGraphicsGetCurrentContext(), rect);
+	};
+}
+
+- (void)tearDown
+{
+	view = nil;
+	[super tearDown];
+}
+
+- (void)_display
+{
+	[view displayLayer:view.layer];
+}
+
+- (void)testFirstDisplayRecordsTheWholeView
+{
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)1, nil);
+	STAssertTrue(CGRectEqualToRect(lastDrawRect, view.bounds), @"the first recording should cover the whole view");
+	STAssertNotNil(view.layer.contents, nil);
+}
+
+- (void)testScaleChangeReplaysWithoutDrawing
+{
+	[self _display];
+	view.layer.contentsScale = 2.0;
+	[view.layer setNeedsDisplay];
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)1, @"a new scale should be rendered from the display list");
+}
+
+- (void)testPartialInvalidationRecordsOnlyTheRect
+{
+	[self _display];
+	[view setNeedsDisplayInRect:CGRectMake(10, 10, 20, 20)];
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)2, nil);
+	STAssertTrue(CGRectEqualToRect(lastDrawRect, CGRectMake(10, 10, 20, 20)), @"only the invalidated rect should be drawn again");
+
+	// the list now holds both recordings, so another scale is still free
+	view.layer.contentsScale = 2.0;
+	[view.layer setNeedsDisplay];
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)2, @"a partial recording shouldn't throw the display list away");
+}
+
+- (void)testSetNeedsDisplayRecordsAgain
+{
+	[self _display];
+	[view setNeedsDisplay];
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)2, nil);
+	STAssertTrue(CGRectEqualToRect(lastDrawRect, view.bounds), @"a full invalidation should record the whole view");
+}
+
+- (void)testManyPartialInvalidationsRecordAgainInFull
+{
+	[self _display];
+	for(NSUInteger i = 0; i < 20; ++i) {
+		[view setNeedsDisplayInRect:CGRectMake(i * 4, 0, 2, 2)];
+		[self _display];
+	}
+	STAssertEquals(draws, (NSUInteger)21, @"each invalidation is drawn once");
+
+	view.layer.contentsScale = 2.0;
+	[view.layer setNeedsDisplay];
+	[self _display];
+	STAssertEquals(draws, (NSUInteger)21, @"the list should still be good after folding the recordings");
+}
+
+@end
@@ -0,0 +1,106 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+#import "TUIKit.h"
+
+@interface TUIViewFlatteningTests : SenTestCase
+{
+	TUIView *root;
+	TUIView *child;
+	TUIView *grandchild;
+	NSUInteger childDraws;
+}
+@end
+
+@implementation TUIViewFlatteningTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	root = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 100, 100)];
+	child = [[TUIView alloc] initWithFrame:CGRectMake(10, 10, 50, 50)];
+	child.backgroundColor = [TUIColor redColor];
+	grandchild = [[TUIView alloc] initWithFrame:CGRectMake(5, 5, 20, 20)];
+	childDraws = 0;
+	__unsafe_unretained TUIViewFlatteningTests *test = self;
+	grandchild.drawRect = ^(TUIView *v, CGRect rect) {
+		test->childDraws++;
+		[[TUIColor blueColor] set];
+		CGContextFillRect(TUIGraphicsGetCurrentContext(), rect);
+	};
+	[child addSubview:grandchild];
+	[root addSubview:child];
+	root.flattensSubtree = YES;
+}
+
+- (void)tearDown
+{
+	root = nil;
+	child = nil;
+	grandchild = nil;
+	[super tearDown];
+}
+
+- (void)testDescendantsAreDrawnIntoTheRoot
+{
+	[root displayLayer:root.layer];
+	STAssertNotNil(root.layer.contents, nil);
+	STAssertEquals(childDraws, (NSUInteger)1, @"the grandchild should draw into the root's bitmap");
+	STAssertNil(child.layer.contents, nil);
+	STAssertNil(grandchild.layer.contents, nil);
+	STAssertTrue(child.layer.backgroundColor == NULL, @"the background is drawn by the root");
+	STAssertEqualObjects(child.backgroundColor, [TUIColor redColor], nil);
+}
+
+- (void)testDescendantInvalidationDirtiesTheRoot
+{
+	[root displayLayer:root.layer];
+	root->_context.dirtyRegion.everything = NO;
+	root->_context.dirtyRegion.count = 0;
+	[grandchild setNeedsDisplayInRect:CGRectMake(0, 0, 10, 10)];
+	STAssertEquals(root->_context.dirtyRegion.count, (NSUInteger)1, nil);
+	STAssertTrue(CGRectEqualToRect(root->_context.dirtyRegion.rects[0], CGRectMake(15, 15, 10, 10)), @"the rect should be in the root's coordinates");
+}
+
+- (void)testFrameChangeDirtiesTheRoot
+{
+	[root displayLayer:root.layer];
+	root->_context.dirtyRegion.everything = NO;
+	child.frame = CGRectMake(20, 20, 50, 50);
+	STAssertTrue(root->_context.dirtyRegion.everything, nil);
+}
+
+- (void)testStatistics
+{
+	[root displayLayer:root.layer];
+	TUIViewFlatteningStatistics statistics = [root flatteningStatistics];
+	STAssertEquals(statistics.layersSaved, (NSUInteger)2, nil);
+	STAssertEquals(statistics.bytesSaved, (NSUInteger)(20 * 20 * 4), nil);
+	STAssertEquals(statistics.cacheBytes, (NSUInteger)(100 * 100 * 4), nil);
+}
+
+- (void)testUnflatteningRestoresTheSubtree
+{
+	root.flattensSubtree = NO;
+	STAssertTrue(child.layer.backgroundColor != NULL, nil);
+	STAssertEquals([root flatteningStatistics].layersSaved, (NSUInteger)0, nil);
+	[child removeFromSuperview];
+	STAssertEqualObjects(child.backgroundColor, [TUIColor redColor], nil);
+}
+
+@end
@@ -25,6 +25,34 @@ typedef enum {
 	AB_CTLineRectAggregationTypeBlock,
 } AB_CTLineRectAggregationType;
 
+/**
+ Metrics of every line of a CTFrame, read once so hit testing and rect lookups
+ don't go back to Core Text (or allocate) for each line on every call.  Lines
+ are in frame order: string ranges ascending, origins descending.
+ */
+typedef struct {
+	CTLineRef line; // not retained, the frame holds on to it
+	CGPoint origin; // relative to the frame's path
+	CGFloat ascent;
+	CGFloat descent;
+	CGFloat leading;
+	CFRange stringRange;
+} AB_CTLineMetrics;
+
+typedef struct {
+	CTFrameRef frame; // retained
+	CGRect bounds; // of the frame's path
+	CFIndex stringLength; // of the frame's string range
+	CFIndex lineCount;
+	AB_CTLineMetrics *lines;
+} AB_CTFrameMetrics;
+
+extern AB_CTFrameMetrics *AB_CTFrameMetricsCreate(CTFrameRef frame);
+extern void AB_CTFrameMetricsRelease(AB_CTFrameMetrics *metrics);
+extern CGFloat AB_CTFrameMetricsGetHeight(const AB_CTFrameMetrics *metrics);
+extern CFIndex AB_CTFrameMetricsGetStringIndexForPosition(const AB_CTFrameMetrics *metrics, CGPoint p);
+extern void AB_CTFrameMetricsGetRectsForRangeWithAggregationType(const AB_CTFrameMetrics *metrics, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount);
+
 extern CGSize AB_CTLineGetSize(CTLineRef line);
 extern CGSize AB_CTFrameGetSize(CTFrameRef frame);
 extern CGFloat AB_CTFrameGetHeight(CTFrameRef frame);
@@ -55,87 +55,101 @@ CGSize AB_CTFrameGetSize(CTFrameRef frame)
 	return CGSizeMake(ceil(w), ceil(h));
 }
 
-CGFloat AB_CTFrameGetHeight(CTFrameRef f)
+static inline void AB_CTLineMetricsInit(AB_CTLineMetrics *m, CTLineRef line, CGPoint origin)
 {
-	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(f);
-	NSInteger n = (NSInteger)[lines count];
-	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * n);
-	CTFrameGetLineOrigins(f, CFRangeMake(0, n), lineOrigins);
-	
-	CGPoint first, last;
-	
-	CGFloat h = 0.0;
-	for(int i = 0; i < n; ++i) {
-		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
-		CGFloat ascent, descent, leading;
-		CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-		if(i == 0) {
-			first = lineOrigins[i];
-			h += ascent;
-			h += descent;
-		}
-		if(i == n-1) {
-			last = lineOrigins[i];
-			h += first.y - last.y;
-			h += descent;
-			free(lineOrigins);
-			return ceil(h);
-		}
-	}
-	free(lineOrigins);
-	return 0.0;
+	m->line = line;
+	m->origin = origin;
+	CTLineGetTypographicBounds(line, &m->ascent, &m->descent, &m->leading);
+	m->stringRange = CTLineGetStringRange(line);
 }
 
-CFIndex AB_CTFrameGetStringIndexForPosition(CTFrameRef frame, CGPoint p)
+AB_CTFrameMetrics *AB_CTFrameMetricsCreate(CTFrameRef frame)
 {
-//	p = (CGPoint){0, 0};
-//	NSLog(@"checking p = %@", NSStringFromCGPoint(p));
-//	CGRect f = [self frame];
-//	NSLog(@"frame = %@", f);
 	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
-	
 	CFIndex linesCount = [lines count];
-	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * linesCount);
-	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
 	
-	CTLineRef line = NULL;
-	CGPoint lineOrigin = CGPointZero;
-	
-	for(CFIndex i = 0; i < linesCount; ++i) {
-		line = (__bridge CTLineRef)[lines objectAtIndex:i];
-		lineOrigin = lineOrigins[i];
-//		NSLog(@"%d origin = %@", i, NSStringFromCGPoint(lineOrigin));
-		CGFloat descent, ascent;
-		CTLineGetTypographicBounds(line, &ascent, &descent, NULL);
-		if(p.y > (floor(lineOrigin.y) - floor(descent))) { // above bottom of line
-			if(i == 0 && (p.y > (ceil(lineOrigin.y) + ceil(ascent)))) { // above top of first line
-				free(lineOrigins);
-				return 0;
-			} else {
-				goto found;
-			}
-		}
-	}
+	// one block for the table and its lines
+	AB_CTFrameMetrics *metrics = (AB_CTFrameMetrics *) malloc(sizeof(AB_CTFrameMetrics) + sizeof(AB_CTLineMetrics) * linesCount);
+	metrics->frame = (CTFrameRef)CFRetain(frame);
+	metrics->bounds = CGPathGetBoundingBox(CTFrameGetPath(frame));
+	metrics->stringLength = CTFrameGetStringRange(frame).length;
+	metrics->lineCount = linesCount;
+	metrics->lines = (AB_CTLineMetrics *)(metrics + 1);
 	
+	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * MAX(linesCount, 1));
+	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
+	for(CFIndex i = 0; i < linesCount; ++i)
+		AB_CTLineMetricsInit(&metrics->lines[i], (__bridge CTLineRef)[lines objectAtIndex:i], lineOrigins[i]);
 	free(lineOrigins);
 	
-	// didn't find a line, must be beneath the last line
-	return CTFrameGetStringRange(frame).length; // last character index
+	return metrics;
+}
 
-found:
+void AB_CTFrameMetricsRelease(AB_CTFrameMetrics *metrics)
+{
+	if(metrics) {
+		CFRelease(metrics->frame);
+		free(metrics);
+	}
+}
 
-	p.x -= lineOrigin.x;
-	p.y -= lineOrigin.y;
+CGFloat AB_CTFrameMetricsGetHeight(const AB_CTFrameMetrics *metrics)
+{
+	CFIndex n = metrics->lineCount;
+	if(n == 0)
+		return 0.0;
 	
-	if(line) {
-		CFIndex i = CTLineGetStringIndexForPosition(line, p);
-		free(lineOrigins);
-		return i;
+	const AB_CTLineMetrics *first = &metrics->lines[0];
+	const AB_CTLineMetrics *last = &metrics->lines[n - 1];
+	CGFloat h = first->ascent + first->descent;
+	h += first->origin.y - last->origin.y;
+	h += last->descent;
+	return ceil(h);
+}
+
+CGFloat AB_CTFrameGetHeight(CTFrameRef f)
+{
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(f);
+	CGFloat h = AB_CTFrameMetricsGetHeight(metrics);
+	AB_CTFrameMetricsRelease(metrics);
+	return h;
+}
+
+CFIndex AB_CTFrameMetricsGetStringIndexForPosition(const AB_CTFrameMetrics *metrics, CGPoint p)
+{
+	// lines go down the frame, find the first one whose bottom is below p
+	CFIndex low = 0;
+	CFIndex high = metrics->lineCount;
+	while(low < high) {
+		CFIndex mid = low + (high - low) / 2;
+		const AB_CTLineMetrics *m = &metrics->lines[mid];
+		if(p.y > (floor(m->origin.y) - floor(m->descent))) { // above bottom of line
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
 	}
 	
-	free(lineOrigins);
+	if(low == metrics->lineCount) {
+		// didn't find a line, must be beneath the last line
+		return metrics->stringLength; // last character index
+	}
 	
-	return 0;
+	const AB_CTLineMetrics *m = &metrics->lines[low];
+	if(low == 0 && (p.y > (ceil(m->origin.y) + ceil(m->ascent)))) // above top of first line
+		return 0;
+	
+	p.x -= m->origin.x;
+	p.y -= m->origin.y;
+	return CTLineGetStringIndexForPosition(m->line, p);
+}
+
+CFIndex AB_CTFrameGetStringIndexForPosition(CTFrameRef frame, CGPoint p)
+{
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	CFIndex i = AB_CTFrameMetricsGetStringIndexForPosition(metrics, p);
+	AB_CTFrameMetricsRelease(metrics);
+	return i;
 }
 
 static inline BOOL RangeContainsIndex(CFRange range, CFIndex index)
@@ -152,92 +166,101 @@ void AB_CTFrameGetRectsForRange(CTFrameRef frame, CFRange range, CGRect rects[],
 
 void AB_CTFrameGetRectsForRangeWithAggregationType(CTFrameRef frame, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
 {
-	CGRect bounds;
-	CGPathIsRect(CTFrameGetPath(frame), &bounds);
-	
-	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, range, aggregationType, rects, rectCount);
+	AB_CTFrameMetricsRelease(metrics);
+}
+
+void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *lineOrigins, CGRect bounds, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
+{
 	CFIndex linesCount = [lines count];
-	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * linesCount);
-	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
+	AB_CTFrameMetrics metrics = {NULL, bounds, 0, linesCount, NULL};
+	metrics.lines = (AB_CTLineMetrics *) malloc(sizeof(AB_CTLineMetrics) * MAX(linesCount, 1));
+	for(CFIndex i = 0; i < linesCount; ++i)
+		AB_CTLineMetricsInit(&metrics.lines[i], (__bridge CTLineRef)[lines objectAtIndex:i], lineOrigins[i]);
 	
-	AB_CTLinesGetRectsForRangeWithAggregationType(lines, lineOrigins, bounds, range, aggregationType, rects, rectCount);
-	free(lineOrigins);
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType(&metrics, range, aggregationType, rects, rectCount);
+	free(metrics.lines);
 }
 
-void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *lineOrigins, CGRect bounds, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
+/**
+ * @brief Vertical extent of line @p i: its bottom in origin.y and its height in size.height
+ */
+static inline CGRect AB_CTFrameMetricsGetLineBox(const AB_CTFrameMetrics *metrics, CFIndex i)
+{
+	const AB_CTLineMetrics *m = &metrics->lines[i];
+	CFIndex linesCount = metrics->lineCount;
+	CGPoint lineOrigin = m->origin;
+	
+	// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
+	BOOL useRealHeight = i < linesCount - 1;
+	CGFloat neighborLineY = i > 0 ? metrics->lines[i - 1].origin.y : (linesCount - 1 > i ? metrics->lines[i + 1].origin.y : 0.0f);
+	CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : m->ascent + m->descent + m->leading);
+	CGFloat line_y = round(useRealHeight ? lineOrigin.y + metrics->bounds.origin.y - lineHeight/2 + m->descent : lineOrigin.y - m->descent + metrics->bounds.origin.y);
+	return CGRectMake(0.0f, line_y, 0.0f, lineHeight);
+}
+
+void AB_CTFrameMetricsGetRectsForRangeWithAggregationType(const AB_CTFrameMetrics *metrics, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
 {
 	CFIndex maxRects = *rectCount;
 	CFIndex rectIndex = 0;
+	CGRect bounds = metrics->bounds;
 	
 	CFIndex startIndex = range.location;
 	CFIndex endIndex = startIndex + range.length;
 	
-	CFIndex linesCount = [lines count];
+	CFIndex linesCount = metrics->lineCount;
 	
-	for(CFIndex i = 0; i < linesCount; ++i) {
-		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
+	// skip straight to the first line that ends at or after the start of the range
+	CFIndex low = 0;
+	CFIndex high = linesCount;
+	while(low < high) {
+		CFIndex mid = low + (high - low) / 2;
+		CFRange lineRange = metrics->lines[mid].stringRange;
+		if(lineRange.location + lineRange.length < startIndex) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	
+	for(CFIndex i = low; i < linesCount; ++i) {
+		const AB_CTLineMetrics *m = &metrics->lines[i];
+		CTLineRef line = m->line;
+		
+		CFRange lineRange = m->stringRange;
+		CFIndex lineEndIndex = lineRange.location + lineRange.length;
+		if(lineRange.location > endIndex)
+			break; // past the range
 		
-		CFRange lineRange = CTLineGetStringRange(line);
-		CFIndex lineStartIndex = lineRange.location;
-		CFIndex lineEndIndex = lineStartIndex + lineRange.length;
 		BOOL containsStartIndex = RangeContainsIndex(lineRange, startIndex);
 		BOOL containsEndIndex = RangeContainsIndex(lineRange, endIndex);
 		
 		if(containsStartIndex && containsEndIndex) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount - 1 > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
+			CGRect lineBox = AB_CTFrameMetricsGetLineBox(metrics, i);
 			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
 			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, endOffset - startOffset, lineHeight);
+			CGRect r = CGRectMake(bounds.origin.x + m->origin.x + startOffset, lineBox.origin.y, endOffset - startOffset, lineBox.size.height);
 			if(aggregationType == AB_CTLineRectAggregationTypeBlock) {
 				r.size.width = bounds.size.width - startOffset;
 			}
 			
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
-			goto end;
+			break;
 		} else if(containsStartIndex) {
 			if(startIndex == lineEndIndex)
 				continue;
 			
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
+			CGRect lineBox = AB_CTFrameMetricsGetLineBox(metrics, i);
 			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, bounds.size.width - startOffset, lineHeight);
+			CGRect r = CGRectMake(bounds.origin.x + m->origin.x + startOffset, lineBox.origin.y, bounds.size.width - startOffset, lineBox.size.height);
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		} else if(containsEndIndex) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
+			CGRect lineBox = AB_CTFrameMetricsGetLineBox(metrics, i);
 			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, endOffset, lineHeight);
+			CGRect r = CGRectMake(bounds.origin.x + m->origin.x, lineBox.origin.y, endOffset, lineBox.size.height);
 			if(aggregationType == AB_CTLineRectAggregationTypeBlock) {
 				r.size.width = bounds.size.width;
 			}
@@ -245,23 +268,12 @@ void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *line
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		} else if(RangeContainsIndex(range, lineRange.location)) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, bounds.size.width, lineHeight);
+			CGRect lineBox = AB_CTFrameMetricsGetLineBox(metrics, i);
+			CGRect r = CGRectMake(bounds.origin.x + m->origin.x, lineBox.origin.y, bounds.size.width, lineBox.size.height);
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		}
 	}
 	
-end:
 	*rectCount = rectIndex;
 }
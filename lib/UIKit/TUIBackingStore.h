@@ -0,0 +1,93 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIView.h"
+
+#define TUIBackingStoreBufferCount 3
+
+typedef struct {
+	NSUInteger bytesInUse;   // held by backing stores or by images onscreen
+	NSUInteger bytesPooled;  // idle, waiting to be reused
+	NSUInteger byteLimit;    // most bytes the pool keeps idle
+	NSUInteger hits;         // buffers served from the pool
+	NSUInteger misses;       // buffers that had to be allocated
+	NSUInteger evictions;    // idle buffers freed to stay under the limit
+	NSUInteger bytesCopied;  // latest drawings copied into newly taken bitmaps
+} TUIBackingStorePoolUsage;
+
+/**
+ Bitmaps no longer used by any backing store go into a pool shared by all views,
+ bucketed by (width, height, opaque, scale), and are handed to the next store
+ that needs the same kind.  Idle bitmaps beyond the byte limit (32MB by default)
+ are freed least recently used first.
+ */
+extern TUIBackingStorePoolUsage TUIBackingStoreGetPoolUsage(void);
+extern void TUIBackingStoreSetPoolByteLimit(NSUInteger byteLimit);
+extern void TUIBackingStorePurgePool(void); // free every idle bitmap
+
+/**
+ One draw into a backing store, from -beginDrawingInRegion: to -copyImageAndFinishDrawing:
+ */
+typedef struct {
+	CGContextRef       context;
+	NSInteger          buffer;  // the store's buffer drawn into, -1 for a bitmap of its own
+	void              *pixels;  // that bitmap, when every buffer was already being drawn into
+	TUIViewDirtyRegion region;  // what the draw covers
+} TUIBackingStoreDrawing;
+
+/**
+ Backing store of up to three bitmaps for a view.
+
+ The view draws into a buffer the layer isn't displaying and the image handed to
+ the layer wraps that buffer's pixels directly, so nothing is copied.  A buffer
+ becomes available again once Core Animation lets go of its image.  Another
+ bitmap is only taken on when every one already held is still onscreen or
+ queued up, and it starts out as a copy of the latest drawing.  Each buffer
+ remembers what changed in the others since it was last drawn, so partial
+ redraws stay correct across buffers.  Draws may overlap (one on the main
+ thread while another finishes in the background, say): each gets a buffer of
+ its own and carries it in its TUIBackingStoreDrawing.
+ */
+@interface TUIBackingStore : NSObject
+
+- (id)initWithPixelWidth:(size_t)width height:(size_t)height opaque:(BOOL)opaque scale:(CGFloat)scale;
+
+@property (nonatomic, readonly) size_t pixelWidth;
+@property (nonatomic, readonly) size_t pixelHeight;
+@property (nonatomic, readonly, getter=isOpaque) BOOL opaque;
+@property (nonatomic, readonly) CGFloat scale;
+
+/**
+ Pick a buffer to draw into, one no other draw is using.  @p region is the part of
+ the view that needs display; on return it's widened to cover whatever is stale in
+ the chosen buffer (everything, if the buffer has never been drawn).  Draw into the
+ returned drawing's context and hand the drawing to -copyImageAndFinishDrawing:.
+ */
+- (TUIBackingStoreDrawing)beginDrawingInRegion:(TUIViewDirtyRegion *)region;
+
+/**
+ Finish @p drawing and return an image of it for layer.contents.  The image shares
+ the buffer's pixels.
+ */
+- (CGImageRef)copyImageAndFinishDrawing:(TUIBackingStoreDrawing *)drawing CF_RETURNS_RETAINED;
+
+/**
+ Give back to the pool every bitmap Core Animation isn't using (the one onscreen
+ stays).  For when the view has gone idle.
+ */
+- (void)releaseSpareBuffers;
+
+@end
@@ -0,0 +1,462 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIBackingStore.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+
+#define TUI_BACKING_STORE_DEFAULT_POOL_BYTE_LIMIT (32 * 1024 * 1024)
+
+/**
+ A bitmap context and its pixel memory, shared by a buffer and the images made
+ from it.  The store holds one reference and every outstanding image holds one,
+ so the memory outlives a store that's thrown away (on resize, say) while its
+ last image is onscreen.  When the last reference goes the bitmap returns to the
+ shared pool.
+ */
+typedef struct TUIBackingStorePixels {
+	volatile int32_t  references;
+	volatile int32_t  images;     // images still alive; the buffer can't be drawn into while > 0
+	void             *bytes;
+	size_t            size;
+	CGContextRef      context;
+	size_t            width;
+	size_t            height;
+	BOOL              opaque;
+	CGFloat           scale;
+	
+	// while idle in the pool
+	struct TUIBackingStorePixels *olderInPool;
+	struct TUIBackingStorePixels *newerInPool;
+	struct TUIBackingStorePixels *previousInSlot;
+	struct TUIBackingStorePixels *nextInSlot;
+} TUIBackingStorePixels;
+
+#define TUIBackingStorePoolSlotCount 64
+
+static pthread_mutex_t          TUIBackingStorePoolLock = PTHREAD_MUTEX_INITIALIZER;
+static TUIBackingStorePixels   *TUIBackingStorePoolSlots[TUIBackingStorePoolSlotCount]; // idle bitmaps hashed by kind, newest first
+static TUIBackingStorePixels   *TUIBackingStorePoolOldest = NULL;
+static TUIBackingStorePixels   *TUIBackingStorePoolNewest = NULL;
+static TUIBackingStorePoolUsage TUIBackingStorePoolStatistics = {0, 0, TUI_BACKING_STORE_DEFAULT_POOL_BYTE_LIMIT, 0, 0, 0, 0};
+
+static inline NSUInteger TUIBackingStorePoolSlot(size_t width, size_t height, BOOL opaque, CGFloat scale)
+{
+	return (width * 31 + height * 17 + (opaque ? 1 : 0) + (NSUInteger)(scale * 4.0f) * 7) % TUIBackingStorePoolSlotCount;
+}
+
+static inline BOOL TUIBackingStorePixelsAreKind(TUIBackingStorePixels *pixels, size_t width, size_t height, BOOL opaque, CGFloat scale)
+{
+	return pixels->width == width && pixels->height == height && pixels->opaque == opaque && pixels->scale == scale;
+}
+
+static void TUIBackingStorePixelsDestroy(TUIBackingStorePixels *pixels)
+{
+	CGContextRelease(pixels->context);
+	free(pixels->bytes);
+	free(pixels);
+}
+
+/**
+ * @brief Put an idle bitmap in the pool.  Must be called with the pool lock held.
+ */
+static void TUIBackingStorePoolAdd(TUIBackingStorePixels *pixels)
+{
+	NSUInteger slot = TUIBackingStorePoolSlot(pixels->width, pixels->height, pixels->opaque, pixels->scale);
+	pixels->previousInSlot = NULL;
+	pixels->nextInSlot = TUIBackingStorePoolSlots[slot];
+	if(pixels->nextInSlot)
+		pixels->nextInSlot->previousInSlot = pixels;
+	TUIBackingStorePoolSlots[slot] = pixels;
+	
+	pixels->newerInPool = NULL;
+	pixels->olderInPool = TUIBackingStorePoolNewest;
+	if(TUIBackingStorePoolNewest)
+		TUIBackingStorePoolNewest->newerInPool = pixels;
+	TUIBackingStorePoolNewest = pixels;
+	if(TUIBackingStorePoolOldest == NULL)
+		TUIBackingStorePoolOldest = pixels;
+	
+	TUIBackingStorePoolStatistics.bytesPooled += pixels->size;
+}
+
+/**
+ * @brief Take a bitmap out of the pool.  Must be called with the pool lock held.
+ */
+static void TUIBackingStorePoolRemove(TUIBackingStorePixels *pixels)
+{
+	if(pixels->previousInSlot) {
+		pixels->previousInSlot->nextInSlot = pixels->nextInSlot;
+	} else {
+		TUIBackingStorePoolSlots[TUIBackingStorePoolSlot(pixels->width, pixels->height, pixels->opaque, pixels->scale)] = pixels->nextInSlot;
+	}
+	if(pixels->nextInSlot)
+		pixels->nextInSlot->previousInSlot = pixels->previousInSlot;
+	
+	if(pixels->newerInPool) {
+		pixels->newerInPool->olderInPool = pixels->olderInPool;
+	} else {
+		TUIBackingStorePoolNewest = pixels->olderInPool;
+	}
+	if(pixels->olderInPool) {
+		pixels->olderInPool->newerInPool = pixels->newerInPool;
+	} else {
+		TUIBackingStorePoolOldest = pixels->newerInPool;
+	}
+	
+	pixels->previousInSlot = pixels->nextInSlot = NULL;
+	pixels->olderInPool = pixels->newerInPool = NULL;
+	TUIBackingStorePoolStatistics.bytesPooled -= pixels->size;
+}
+
+/**
+ * @brief Free idle bitmaps, least recently used first, until the pool fits in @p byteLimit
+ * 
+ * Must be called with the pool lock held.
+ */
+static void TUIBackingStorePoolTrim(NSUInteger byteLimit)
+{
+	while(TUIBackingStorePoolStatistics.bytesPooled > byteLimit && TUIBackingStorePoolOldest != NULL) {
+		TUIBackingStorePixels *pixels = TUIBackingStorePoolOldest;
+		TUIBackingStorePoolRemove(pixels);
+		TUIBackingStorePoolStatistics.evictions++;
+		TUIBackingStorePixelsDestroy(pixels);
+	}
+}
+
+static TUIBackingStorePixels *TUIBackingStorePixelsCheckOut(size_t width, size_t height, BOOL opaque, CGFloat scale, CGColorSpaceRef colorSpace, CGBitmapInfo bitmapInfo)
+{
+	TUIBackingStorePixels *pixels = NULL;
+	
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	for(TUIBackingStorePixels *p = TUIBackingStorePoolSlots[TUIBackingStorePoolSlot(width, height, opaque, scale)]; p != NULL; p = p->nextInSlot) {
+		if(TUIBackingStorePixelsAreKind(p, width, height, opaque, scale)) {
+			pixels = p;
+			break;
+		}
+	}
+	if(pixels != NULL) {
+		TUIBackingStorePoolRemove(pixels);
+		TUIBackingStorePoolStatistics.hits++;
+	} else {
+		TUIBackingStorePoolStatistics.misses++;
+	}
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+	
+	if(pixels == NULL) {
+		size_t bytesPerRow = 4 * width;
+		pixels = calloc(1, sizeof(TUIBackingStorePixels));
+		pixels->size = bytesPerRow * height;
+		pixels->bytes = calloc(1, pixels->size);
+		pixels->context = CGBitmapContextCreate(pixels->bytes, width, height, 8, bytesPerRow, colorSpace, bitmapInfo);
+		pixels->width = width;
+		pixels->height = height;
+		pixels->opaque = opaque;
+		pixels->scale = scale;
+	}
+	
+	pixels->references = 1;
+	pixels->images = 0;
+	
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolStatistics.bytesInUse += pixels->size;
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+	
+	return pixels;
+}
+
+static void TUIBackingStorePixelsRelease(TUIBackingStorePixels *pixels)
+{
+	if(OSAtomicDecrement32Barrier(&pixels->references) != 0)
+		return;
+	
+	// may be on any thread: images are released wherever Core Animation drops them
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolStatistics.bytesInUse -= pixels->size;
+	if(pixels->size <= TUIBackingStorePoolStatistics.byteLimit) {
+		TUIBackingStorePoolAdd(pixels);
+		TUIBackingStorePoolTrim(TUIBackingStorePoolStatistics.byteLimit);
+		pixels = NULL;
+	}
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+	
+	if(pixels != NULL)
+		TUIBackingStorePixelsDestroy(pixels);
+}
+
+static void TUIBackingStoreReleaseImageData(void *info, const void *data, size_t size)
+{
+	TUIBackingStorePixels *pixels = info;
+	OSAtomicDecrement32Barrier(&pixels->images);
+	TUIBackingStorePixelsRelease(pixels);
+}
+
+/**
+ * @brief Start a newly taken bitmap off as a copy of @p source
+ */
+static void TUIBackingStoreCopyPixels(TUIBackingStorePixels *pixels, TUIBackingStorePixels *source)
+{
+	memcpy(pixels->bytes, source->bytes, pixels->size);
+	
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolStatistics.bytesCopied += pixels->size;
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+}
+
+TUIBackingStorePoolUsage TUIBackingStoreGetPoolUsage(void)
+{
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolUsage usage = TUIBackingStorePoolStatistics;
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+	return usage;
+}
+
+void TUIBackingStoreSetPoolByteLimit(NSUInteger byteLimit)
+{
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolStatistics.byteLimit = byteLimit;
+	TUIBackingStorePoolTrim(byteLimit);
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+}
+
+void TUIBackingStorePurgePool(void)
+{
+	pthread_mutex_lock(&TUIBackingStorePoolLock);
+	TUIBackingStorePoolTrim(0);
+	pthread_mutex_unlock(&TUIBackingStorePoolLock);
+}
+
+typedef struct {
+	TUIBackingStorePixels *pixels;
+	BOOL                   drawn;
+	BOOL                   drawing;   // between -beginDrawingInRegion: and -copyImageAndFinishDrawing:
+	TUIViewDirtyRegion     stale;     // changed in the other buffers since this one was drawn
+	NSUInteger             lastDrawn; // 0 until drawn; the most recently drawn free buffer is the least stale
+} TUIBackingStoreBuffer;
+
+@interface TUIBackingStore ()
+{
+	size_t                 pixelWidth;
+	size_t                 pixelHeight;
+	size_t                 bytesPerRow;
+	BOOL                   opaque;
+	CGFloat                scale;
+	CGColorSpaceRef        colorSpace;
+	CGBitmapInfo           bitmapInfo;
+	TUIBackingStoreBuffer  buffers[TUIBackingStoreBufferCount];
+	NSUInteger             drawCount;
+}
+@end
+
+@implementation TUIBackingStore
+
+@synthesize pixelWidth;
+@synthesize pixelHeight;
+@synthesize opaque;
+@synthesize scale;
+
+- (id)initWithPixelWidth:(size_t)width height:(size_t)height opaque:(BOOL)o scale:(CGFloat)s
+{
+	if((self = [super init])) {
+		pixelWidth = MAX(width, 1);
+		pixelHeight = MAX(height, 1);
+		bytesPerRow = 4 * pixelWidth;
+		opaque = o;
+		scale = s;
+		colorSpace = CGColorSpaceCreateDeviceRGB();
+		// same formats as TUICreateOpaqueGraphicsContext() / TUICreateGraphicsContext()
+		bitmapInfo = kCGBitmapByteOrder32Host | (opaque ? kCGImageAlphaNoneSkipFirst : kCGImageAlphaPremultipliedFirst);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	for(NSInteger i = 0; i < TUIBackingStoreBufferCount; ++i) {
+		if(buffers[i].pixels)
+			TUIBackingStorePixelsRelease(buffers[i].pixels);
+	}
+	CGColorSpaceRelease(colorSpace);
+}
+
+/**
+ * @brief The most recently drawn buffer that isn't being drawn into right now, or -1
+ */
+- (NSInteger)_latestBuffer
+{
+	NSInteger latest = -1;
+	for(NSInteger i = 0; i < TUIBackingStoreBufferCount; ++i) {
+		if(buffers[i].drawing || buffers[i].pixels == NULL || !buffers[i].drawn)
+			continue;
+		if(latest < 0 || buffers[i].lastDrawn > buffers[latest].lastDrawn)
+			latest = i;
+	}
+	return latest;
+}
+
+/**
+ * @brief Give a buffer another bitmap from the pool
+ *
+ * The old bitmap stays alive for as long as images still use it.  The new one
+ * starts out as a copy of the latest drawing, so only what's dirty gets redrawn
+ * into it.
+ */
+- (void)_allocateBuffer:(NSInteger)index
+{
+	TUIBackingStoreBuffer *buffer = &buffers[index];
+	NSInteger latest = [self _latestBuffer];
+	TUIBackingStorePixels *source = NULL;
+	if(latest >= 0) {
+		source = buffers[latest].pixels;
+		OSAtomicIncrement32Barrier(&source->references); // in case it's the one being replaced
+	}
+
+	if(buffer->pixels)
+		TUIBackingStorePixelsRelease(buffer->pixels);
+	buffer->pixels = TUIBackingStorePixelsCheckOut(pixelWidth, pixelHeight, opaque, scale, colorSpace, bitmapInfo);
+
+	if(source != NULL) {
+		buffer->drawn = YES;
+		buffer->stale = buffers[latest].stale;
+		TUIBackingStoreCopyPixels(buffer->pixels, source);
+		TUIBackingStorePixelsRelease(source);
+	} else {
+		buffer->drawn = NO;
+	}
+}
+
+- (TUIBackingStoreDrawing)beginDrawingInRegion:(TUIViewDirtyRegion *)region
+{
+	@synchronized(self) {
+		// reuse memory the compositor is done with, the most recently drawn first since it's the least stale
+		NSInteger chosen = -1;
+		NSInteger empty = -1;
+		NSInteger oldest = -1;
+		for(NSInteger i = 0; i < TUIBackingStoreBufferCount; ++i) {
+			TUIBackingStoreBuffer *buffer = &buffers[i];
+			if(buffer->drawing)
+				continue;
+			if(buffer->pixels == NULL) {
+				if(empty < 0)
+					empty = i;
+				continue;
+			}
+			if(oldest < 0 || buffer->lastDrawn < buffers[oldest].lastDrawn)
+				oldest = i;
+			if(buffer->pixels->images > 0)
+				continue;
+			if(chosen < 0 || buffer->lastDrawn > buffers[chosen].lastDrawn)
+				chosen = i;
+		}
+
+		if(chosen < 0 && empty >= 0) {
+			// everything allocated is onscreen or queued up, only now take on another bitmap
+			chosen = empty;
+			[self _allocateBuffer:chosen];
+		} else if(chosen < 0 && oldest >= 0) {
+			// all buffers are onscreen or queued up; swap fresh memory into the oldest
+			chosen = oldest;
+			[self _allocateBuffer:chosen];
+		}
+		
+		TUIBackingStoreDrawing drawing;
+		drawing.buffer = chosen;
+		drawing.pixels = NULL;
+		if(chosen < 0) {
+			// every buffer is being drawn into; this draw gets a bitmap that goes back to the pool once it's off screen
+			TUIBackingStorePixels *pixels = TUIBackingStorePixelsCheckOut(pixelWidth, pixelHeight, opaque, scale, colorSpace, bitmapInfo);
+			region->everything = YES;
+			drawing.pixels = pixels;
+			drawing.context = pixels->context;
+		} else {
+			TUIBackingStoreBuffer *buffer = &buffers[chosen];
+			if(!buffer->drawn || buffer->stale.everything) {
+				region->everything = YES;
+			} else if(!region->everything && region->count > 0) {
+				for(NSUInteger i = 0; i < buffer->stale.count; ++i)
+					TUIViewDirtyRegionAddRect(region, buffer->stale.rects[i]);
+			}
+			buffer->stale.everything = NO;
+			buffer->stale.count = 0;
+			buffer->drawing = YES;
+			drawing.context = buffer->pixels->context;
+		}
+		drawing.region = *region;
+		return drawing;
+	}
+}
+
+- (void)releaseSpareBuffers
+{
+	@synchronized(self) {
+		for(NSInteger i = 0; i < TUIBackingStoreBufferCount; ++i) {
+			TUIBackingStoreBuffer *buffer = &buffers[i];
+			if(buffer->drawing || buffer->pixels == NULL || buffer->pixels->images > 0)
+				continue;
+			TUIBackingStorePixelsRelease(buffer->pixels);
+			buffer->pixels = NULL;
+			buffer->drawn = NO;
+			buffer->stale.everything = NO;
+			buffer->stale.count = 0;
+			buffer->lastDrawn = 0;
+		}
+	}
+}
+
+- (CGImageRef)copyImageAndFinishDrawing:(TUIBackingStoreDrawing *)drawing
+{
+	@synchronized(self) {
+		TUIBackingStorePixels *pixels = drawing->pixels;
+		if(pixels == NULL) {
+			if(drawing->buffer < 0 || !buffers[drawing->buffer].drawing)
+				return NULL;
+			TUIBackingStoreBuffer *buffer = &buffers[drawing->buffer];
+			buffer->drawing = NO;
+			buffer->drawn = YES;
+			buffer->lastDrawn = ++drawCount;
+			pixels = buffer->pixels;
+			OSAtomicIncrement32Barrier(&pixels->references);
+		}
+
+		// the buffers are now behind by whatever was just drawn (a draw that overlapped this one
+		// may have left the one drawn into behind too, that's already in its stale region)
+		for(NSInteger i = 0; i < TUIBackingStoreBufferCount; ++i) {
+			TUIBackingStoreBuffer *other = &buffers[i];
+			if(i == drawing->buffer || other->stale.everything)
+				continue;
+			if(drawing->region.everything || drawing->region.count == 0) {
+				other->stale.everything = YES;
+			} else {
+				for(NSUInteger j = 0; j < drawing->region.count; ++j)
+					TUIViewDirtyRegionAddRect(&other->stale, drawing->region.rects[j]);
+			}
+		}
+
+		CGContextFlush(pixels->context);
+
+		// the image holds the reference taken above (or the one a bitmap of the draw's own came with)
+		OSAtomicIncrement32Barrier(&pixels->images);
+		CGDataProviderRef provider = CGDataProviderCreateWithData(pixels, pixels->bytes, bytesPerRow * pixelHeight, TUIBackingStoreReleaseImageData);
+		CGImageRef image = CGImageCreate(pixelWidth, pixelHeight, 8, 32, bytesPerRow, colorSpace, bitmapInfo, provider, NULL, false, kCGRenderingIntentDefault);
+		CGDataProviderRelease(provider);
+
+		drawing->buffer = -1;
+		drawing->pixels = NULL;
+		return image;
+	}
+}
+
+@end
@@ -0,0 +1,74 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+typedef enum {
+	TUIDrawPriorityLow = 0,     // offscreen
+	TUIDrawPriorityDefault = 1,
+	TUIDrawPriorityHigh = 2,    // onscreen
+} TUIDrawPriority;
+
+/**
+ A draw to run in the background.  Returns NO if it turned out to be out of date
+ and its result was thrown away.
+ */
+typedef BOOL (^TUIDrawSchedulerBlock)(void);
+
+typedef struct {
+	NSUInteger queueDepth;          // draws waiting to start
+	NSUInteger maximumQueueDepth;
+	NSUInteger inFlight;            // draws running now
+	NSUInteger scheduled;
+	NSUInteger coalesced;           // requests folded into one already waiting for the same target
+	NSUInteger cancelled;
+	NSUInteger completed;
+	NSUInteger discarded;           // draws whose block returned NO
+	NSTimeInterval averageLatency;  // from the first request to the end of the draw
+	NSTimeInterval maximumLatency;
+} TUIDrawSchedulerStatistics;
+
+/**
+ Runs background draws (for views with drawInBackground set and no drawQueue).
+
+ Higher priority draws start first, then older ones, from one first-in first-out
+ queue per priority.  At most one draw waits per target: scheduling another
+ replaces the block of the one waiting, and the request keeps its original start
+ time and its place in line, unless it was scheduled at a higher priority, in
+ which case it joins the back of that priority's queue.  A target never has two
+ draws running at once.  No more than maximumConcurrentDraws run at a time.
+ */
+@interface TUIDrawScheduler : NSObject
+
++ (TUIDrawScheduler *)sharedScheduler;
+
+/**
+ Defaults to the number of active processor cores.
+ */
+@property (nonatomic, assign) NSUInteger maximumConcurrentDraws;
+
+- (void)scheduleDrawForTarget:(id)target priority:(TUIDrawPriority)priority block:(TUIDrawSchedulerBlock)block;
+
+/**
+ Drop the draw waiting for @p target, if any.  A draw that has already started
+ runs to completion.
+ */
+- (void)cancelDrawForTarget:(id)target;
+
+- (TUIDrawSchedulerStatistics)statistics;
+- (void)resetStatistics;
+
+@end
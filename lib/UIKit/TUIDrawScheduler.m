@@ -0,0 +1,233 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIDrawScheduler.h"
+
+#define TUIDrawPriorityCount (TUIDrawPriorityHigh + 1)
+
+@interface TUIDrawSchedulerRequest : NSObject
+{
+@public
+	NSValue              *key;         // the target, not retained (the block keeps it alive)
+	TUIDrawPriority       priority;
+	TUIDrawSchedulerBlock block;
+	CFAbsoluteTime        requestTime;
+	BOOL                  deferred;    // taken off its queue while its target was being drawn
+}
+@end
+
+@implementation TUIDrawSchedulerRequest
+@end
+
+@interface TUIDrawScheduler ()
+{
+	NSMutableArray             *queues[TUIDrawPriorityCount]; // TUIDrawSchedulerRequest, oldest first, one per priority
+	NSMutableDictionary        *pendingRequestsByTarget;      // key -> TUIDrawSchedulerRequest, every request waiting
+	NSMutableDictionary        *deferredRequestsByTarget;     // key -> TUIDrawSchedulerRequest, waiting for their target's draw to finish
+	NSMutableSet               *targetsInFlight;              // keys
+	TUIDrawSchedulerStatistics  statistics;
+	NSTimeInterval              totalLatency;
+}
+- (void)_startDrawsIfNeeded;
+@end
+
+@implementation TUIDrawScheduler
+
+@synthesize maximumConcurrentDraws;
+
++ (TUIDrawScheduler *)sharedScheduler
+{
+	static TUIDrawScheduler *sharedScheduler = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedScheduler = [[TUIDrawScheduler alloc] init];
+	});
+	return sharedScheduler;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		for(NSInteger p = 0; p < TUIDrawPriorityCount; ++p)
+			queues[p] = [[NSMutableArray alloc] init];
+		pendingRequestsByTarget = [[NSMutableDictionary alloc] init];
+		deferredRequestsByTarget = [[NSMutableDictionary alloc] init];
+		targetsInFlight = [[NSMutableSet alloc] init];
+		maximumConcurrentDraws = MAX([[NSProcessInfo processInfo] activeProcessorCount], 1);
+	}
+	return self;
+}
+
+- (NSUInteger)maximumConcurrentDraws
+{
+	@synchronized(self) {
+		return maximumConcurrentDraws;
+	}
+}
+
+- (void)setMaximumConcurrentDraws:(NSUInteger)n
+{
+	@synchronized(self) {
+		maximumConcurrentDraws = MAX(n, 1);
+		[self _startDrawsIfNeeded];
+	}
+}
+
+- (void)scheduleDrawForTarget:(id)target priority:(TUIDrawPriority)priority block:(TUIDrawSchedulerBlock)block
+{
+	NSValue *key = [NSValue valueWithNonretainedObject:target];
+
+	@synchronized(self) {
+		statistics.scheduled++;
+
+		TUIDrawSchedulerRequest *request = [pendingRequestsByTarget objectForKey:key];
+		if(request != nil) {
+			// run the newest block; a higher priority moves it up to that priority's line,
+			// the entry left in the old line is skipped when it comes up
+			request->block = [block copy];
+			if(priority > request->priority) {
+				request->priority = priority;
+				if(!request->deferred)
+					[queues[priority] addObject:request];
+			}
+			statistics.coalesced++;
+			return;
+		}
+
+		request = [[TUIDrawSchedulerRequest alloc] init];
+		request->key = key;
+		request->priority = priority;
+		request->block = [block copy];
+		request->requestTime = CFAbsoluteTimeGetCurrent();
+		[queues[priority] addObject:request];
+		[pendingRequestsByTarget setObject:request forKey:key];
+
+		statistics.queueDepth = [pendingRequestsByTarget count];
+		statistics.maximumQueueDepth = MAX(statistics.maximumQueueDepth, statistics.queueDepth);
+
+		[self _startDrawsIfNeeded];
+	}
+}
+
+- (void)cancelDrawForTarget:(id)target
+{
+	NSValue *key = [NSValue valueWithNonretainedObject:target];
+
+	@synchronized(self) {
+		TUIDrawSchedulerRequest *request = [pendingRequestsByTarget objectForKey:key];
+		if(request != nil) {
+			// its queue entry is skipped when it comes up
+			[pendingRequestsByTarget removeObjectForKey:key];
+			[deferredRequestsByTarget removeObjectForKey:key];
+			statistics.queueDepth = [pendingRequestsByTarget count];
+			statistics.cancelled++;
+		}
+	}
+}
+
+/**
+ * @brief The waiting request to start next, or nil
+ *
+ * The front of the highest priority queue that has one.  Entries left behind by
+ * cancelled requests, or by requests that moved up to a higher priority, are
+ * dropped on the way.  A request whose target is already being drawn is set
+ * aside until that draw finishes.  Must be called from within @synchronized(self).
+ */
+- (TUIDrawSchedulerRequest *)_nextRequest
+{
+	for(NSInteger p = TUIDrawPriorityCount - 1; p >= 0; --p) {
+		NSMutableArray *queue = queues[p];
+		while([queue count] > 0) {
+			TUIDrawSchedulerRequest *request = [queue objectAtIndex:0];
+			[queue removeObjectAtIndex:0];
+			if(request->priority != p || request->deferred || [pendingRequestsByTarget objectForKey:request->key] != request)
+				continue;
+			if([targetsInFlight containsObject:request->key]) {
+				request->deferred = YES;
+				[deferredRequestsByTarget setObject:request forKey:request->key];
+				continue;
+			}
+			return request;
+		}
+	}
+	return nil;
+}
+
+- (void)_startDrawsIfNeeded
+{
+	while(statistics.inFlight < maximumConcurrentDraws) {
+		TUIDrawSchedulerRequest *request = [self _nextRequest];
+		if(request == nil)
+			break;
+
+		[pendingRequestsByTarget removeObjectForKey:request->key];
+		[targetsInFlight addObject:request->key];
+		statistics.queueDepth = [pendingRequestsByTarget count];
+		statistics.inFlight++;
+
+		long queuePriority = (request->priority == TUIDrawPriorityHigh) ? DISPATCH_QUEUE_PRIORITY_HIGH : DISPATCH_QUEUE_PRIORITY_DEFAULT;
+		dispatch_async(dispatch_get_global_queue(queuePriority, 0), ^{
+			BOOL committed = request->block();
+			NSTimeInterval latency = CFAbsoluteTimeGetCurrent() - request->requestTime;
+
+			@synchronized(self) {
+				[targetsInFlight removeObject:request->key];
+				statistics.inFlight--;
+				if(committed) {
+					statistics.completed++;
+				} else {
+					statistics.discarded++;
+				}
+
+				totalLatency += latency;
+				statistics.maximumLatency = MAX(statistics.maximumLatency, latency);
+				statistics.averageLatency = totalLatency / (statistics.completed + statistics.discarded);
+
+				// a request set aside for this target was at the front of its line
+				TUIDrawSchedulerRequest *deferred = [deferredRequestsByTarget objectForKey:request->key];
+				if(deferred != nil) {
+					deferred->deferred = NO;
+					[deferredRequestsByTarget removeObjectForKey:request->key];
+					[queues[deferred->priority] insertObject:deferred atIndex:0];
+				}
+
+				[self _startDrawsIfNeeded];
+			}
+		});
+	}
+}
+
+- (TUIDrawSchedulerStatistics)statistics
+{
+	@synchronized(self) {
+		return statistics;
+	}
+}
+
+- (void)resetStatistics
+{
+	@synchronized(self) {
+		NSUInteger queueDepth = statistics.queueDepth;
+		NSUInteger inFlight = statistics.inFlight;
+		memset(&statistics, 0, sizeof(statistics));
+		statistics.queueDepth = queueDepth;
+		statistics.maximumQueueDepth = queueDepth;
+		statistics.inFlight = inFlight;
+		totalLatency = 0.0;
+	}
+}
+
+@end
@@ -21,6 +21,51 @@
 #define TUIFastIndexPath_DANGEROUS_ISEQUAL 1
 #endif
 
+/**
+ A section/row pair packed into 64 bits: section in the high word, row in the low
+ word.  It's a plain value, so it never allocates, and comparing two packed index
+ paths as integers orders them the same way as -[TUIFastIndexPath compare:].
+ Sections and rows are limited to 32 bits.
+ */
+typedef uint64_t TUIPackedIndexPath;
+
+#define TUIPackedIndexPathNotFound ((TUIPackedIndexPath)UINT64_MAX)
+
+static inline TUIPackedIndexPath TUIPackedIndexPathMake(NSUInteger section, NSUInteger row)
+{
+	return ((uint64_t)(uint32_t)section << 32) | (uint32_t)row;
+}
+
+static inline NSUInteger TUIPackedIndexPathGetSection(TUIPackedIndexPath indexPath)
+{
+	return (NSUInteger)(indexPath >> 32);
+}
+
+static inline NSUInteger TUIPackedIndexPathGetRow(TUIPackedIndexPath indexPath)
+{
+	return (NSUInteger)(indexPath & 0xffffffff);
+}
+
+static inline NSComparisonResult TUIPackedIndexPathCompare(TUIPackedIndexPath a, TUIPackedIndexPath b)
+{
+	return (a < b) ? NSOrderedAscending : ((a > b) ? NSOrderedDescending : NSOrderedSame);
+}
+
+/**
+ 64-bit finalizer from MurmurHash3: every input bit affects every output bit, so
+ neighbouring rows and rows in different sections spread evenly over hash buckets.
+ */
+static inline NSUInteger TUIPackedIndexPathHash(TUIPackedIndexPath indexPath)
+{
+	uint64_t h = indexPath;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (NSUInteger)h;
+}
+
 #define TUIFastIndexPathFromNSIndexPath(indexPath)  (((indexPath) != nil) ? [TUIFastIndexPath indexPathForRow:(indexPath).row inSection:(indexPath).section] : nil)
 #define NSIndexPathFromTUIFastIndexPath(indexPath)  (((indexPath) != nil) ? [NSIndexPath indexPathForRow:(indexPath).row inSection:(indexPath).section] : nil)
 
@@ -35,11 +80,14 @@
 }
 
 + (TUIFastIndexPath *)indexPathForRow:(NSUInteger)row inSection:(NSUInteger)section;
++ (TUIFastIndexPath *)indexPathWithPackedIndexPath:(TUIPackedIndexPath)indexPath;
 
 // duck type to NSIndexPath
 @property(nonatomic, readonly) NSUInteger section;
 @property(nonatomic, readonly) NSUInteger row;
 
+@property(nonatomic, readonly) TUIPackedIndexPath packedIndexPath;
+
 - (NSComparisonResult)compare:(TUIFastIndexPath *)i;
 - (BOOL)isEqual:(TUIFastIndexPath *)i;
 
@@ -22,11 +22,18 @@
  */
 #define CACHE_COMMON_INDEX_PATHS 1024*10
 
+/**
+ Smaller hunk for the first rows of the next few sections, for grouped tables.  Anything
+ beyond these should use TUIPackedIndexPath where it can.
+ */
+#define CACHE_COMMON_SECTIONS 8
+#define CACHE_COMMON_SECTION_INDEX_PATHS 1024
+
 static struct TUIFastIndexPath_staticStruct {
 	Class isa;
 	NSInteger section;
 	NSInteger row;
-} CommonIndexPaths[CACHE_COMMON_INDEX_PATHS];
+} CommonIndexPaths[CACHE_COMMON_INDEX_PATHS], CommonSectionIndexPaths[CACHE_COMMON_SECTIONS - 1][CACHE_COMMON_SECTION_INDEX_PATHS];
 
 @interface TUIFastIndexPath_staticClass : TUIFastIndexPath
 @end
@@ -46,6 +53,14 @@ static struct TUIFastIndexPath_staticStruct {
 			f->section = 0;
 			f->row = i;
 		}
+		for(int s = 1; s < CACHE_COMMON_SECTIONS; ++s) {
+			for(int i = 0; i < CACHE_COMMON_SECTION_INDEX_PATHS; ++i) {
+				struct TUIFastIndexPath_staticStruct *f = &CommonSectionIndexPaths[s - 1][i];
+				f->isa = staticCls;
+				f->section = s;
+				f->row = i;
+			}
+		}
 	}
 }
 
@@ -55,6 +70,8 @@ static struct TUIFastIndexPath_staticStruct {
 		if(row < CACHE_COMMON_INDEX_PATHS) {
 			return (__bridge TUIFastIndexPath *)&CommonIndexPaths[row];
 		}
+	} else if(section < CACHE_COMMON_SECTIONS && row < CACHE_COMMON_SECTION_INDEX_PATHS) {
+		return (__bridge TUIFastIndexPath *)&CommonSectionIndexPaths[section - 1][row];
 	}
 	
 	// actually have to make one
@@ -64,6 +81,11 @@ static struct TUIFastIndexPath_staticStruct {
 	return f;
 }
 
++ (TUIFastIndexPath *)indexPathWithPackedIndexPath:(TUIPackedIndexPath)indexPath
+{
+	return [self indexPathForRow:TUIPackedIndexPathGetRow(indexPath) inSection:TUIPackedIndexPathGetSection(indexPath)];
+}
+
 - (id)copyWithZone:(NSZone *)zone
 {
 	return self;  // change me if we ever do mutable index paths
@@ -98,9 +120,15 @@ static struct TUIFastIndexPath_staticStruct {
 	return row;
 }
 
+- (TUIPackedIndexPath)packedIndexPath
+{
+	return TUIPackedIndexPathMake(section, row);
+}
+
 - (NSUInteger)hash
 {
-	return ((section << 28) ^ row); // assume we're going to have a lot more rows than sections
+	// (section << 28) ^ row collided for multi-section tables; mix all the bits instead
+	return TUIPackedIndexPathHash(TUIPackedIndexPathMake(section, row));
 }
 
 - (NSComparisonResult)compare:(TUIFastIndexPath *)i
@@ -21,7 +21,9 @@
 #import "TUIColor.h"
 #import "TUIImage.h"
 #import "TUIView.h"
+#import "TUIDrawScheduler.h"
 #import "TUIScrollView.h"
+#import "TUITiledView.h"
 #import "TUIFastIndexPath.h"
 #import "TUITableView.h"
 #import "TUITableView+Additions.h"
@@ -37,6 +39,7 @@
 #import "TUINSView.h"
 #import "TUINSWindow.h"
 #import "TUIStringDrawing.h"
+#import "TUITextLayout.h"
 #import "TUIViewController.h"
 #import "TUICGAdditions.h"
 #import "CoreText+Additions.h"
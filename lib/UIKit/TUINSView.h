@@ -33,6 +33,13 @@
 	
 	NSTrackingArea *_trackingArea;
 	
+	// hover hit test cache: while nothing changes and the mouse stays inside _hoverHitRect, the answer is _hoverHitView
+	TUIView *_hoverHitView;
+	NSRect _hoverHitRect;
+	NSUInteger _hoverHitGeneration;
+	NSEvent *_pendingHoverEvent; // latest mouse moved, waiting for the next frame
+	CFAbsoluteTime _lastHoverUpdateTime;
+	
 	__unsafe_unretained TUITextRenderer *_tempTextRendererForTextInputClient; // weak, set temporarily while NSTextInputClient dicks around
 	
 	BOOL deliveringEvent;
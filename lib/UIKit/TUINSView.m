@@ -20,6 +20,8 @@
 #import "TUITooltipWindow.h"
 #import <CoreFoundation/CoreFoundation.h>
 
+#define TUINSViewHoverUpdateInterval (1.0 / 60.0) // mouse moved events are coalesced to one hit test per frame
+
 @interface TUINSView ()
 - (void)windowDidResignKey:(NSNotification *)notification;
 - (void)windowDidBecomeKey:(NSNotification *)notification;
@@ -49,6 +51,7 @@
 	
 	rootView = nil;
 	_hoverView = nil;
+	_hoverHitView = nil;
 	_trackingView = nil;
 	_trackingArea = nil;
 	
@@ -95,6 +98,12 @@
 	[self addTrackingArea:_trackingArea];
 }
 
+- (void)setFrameSize:(NSSize)newSize
+{
+	[super setFrameSize:newSize];
+	TUIViewHitTestingDidChange(); // the root view and anything autoresizing in it follow
+}
+
 - (void)viewWillStartLiveResize
 {
 	[super viewWillStartLiveResize];
@@ -282,9 +291,90 @@
 	}
 }
 
+static BOOL TUINSViewCanBeHit(TUIView *v)
+{
+	return v.userInteractionEnabled && !v.hidden && v.alpha > 0.0f;
+}
+
+/**
+ * @brief Work out where else in the view @p hit would be hit, and remember it
+ * 
+ * Walks from the hit view up to the root.  The rect starts as the hit view's bounds and is
+ * clipped by each ancestor; if anything that could take the hit instead (an interactive
+ * subview of the hit view, or an interactive sibling in front of any view on the way up)
+ * overlaps it, or a view on the way decides hits for itself or is transformed, nothing is
+ * cached.
+ */
+- (void)_cacheHoverHit:(TUIView *)hit
+{
+	_hoverHitView = nil;
+	if(hit == nil)
+		return;
+	
+	IMP defaultHitTest = [TUIView instanceMethodForSelector:@selector(hitTest:withEvent:)];
+	IMP defaultPointInside = [TUIView instanceMethodForSelector:@selector(pointInside:withEvent:)];
+	
+	CGRect r = [hit convertRect:hit.bounds toView:rootView];
+	for(TUIView *subview in hit.subviews) {
+		if(TUINSViewCanBeHit(subview) && CGRectIntersectsRect(r, [hit convertRect:subview.frame toView:rootView]))
+			return;
+	}
+	
+	for(TUIView *v = hit; v != rootView; v = v.superview) {
+		TUIView *superview = v.superview;
+		if(superview == nil)
+			return; // not in this hierarchy any more
+		if([v methodForSelector:@selector(hitTest:withEvent:)] != defaultHitTest ||
+		   [v methodForSelector:@selector(pointInside:withEvent:)] != defaultPointInside ||
+		   !CGAffineTransformIsIdentity(v.transform))
+			return;
+		
+		r = CGRectIntersection(r, [superview convertRect:superview.bounds toView:rootView]);
+		
+		BOOL inFront = NO;
+		for(TUIView *sibling in [superview sortedSubviews]) {
+			if(sibling == v) {
+				inFront = YES;
+			} else if(inFront && TUINSViewCanBeHit(sibling) && CGRectIntersectsRect(r, [superview convertRect:sibling.frame toView:rootView])) {
+				return;
+			}
+		}
+	}
+	
+	if([rootView methodForSelector:@selector(hitTest:withEvent:)] != defaultHitTest ||
+	   [rootView methodForSelector:@selector(pointInside:withEvent:)] != defaultPointInside)
+		return;
+	
+	r = CGRectIntersection(r, rootView.bounds);
+	if(CGRectIsEmpty(r))
+		return;
+	
+	_hoverHitView = hit;
+	_hoverHitRect = NSRectFromCGRect(r);
+	_hoverHitGeneration = TUIViewHitTestingGeneration;
+}
+
+- (TUIView *)_hoverViewForEvent:(NSEvent *)event
+{
+	NSPoint p = [self localPointForLocationInWindow:[event locationInWindow]];
+	if(_hoverHitView != nil && _hoverHitGeneration == TUIViewHitTestingGeneration && NSPointInRect(p, _hoverHitRect))
+		return _hoverHitView;
+	
+	TUIView *hit = [self viewForLocalPoint:p];
+	[self _cacheHoverHit:hit];
+	return hit;
+}
+
 - (void)_updateHoverViewWithEvent:(NSEvent *)event
 {
-	TUIView *_newHoverView = [self viewForEvent:event];
+	// anything that updates hover now makes a waiting mouse moved redundant
+	if(_pendingHoverEvent != nil) {
+		_pendingHoverEvent = nil;
+		[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_updateHoverViewWithPendingEvent) object:nil];
+	}
+	_lastHoverUpdateTime = CFAbsoluteTimeGetCurrent();
+	
+	TUIView *_newHoverView = [self _hoverViewForEvent:event];
 	
 	if(![[self window] isKeyWindow]) {
 		if(![_newHoverView acceptsFirstMouse:event]) {
@@ -296,6 +386,14 @@
 	[self _updateHoverView:_newHoverView withEvent:event];
 }
 
+- (void)_updateHoverViewWithPendingEvent
+{
+	NSEvent *event = _pendingHoverEvent;
+	_pendingHoverEvent = nil;
+	if(event != nil)
+		[self _updateHoverViewWithEvent:event];
+}
+
 - (void)invalidateHover
 {
 	[self _updateHoverView:nil withEvent:nil];
@@ -349,7 +447,13 @@
 
 - (void)mouseMoved:(NSEvent *)event
 {
-	[self _updateHoverViewWithEvent:event];
+	// only the latest position matters; hit test it at most once a frame
+	BOOL scheduled = (_pendingHoverEvent != nil);
+	_pendingHoverEvent = event;
+	if(!scheduled) {
+		NSTimeInterval delay = MAX(0.0, _lastHoverUpdateTime + TUINSViewHoverUpdateInterval - CFAbsoluteTimeGetCurrent());
+		[self performSelector:@selector(_updateHoverViewWithPendingEvent) withObject:nil afterDelay:delay inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	}
 }
 
 -(void)mouseEntered:(NSEvent *)event {
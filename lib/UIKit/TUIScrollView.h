@@ -17,6 +17,8 @@
 #import "TUIView.h"
 #import "TUIGeometry.h"
 
+extern NSString * const TUIScrollViewDidScrollNotification; // posted for every change of the content offset while asked for (see -beginPostingDidScrollNotifications), object is the scroll view
+
 typedef enum {
   /** Dark scroll indicator style suitable for light background */
   TUIScrollViewIndicatorStyleDark,
@@ -119,6 +121,14 @@ typedef enum {
 	
 	CGPoint  _dragScrollLocation;
 	
+	struct {
+		CGPoint visibleOrigin;
+		CGPoint velocity;
+		CFAbsoluteTime t;
+	} _scrollVelocity;
+	
+	NSUInteger _didScrollNotificationRequests; // TUIScrollViewDidScrollNotification is only posted while nonzero
+	
 	BOOL x;
 	
 	struct {
@@ -184,6 +194,17 @@ typedef enum {
 @property (nonatomic, readonly, getter=isDragging) BOOL dragging;
 @property (nonatomic, readonly, getter=isDecelerating) BOOL decelerating;
 
+/**
+ How fast visibleRect is moving, in points per second, however the scrolling is happening (dragging, throwing, animating).  Zero once scrolling has stopped.  Content can use it to get ready for what's about to come into view.
+ */
+@property (nonatomic, readonly) CGPoint scrollVelocity;
+
+/**
+ TUIScrollViewDidScrollNotification is only posted between calls to these, so scrolling doesn't pay for a notification nobody observes.  Calls nest; balance each begin with an end.  TUITiledView calls them for the scroll view it's in.
+ */
+- (void)beginPostingDidScrollNotifications;
+- (void)endPostingDidScrollNotifications;
+
 @end
 
 @protocol TUIScrollViewDelegate <NSObject>
@@ -19,8 +19,12 @@
 #import "TUIView+Private.h"
 #import "TUINSView.h"
 
+NSString * const TUIScrollViewDidScrollNotification = @"TUIScrollViewDidScrollNotification";
+
 #define KNOB_Z_POSITION 6000
 
+#define TUIScrollViewVelocityTimeout 0.1 // seconds without scrolling before the velocity drops to zero
+
 #define FORCE_ENABLE_BOUNCE 1
 
 #define TUIScrollViewContinuousScrollDragBoundary 25.0
@@ -539,9 +543,43 @@ static CGPoint PointLerp(CGPoint a, CGPoint b, CGFloat t)
 	p.x = round(-p.x - self.bounceOffset.x - self.pullOffset.x);
 	p.y = round(-p.y - self.bounceOffset.y - self.pullOffset.y);
 	[((CAScrollLayer *)self.layer) scrollToPoint:p];
+	TUIViewHitTestingDidChange();
+	
+	// smoothed over the last few changes; a change after a pause starts over
+	CFAbsoluteTime t = CFAbsoluteTimeGetCurrent();
+	CFTimeInterval dt = t - _scrollVelocity.t;
+	CGPoint v = CGPointZero;
+	if(dt > 0.0 && dt < TUIScrollViewVelocityTimeout) {
+		v.x = 0.5 * _scrollVelocity.velocity.x + 0.5 * (p.x - _scrollVelocity.visibleOrigin.x) / dt;
+		v.y = 0.5 * _scrollVelocity.velocity.y + 0.5 * (p.y - _scrollVelocity.visibleOrigin.y) / dt;
+	}
+	_scrollVelocity.visibleOrigin = p;
+	_scrollVelocity.velocity = v;
+	_scrollVelocity.t = t;
+	
 	if(_scrollViewFlags.delegateScrollViewDidScroll){
 		[_delegate scrollViewDidScroll:self];
 	}
+	if(_didScrollNotificationRequests > 0)
+		[[NSNotificationCenter defaultCenter] postNotificationName:TUIScrollViewDidScrollNotification object:self];
+}
+
+- (void)beginPostingDidScrollNotifications
+{
+	_didScrollNotificationRequests++;
+}
+
+- (void)endPostingDidScrollNotifications
+{
+	if(_didScrollNotificationRequests > 0)
+		_didScrollNotificationRequests--;
+}
+
+- (CGPoint)scrollVelocity
+{
+	if(CFAbsoluteTimeGetCurrent() - _scrollVelocity.t >= TUIScrollViewVelocityTimeout)
+		return CGPointZero;
+	return _scrollVelocity.velocity;
 }
 
 - (void)setContentOffset:(CGPoint)p
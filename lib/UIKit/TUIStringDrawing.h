@@ -20,6 +20,10 @@
 @class TUIFont;
 @class TUIColor;
 
+/**
+ Measuring and drawing go through the shared TUITextLayoutCache and keep no
+ other state, so these are safe to call from any thread or queue at once.
+ */
 @interface NSAttributedString (TUIStringDrawing)
 
 - (CGSize)ab_size;
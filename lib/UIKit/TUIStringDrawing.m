@@ -16,21 +16,13 @@
 
 #import "TUIAttributedString.h"
 #import "TUIStringDrawing.h"
-#import "TUITextRenderer.h"
+#import "TUITextLayout.h"
 #import "TUIColor.h"
 #import "TUIFont.h"
 #import "TUIKit.h"
 
 @implementation NSAttributedString (TUIStringDrawing)
 
-- (TUITextRenderer *)ab_sharedTextRenderer
-{
-	static TUITextRenderer *t = nil;
-	if(!t)
-		t = [[TUITextRenderer alloc] init];
-	return t;
-}
-
 - (CGSize)ab_sizeConstrainedToWidth:(CGFloat)width
 {
 	return [self ab_sizeConstrainedToSize:CGSizeMake(width, 2000)]; // big enough
@@ -38,10 +30,7 @@
 
 - (CGSize)ab_sizeConstrainedToSize:(CGSize)size
 {
-	TUITextRenderer *t = [self ab_sharedTextRenderer];
-	t.attributedString = self;
-	t.frame = CGRectMake(0, 0, size.width, size.height);
-	return [t size];
+	return [[TUITextLayoutCache sharedCache] layoutForAttributedString:self size:size numberOfLines:0].size;
 }
 
 - (CGSize)ab_size
@@ -51,11 +40,9 @@
 
 - (CGSize)ab_drawInRect:(CGRect)rect context:(CGContextRef)ctx
 {
-	TUITextRenderer *t = [self ab_sharedTextRenderer];
-	t.attributedString = self;
-	t.frame = rect;
-	[t drawInContext:ctx];
-	return [t size];
+	TUITextLayout *layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:self size:rect.size numberOfLines:0];
+	[layout drawInRect:rect context:ctx];
+	return layout.size;
 }
 
 - (CGSize)ab_drawInRect:(CGRect)rect
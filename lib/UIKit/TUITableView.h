@@ -39,6 +39,18 @@ typedef enum {
 @class TUITableViewCell;
 @protocol TUITableViewDataSource;
 
+typedef TUITableViewCell * (^TUITableViewCellFactory)(void);
+
+typedef struct {
+	NSUInteger hits;      // dequeues served from the pool
+	NSUInteger misses;    // dequeues the pool couldn't serve
+	NSUInteger evictions; // cells dropped because the pool was full
+	NSUInteger prewarmed; // cells created ahead of time by a registered factory
+	NSUInteger count;     // cells currently in the pool
+} TUITableViewReusePoolStatistics;
+
+extern NSString * const TUITableViewDidReceiveMemoryWarningNotification; // posted on system memory pressure where supported; post it yourself to have every table trim its reuse pools
+
 @class TUITableView;
 
 @protocol TUITableViewDelegate<NSObject, TUIScrollViewDelegate>
@@ -47,6 +59,11 @@ typedef enum {
 
 @optional
 
+/**
+ If implemented, this is used for every row when the table data is (re)loaded and -tableView:heightForRowAtIndexPath: is only asked for rows in and near the visible area, as they come into range.  It should be cheap: a constant, or something based on the model without laying anything out.  When a real height differs from its estimate the table keeps the top visible row in place.
+ */
+- (CGFloat)tableView:(TUITableView *)tableView estimatedHeightForRowAtIndexPath:(TUIFastIndexPath *)indexPath;
+
 - (void)tableView:(TUITableView *)tableView willDisplayCell:(TUITableViewCell *)cell forRowAtIndexPath:(TUIFastIndexPath *)indexPath; // called after the cell's frame has been set but before it's added as a subview
 - (void)tableView:(TUITableView *)tableView didSelectRowAtIndexPath:(TUIFastIndexPath *)indexPath; // happens on left/right mouse down, key up/down
 - (void)tableView:(TUITableView *)tableView didDeselectRowAtIndexPath:(TUIFastIndexPath *)indexPath;
@@ -55,6 +72,11 @@ typedef enum {
 - (BOOL)tableView:(TUITableView*)tableView shouldSelectRowAtIndexPath:(TUIFastIndexPath*)indexPath forEvent:(NSEvent*)event; // YES, if not implemented
 - (NSMenu *)tableView:(TUITableView *)tableView menuForRowAtIndexPath:(TUIFastIndexPath *)indexPath withEvent:(NSEvent *)event;
 
+/**
+ Return YES if -tableView:heightForRowAtIndexPath: (and -tableView:estimatedHeightForRowAtIndexPath:, if implemented) may be called from any thread, concurrently.  -reloadData then calculates row heights for all sections in parallel in the background and swaps the result in when it's done.  Until then the table keeps its current layout and scrolls as before, but the data source has already moved on, so its cells are hidden and no new ones are requested until the new layout is in place.  Row identifiers (see -tableView:identifierForRowAtIndexPath:) are collected on the main thread before the background pass starts.  -tableViewDidReloadData: is sent once the new layout is in place.
+ */
+- (BOOL)tableViewCanCalculateRowHeightsConcurrently:(TUITableView *)tableView;
+
 // the following are good places to update or restore state (such as selection) when the table data reloads
 - (void)tableViewWillReloadData:(TUITableView *)tableView;
 - (void)tableViewDidReloadData:(TUITableView *)tableView;
@@ -77,8 +99,12 @@ typedef enum {
 	CGFloat                       _contentHeight;
 	
 	NSMutableIndexSet           * _visibleSectionHeaders;
-	NSMutableDictionary         * _visibleItems;
-	NSMutableDictionary         * _reusableTableCells;
+	NSMutableArray              * _visibleCells;    // one slot per row from _firstVisibleRow to _lastVisibleRow
+	TUIPackedIndexPath            _firstVisibleRow; // TUIPackedIndexPathNotFound when nothing is visible
+	TUIPackedIndexPath            _lastVisibleRow;
+	NSMutableDictionary         * _reusableTableCells; // reuse identifier -> pool
+	NSUInteger                    _maximumReusableCellCount;
+	id                            _rowHeightCache;
 	
 	TUIFastIndexPath            * _selectedIndexPath;
 	TUIFastIndexPath            * _indexPathShouldBeFirstResponder;
@@ -94,7 +120,22 @@ typedef enum {
   TUITableViewInsertionMethod   _currentDragToReorderInsertionMethod;
   TUIFastIndexPath            * _previousDragToReorderIndexPath;
   TUITableViewInsertionMethod   _previousDragToReorderInsertionMethod;
+  TUITableViewCell            * _detachedDragToReorderCell;      // dragged cell scrolled out of the visible window
+  TUIPackedIndexPath            _detachedDragToReorderRow;       // TUIPackedIndexPathNotFound if there's no detached cell
   
+	// batched row updates
+	NSInteger                     _updateNestingLevel;
+	NSMutableArray              * _indexPathsToDelete;
+	NSMutableArray              * _indexPathsToInsert;
+	NSMutableArray              * _indexPathsToReload;
+	
+	// concurrent reload
+	NSUInteger                    _reloadGeneration;
+	NSArray                     * _preparedSectionInfo;
+	CGFloat                       _preparedContentHeight;
+	
+	TUIPackedIndexPath            _estimatedRowCursor; // rows before it have all been measured
+	
 	struct {
 		unsigned int animateSelectionChanges:1;
 		unsigned int forceSaveScrollPosition:1;
@@ -104,6 +145,13 @@ typedef enum {
 		unsigned int dataSourceNumberOfSectionsInTableView:1;
 		unsigned int delegateTableViewWillDisplayCellForRowAtIndexPath:1;
 		unsigned int maintainContentOffsetAfterReload:1;
+		unsigned int delegateTableViewEstimatedHeightForRowAtIndexPath:1;
+		unsigned int animateUpdates:1;
+		unsigned int calculatingSectionInfo:1;
+		unsigned int visibleCellsHaveGaps:1;
+		unsigned int prewarmScheduled:1;
+		unsigned int dataSourceIdentifierForRowAtIndexPath:1;
+		unsigned int hasProvisionalRowHeights:1;
 	} _tableFlags;
 	
 }
@@ -123,6 +171,21 @@ typedef enum {
  */
 - (void)reloadDataMaintainingVisibleIndexPath:(TUIFastIndexPath *)indexPath relativeOffset:(CGFloat)relativeOffset;
 
+/**
+ Row updates patch the table in place instead of reloading it: untouched visible cells are kept and only inserted or reloaded rows are measured.  Update the data source first, then describe the change.  Calls may be grouped between -beginUpdates and -endUpdates (which may nest); as with UITableView, deleted and reloaded index paths refer to rows before the batch and inserted index paths to rows after it.  If animated, rows displaced by the change slide into place.
+ */
+- (void)beginUpdates;
+- (void)endUpdates;
+
+- (void)insertRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated;
+- (void)deleteRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated;
+- (void)reloadRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated;
+
+/**
+ Fast path for tables that grow at the top, like timelines.  Add the rows to the data source, then call this instead of -insertRowsAtIndexPaths:animated: or -reloadDataMaintainingVisibleIndexPath:relativeOffset:.  Only the new rows are measured and the cost is proportional to their number, not the size of the table.  Visible cells are kept and on-screen content does not move.
+ */
+- (void)prependRows:(NSUInteger)count toSection:(NSInteger)section;
+
 // Forces a re-calculation and re-layout of the table. This is most useful for animating the relayout. It is potentially _more_ expensive than -reloadData since it has to allow for animating.
 - (void)reloadLayout;
 
@@ -148,7 +211,7 @@ typedef enum {
 
 - (TUIView *)headerViewForSection:(NSInteger)section;
 - (TUITableViewCell *)cellForRowAtIndexPath:(TUIFastIndexPath *)indexPath;            // returns nil if cell is not visible or index path is out of range
-- (NSArray *)visibleCells; // no particular order
+- (NSArray *)visibleCells; // no particular order (currently the same as -sortedVisibleCells)
 - (NSArray *)sortedVisibleCells; // top to bottom
 - (NSArray *)indexPathsForVisibleRows;
 
@@ -175,6 +238,36 @@ typedef enum {
  */
 - (TUITableViewCell *)dequeueReusableCellWithIdentifier:(NSString *)identifier;
 
+/**
+ Cells beyond this many per reuse identifier are released instead of pooled, unless the identifier has its own limit.  Defaults to 32; 0 means unlimited.
+ */
+@property (nonatomic, assign) NSUInteger maximumReusableCellCount;
+
+- (void)setMaximumReusableCellCount:(NSUInteger)count forReuseIdentifier:(NSString *)identifier; // 0 reverts to maximumReusableCellCount
+
+/**
+ Register a block which creates cells for a reuse identifier.  When the run loop is idle the table uses it to fill that pool up to @p prewarmCount cells, one cell per pass, so the first scroll doesn't allocate.  -dequeueReusableCellWithIdentifier: also falls back to the factory when the pool is empty (still counted as a miss), so it never returns nil for a registered identifier.  Pass a nil factory to unregister.
+ */
+- (void)registerCellFactory:(TUITableViewCellFactory)factory prewarmCount:(NSUInteger)prewarmCount forReuseIdentifier:(NSString *)identifier;
+
+/**
+ Statistics for one reuse identifier, or summed over all identifiers if @p identifier is nil.
+ */
+- (TUITableViewReusePoolStatistics)reusePoolStatisticsForReuseIdentifier:(NSString *)identifier;
+
+/**
+ Release the backing stores of pooled cells and trim pools back to their prewarm counts.  Called for TUITableViewDidReceiveMemoryWarningNotification; pooled cells redraw when they're reused.
+ */
+- (void)didReceiveMemoryWarning;
+
+/**
+ Maximum number of (identity, width) entries kept in the row height cache; least recently used entries are evicted first.  Defaults to 2048.
+ */
+@property (nonatomic, assign) NSUInteger rowHeightCacheLimit;
+
+- (void)invalidateCachedRowHeightForIdentifier:(id)identifier; // all widths
+- (void)invalidateAllCachedRowHeights;
+
 @end
 
 @protocol TUITableViewDataSource<NSObject>
@@ -189,6 +282,11 @@ typedef enum {
 
 - (TUIView *)tableView:(TUITableView *)tableView headerViewForSection:(NSInteger)section;
 
+/**
+ Return a stable identity for the model object behind a row (a tweet ID, say) to let the table cache its height.  Cached heights are keyed by identity and table width and survive -reloadData, so rows that haven't changed aren't measured again; use -invalidateCachedRowHeightForIdentifier: when a row's content changes (-reloadRowsAtIndexPaths:animated: does this for you).  Return nil for rows which shouldn't be cached.  Always called on the main thread; for a concurrent reload (see -tableViewCanCalculateRowHeightsConcurrently:) the table asks for every row's identifier up front.
+ */
+- (id<NSObject, NSCopying>)tableView:(TUITableView *)tableView identifierForRowAtIndexPath:(TUIFastIndexPath *)indexPath;
+
 // the following are required to support row reordering
 - (BOOL)tableView:(TUITableView *)tableView canMoveRowAtIndexPath:(TUIFastIndexPath *)indexPath;
 - (void)tableView:(TUITableView *)tableView moveRowAtIndexPath:(TUIFastIndexPath *)fromIndexPath toIndexPath:(TUIFastIndexPath *)toIndexPath;
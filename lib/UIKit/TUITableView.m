@@ -18,15 +18,31 @@
 #import "TUITableView+Cell.h"
 #import "TUITableViewSectionHeader.h"
 #import "TUINSView.h"
+#import "TUIView+Private.h"
+#import "TUIBackingStore.h"
+#import "TUITextLayout.h"
 
 // header views need to be above the cells at all times
 #define HEADER_Z_POSITION 1000 
 
+#define TUI_DEFAULT_MAXIMUM_REUSABLE_CELL_COUNT 32
+#define TUI_DEFAULT_ROW_HEIGHT_CACHE_LIMIT 2048
+
+NSString * const TUITableViewDidReceiveMemoryWarningNotification = @"TUITableViewDidReceiveMemoryWarningNotification";
+
 typedef struct {
-	CGFloat offset; // from beginning of section
 	CGFloat height;
+	BOOL    estimated; // height came from the delegate's estimate and hasn't been measured yet
 } TUITableViewRowInfo;
 
+@interface TUITableView (RowHeightCache)
+- (BOOL)_hasRowIdentifiers;
+- (id)_identifierForPackedIndexPath:(TUIPackedIndexPath)indexPath;
+- (BOOL)_getCachedHeight:(CGFloat *)height forIdentifier:(id)identifier width:(CGFloat)width;
+- (void)_cacheHeight:(CGFloat)height forIdentifier:(id)identifier width:(CGFloat)width;
+- (void)_invalidateCachedRowHeightForRow:(TUIPackedIndexPath)indexPath;
+@end
+
 @interface TUITableViewSection : NSObject
 {
 	__unsafe_unretained TUITableView  *_tableView;   // weak
@@ -35,7 +51,15 @@ typedef struct {
 	NSUInteger            numberOfRows;
 	CGFloat               sectionHeight;
 	CGFloat               sectionOffset;
-	TUITableViewRowInfo  *rowInfo;
+	CGFloat               rowsOffset;    // from beginning of section, i.e. the header height
+	TUITableViewRowInfo  *rowStorage;    // rowCapacity slots, unused slots have zero height
+	NSUInteger            rowCapacity;
+	NSUInteger            firstRowSlot;  // headroom before the first row, for cheap prepends
+	TUITableViewRowInfo  *rowInfo;       // rowStorage + firstRowSlot
+	CGFloat              *rowHeightTree; // binary indexed (Fenwick) tree of slot heights, 1-based
+	CGFloat               rowWidth;      // table width the heights are for, captured on the main thread
+	NSArray              *rowIdentifiers; // captured on the main thread for a background height pass, NSNull for none
+	BOOL                  provisional;   // laid out during live resize; heights stay out of the row height cache
 }
 
 @property (strong, readonly) TUIView           *headerView;
@@ -55,14 +79,19 @@ typedef struct {
 		_tableView = t;
 		sectionIndex = s;
 		numberOfRows = n;
-		rowInfo = calloc(n, sizeof(TUITableViewRowInfo));
+		rowCapacity = n;
+		rowStorage = calloc(n, sizeof(TUITableViewRowInfo));
+		rowInfo = rowStorage;
+		rowHeightTree = calloc(n + 1, sizeof(CGFloat));
+		rowWidth = t.bounds.size.width;
 	}
 	return self;
 }
 
 - (void)dealloc
 {
-	if(rowInfo) free(rowInfo);
+	if(rowStorage) free(rowStorage);
+	if(rowHeightTree) free(rowHeightTree);
 }
 
 - (NSUInteger)numberOfRows
@@ -70,22 +99,298 @@ typedef struct {
 	return numberOfRows;
 }
 
-- (void)_setupRowHeights
+/**
+ * @brief Rebuild the row height tree from the row storage in O(n)
+ */
+- (void)_rebuildRowHeightTree
+{
+	rowHeightTree[0] = 0.0;
+	for(NSUInteger i = 1; i <= rowCapacity; ++i)
+		rowHeightTree[i] = rowStorage[i - 1].height;
+	for(NSUInteger i = 1; i <= rowCapacity; ++i) {
+		NSUInteger parent = i + (i & -i);
+		if(parent <= rowCapacity)
+			rowHeightTree[parent] += rowHeightTree[i];
+	}
+}
+
+- (void)_addHeight:(CGFloat)delta toSlot:(NSUInteger)slot
+{
+	for(NSUInteger k = slot + 1; k <= rowCapacity; k += (k & -k))
+		rowHeightTree[k] += delta;
+}
+
+/**
+ * @brief Sum of the heights of rows [0, @p i) in O(log n)
+ * 
+ * The headroom slots before the first row have zero height, so this is just
+ * the prefix sum up to the row's slot.
+ */
+- (CGFloat)_heightOfRowsBeforeRow:(NSUInteger)i
+{
+	CGFloat sum = 0.0;
+	for(NSUInteger k = firstRowSlot + MIN(i, numberOfRows); k > 0; k -= (k & -k))
+		sum += rowHeightTree[k];
+	return sum;
+}
+
+/**
+ * @brief Set up the header height
+ * 
+ * This creates the header view, so it has to run on the main thread before
+ * #_setupRowHeightsEstimated:.
+ */
+- (void)_setupHeaderHeight
 {
-	sectionHeight = 0.0;
+	rowsOffset = 0.0;
 	
 	TUIView *header;
 	if((header = self.headerView) != nil) {
-		sectionHeight += roundf(header.frame.size.height);
+		rowsOffset += roundf(header.frame.size.height);
 	}
-  
+}
+
+/**
+ * @brief Ask the data source for every row's height cache identifier up front
+ * 
+ * The data source is only ever called on the main thread, so a height pass
+ * that runs in the background works from this snapshot instead.
+ */
+- (void)_captureRowIdentifiers
+{
+	if(![_tableView _hasRowIdentifiers])
+		return;
+	
+	NSMutableArray *identifiers = [[NSMutableArray alloc] initWithCapacity:numberOfRows];
+	for(NSUInteger i = 0; i < numberOfRows; ++i) {
+		id identifier = [_tableView _identifierForPackedIndexPath:TUIPackedIndexPathMake(sectionIndex, i)];
+		[identifiers addObject:(identifier != nil) ? identifier : [NSNull null]];
+	}
+	rowIdentifiers = identifiers;
+}
+
+- (id)_identifierForRow:(NSInteger)i
+{
+	if(provisional)
+		return nil; // nothing is cached at widths passed through in a live resize
+	if(rowIdentifiers != nil) {
+		id identifier = [rowIdentifiers objectAtIndex:i];
+		return (identifier != [NSNull null]) ? identifier : nil;
+	}
+	return [_tableView _identifierForPackedIndexPath:TUIPackedIndexPathMake(sectionIndex, i)];
+}
+
+/**
+ * @brief Set up row heights
+ * 
+ * When @p estimated is set the delegate's (cheap) estimate is used for every
+ * row and real heights are measured lazily via #measureHeightForRow:.  This
+ * only talks to the delegate's height callbacks, so when the delegate says
+ * they are thread-safe it may run on any queue.
+ */
+- (void)_setupRowHeightsEstimated:(BOOL)estimated
+{
+	sectionHeight = rowsOffset;
+	for(int i = 0; i < numberOfRows; ++i) {
+		rowInfo[i] = [self _rowInfoForRow:i estimated:estimated];
+		sectionHeight += rowInfo[i].height;
+	}
+	rowIdentifiers = nil; // rows may change once the section is in use
+	
+	[self _rebuildRowHeightTree];
+}
+
+/**
+ * @brief Set up row heights from a section laid out at another width
+ * 
+ * Used during live resize: each row starts out with its height from
+ * @p previous, marked as estimated, so nothing is measured up front and the
+ * data source isn't asked for identifiers every frame.  Rows are then
+ * measured as they come near the viewport, with the rest following in idle
+ * time.  Widths passed through while resizing aren't worth caching, so
+ * nothing is cached until #_endProvisionalHeights.
+ */
+- (void)_setupRowHeightsFromSection:(TUITableViewSection *)previous
+{
+	provisional = YES;
+	sectionHeight = rowsOffset;
 	for(int i = 0; i < numberOfRows; ++i) {
-		CGFloat h = roundf([_tableView.delegate tableView:_tableView heightForRowAtIndexPath:[TUIFastIndexPath indexPathForRow:i inSection:sectionIndex]]);
-		rowInfo[i].offset = sectionHeight;
-		rowInfo[i].height = h;
-		sectionHeight += h;
+		rowInfo[i].height = [previous rowHeight:i];
+		rowInfo[i].estimated = YES;
+		sectionHeight += rowInfo[i].height;
 	}
 	
+	[self _rebuildRowHeightTree];
+}
+
+/**
+ * @brief The live resize ended at this section's width: cache the rows measured at it
+ * 
+ * Rows still estimated take their heights from the cache when measured.
+ */
+- (void)_endProvisionalHeights
+{
+	if(!provisional)
+		return;
+	provisional = NO;
+	for(NSUInteger i = 0; i < numberOfRows; ++i) {
+		if(!rowInfo[i].estimated)
+			[_tableView _cacheHeight:rowInfo[i].height forIdentifier:[self _identifierForRow:i] width:rowWidth];
+	}
+}
+
+/**
+ * @brief Find the first row at or after @p i whose height is still estimated
+ * @return the row or NSNotFound
+ */
+- (NSInteger)indexOfFirstEstimatedRowAtOrAfterRow:(NSInteger)i
+{
+	for(; i < (NSInteger)numberOfRows; ++i) {
+		if(rowInfo[i].estimated)
+			return i;
+	}
+	return NSNotFound;
+}
+
+- (TUITableViewRowInfo)_rowInfoForRow:(NSInteger)i estimated:(BOOL)estimated
+{
+	TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:i inSection:sectionIndex];
+	id identifier = [self _identifierForRow:i];
+	TUITableViewRowInfo info;
+	if([_tableView _getCachedHeight:&info.height forIdentifier:identifier width:rowWidth]) {
+		// a real height, even when estimating
+		info.estimated = NO;
+		return info;
+	}
+	if(estimated) {
+		info.height = roundf([_tableView.delegate tableView:_tableView estimatedHeightForRowAtIndexPath:indexPath]);
+	} else {
+		info.height = roundf([_tableView.delegate tableView:_tableView heightForRowAtIndexPath:indexPath]);
+		[_tableView _cacheHeight:info.height forIdentifier:identifier width:rowWidth];
+	}
+	info.estimated = estimated;
+	return info;
+}
+
+/**
+ * @brief Patch the rows of this section in place
+ * 
+ * Deleted and reloaded rows are given as indexes before the update, inserted
+ * rows as indexes after it.  Only inserted and reloaded rows are asked for a
+ * height; every other row keeps the one it already has.
+ */
+- (void)_updateRowsDeleting:(NSIndexSet *)deleted inserting:(NSIndexSet *)inserted reloading:(NSIndexSet *)reloaded estimated:(BOOL)estimated
+{
+	NSUInteger newNumberOfRows = numberOfRows - [deleted count] + [inserted count];
+	TUITableViewRowInfo *newRowInfo = calloc(newNumberOfRows, sizeof(TUITableViewRowInfo));
+	
+	sectionHeight = rowsOffset;
+	NSUInteger oldRow = 0;
+	for(NSUInteger row = 0; row < newNumberOfRows; ++row) {
+		if([inserted containsIndex:row]) {
+			newRowInfo[row] = [self _rowInfoForRow:row estimated:estimated];
+		} else {
+			while([deleted containsIndex:oldRow])
+				++oldRow;
+			if(oldRow < numberOfRows && ![reloaded containsIndex:oldRow]) {
+				newRowInfo[row] = rowInfo[oldRow];
+			} else {
+				// the row's content changed, so its cached height is stale
+				[_tableView _invalidateCachedRowHeightForRow:TUIPackedIndexPathMake(sectionIndex, row)];
+				newRowInfo[row] = [self _rowInfoForRow:row estimated:estimated];
+			}
+			++oldRow;
+		}
+		sectionHeight += newRowInfo[row].height;
+	}
+	
+	free(rowStorage);
+	rowStorage = newRowInfo;
+	rowInfo = rowStorage;
+	numberOfRows = newNumberOfRows;
+	rowCapacity = newNumberOfRows;
+	firstRowSlot = 0;
+	rowHeightTree = realloc(rowHeightTree, (rowCapacity + 1) * sizeof(CGFloat));
+	[self _rebuildRowHeightTree];
+}
+
+/**
+ * @brief Insert rows at the top of the section
+ * 
+ * Rows live after some unused, zero height headroom, so prepending only
+ * measures the new rows and adds them to the tree.  When the headroom runs out
+ * it is grown in proportion to the section, which keeps prepending O(1)
+ * amortized per row plus the O(log n) tree update.
+ * 
+ * @return the combined height of the new rows
+ */
+- (CGFloat)_prependRows:(NSUInteger)count estimated:(BOOL)estimated
+{
+	if(count > firstRowSlot) {
+		NSUInteger headroom = MAX(count, numberOfRows);
+		NSUInteger capacity = headroom + numberOfRows;
+		TUITableViewRowInfo *storage = calloc(capacity, sizeof(TUITableViewRowInfo));
+		memcpy(storage + headroom, rowInfo, numberOfRows * sizeof(TUITableViewRowInfo));
+		free(rowStorage);
+		rowStorage = storage;
+		rowCapacity = capacity;
+		firstRowSlot = headroom;
+		rowHeightTree = realloc(rowHeightTree, (rowCapacity + 1) * sizeof(CGFloat));
+		[self _rebuildRowHeightTree];
+	}
+	
+	firstRowSlot -= count;
+	rowInfo = rowStorage + firstRowSlot;
+	numberOfRows += count;
+	
+	CGFloat height = 0.0;
+	for(NSUInteger i = 0; i < count; ++i) {
+		rowInfo[i] = [self _rowInfoForRow:i estimated:estimated];
+		[self _addHeight:rowInfo[i].height toSlot:firstRowSlot + i];
+		height += rowInfo[i].height;
+	}
+	sectionHeight += height;
+	
+	return height;
+}
+
+- (BOOL)rowHeightIsEstimated:(NSInteger)i
+{
+	if(i >= 0 && i < numberOfRows) {
+		return rowInfo[i].estimated;
+	}
+	return NO;
+}
+
+/**
+ * @brief Replace an estimated row height with the real one from the delegate
+ * 
+ * The correction is folded into the row height tree in O(log n).
+ * 
+ * @return the change in height of the row (and of the section)
+ */
+- (CGFloat)measureHeightForRow:(NSInteger)i
+{
+	if(i < 0 || i >= numberOfRows || !rowInfo[i].estimated)
+		return 0.0;
+	
+	CGFloat h;
+	id identifier = [self _identifierForRow:i];
+	if(![_tableView _getCachedHeight:&h forIdentifier:identifier width:rowWidth]) {
+		TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:i inSection:sectionIndex];
+		h = roundf([_tableView.delegate tableView:_tableView heightForRowAtIndexPath:indexPath]);
+		[_tableView _cacheHeight:h forIdentifier:identifier width:rowWidth];
+	}
+	CGFloat delta = h - rowInfo[i].height;
+	rowInfo[i].height = h;
+	rowInfo[i].estimated = NO;
+	
+	if(delta != 0.0) {
+		[self _addHeight:delta toSlot:firstRowSlot + i];
+		sectionHeight += delta;
+	}
+	
+	return delta;
 }
 
 - (CGFloat)rowHeight:(NSInteger)i
@@ -99,7 +404,7 @@ typedef struct {
 - (CGFloat)sectionRowOffset:(NSInteger)i
 {
 	if(i >= 0 && i < numberOfRows){
-		return rowInfo[i].offset;
+		return rowsOffset + [self _heightOfRowsBeforeRow:i];
 	}
 	return 0.0;
 }
@@ -114,6 +419,36 @@ typedef struct {
 	return sectionHeight;
 }
 
+/**
+ * @brief Find the first row which extends to or past an offset
+ * 
+ * This descends the row height tree, so it is O(log n) and stays correct as
+ * estimated heights are corrected.
+ * 
+ * @param offset offset from the beginning of the section
+ * @return index of the first row whose bottom edge is at or past @p offset, or
+ * the number of rows if every row ends before it
+ */
+- (NSInteger)indexOfFirstRowEndingAtOrAfterOffset:(CGFloat)offset
+{
+	CGFloat remaining = offset - rowsOffset;
+	NSUInteger position = 0;
+	NSUInteger step = 1;
+	while((step << 1) <= rowCapacity)
+		step <<= 1;
+	for(; step > 0; step >>= 1) {
+		if(position + step <= rowCapacity && rowHeightTree[position + step] < remaining) {
+			position += step;
+			remaining -= rowHeightTree[position];
+		}
+	}
+	
+	// position is a slot; the zero height headroom can't end past a positive offset
+	if(position < firstRowSlot)
+		return 0;
+	return MIN(position - firstRowSlot, numberOfRows);
+}
+
 - (CGFloat)headerHeight
 {
 	return (self.headerView != nil) ? self.headerView.frame.size.height : 0;
@@ -141,9 +476,259 @@ typedef struct {
 
 @end
 
+/**
+ * @brief Reusable cells for one reuse identifier
+ */
+@interface TUITableViewReusePool : NSObject
+{
+@public
+	NSMutableArray          *cells;
+	NSUInteger               maximumCount; // 0 = use the table's default
+	TUITableViewCellFactory  factory;
+	NSUInteger               prewarmCount;
+	TUITableViewReusePoolStatistics statistics;
+}
+@end
+
+@implementation TUITableViewReusePool
+
+- (id)init
+{
+	if((self = [super init])) {
+		cells = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+@end
+
+/**
+ * @brief Row height cache key: a row's model identity and the table width
+ */
+@interface TUITableViewRowHeightKey : NSObject <NSCopying>
+{
+@public
+	id       identifier;
+	CGFloat  width;
+}
+@end
+
+@implementation TUITableViewRowHeightKey
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	return self; // immutable
+}
+
+- (NSUInteger)hash
+{
+	return [identifier hash] ^ ((NSUInteger)width * 2654435761u);
+}
+
+- (BOOL)isEqual:(id)object
+{
+	TUITableViewRowHeightKey *other = object;
+	return [object isKindOfClass:[TUITableViewRowHeightKey class]] && other->width == width && [other->identifier isEqual:identifier];
+}
+
+@end
+
+/**
+ * @brief Cached row height, linked into the cache's LRU list
+ */
+@interface TUITableViewRowHeightEntry : NSObject
+{
+@public
+	TUITableViewRowHeightKey                    *key;
+	CGFloat                                      height;
+	__unsafe_unretained TUITableViewRowHeightEntry *previous; // more recently used
+	__unsafe_unretained TUITableViewRowHeightEntry *next;     // less recently used
+}
+@end
+
+@implementation TUITableViewRowHeightEntry
+@end
+
+/**
+ * @brief LRU cache of row heights keyed by (identity, width)
+ * 
+ * Heights may be calculated concurrently (see
+ * -tableViewCanCalculateRowHeightsConcurrently:), so access is synchronized.
+ */
+@interface TUITableViewRowHeightCache : NSObject
+{
+	NSMutableDictionary         *entries;     // key -> entry, owns the entries
+	NSMutableDictionary         *widthsByIdentifier; // identity -> NSMutableArray of keys, for invalidation
+	__unsafe_unretained TUITableViewRowHeightEntry *head; // most recently used
+	__unsafe_unretained TUITableViewRowHeightEntry *tail; // least recently used
+@public
+	NSUInteger                   limit;
+}
+- (BOOL)getHeight:(CGFloat *)height forIdentifier:(id)identifier width:(CGFloat)width;
+- (void)setHeight:(CGFloat)height forIdentifier:(id)identifier width:(CGFloat)width;
+- (void)removeHeightsForIdentifier:(id)identifier;
+- (void)removeAllHeights;
+@end
+
+@implementation TUITableViewRowHeightCache
+
+- (id)init
+{
+	if((self = [super init])) {
+		entries = [[NSMutableDictionary alloc] init];
+		widthsByIdentifier = [[NSMutableDictionary alloc] init];
+		limit = TUI_DEFAULT_ROW_HEIGHT_CACHE_LIMIT;
+	}
+	return self;
+}
+
+- (void)_unlinkEntry:(TUITableViewRowHeightEntry *)entry
+{
+	if(entry->previous) entry->previous->next = entry->next; else head = entry->next;
+	if(entry->next) entry->next->previous = entry->previous; else tail = entry->previous;
+	entry->previous = nil;
+	entry->next = nil;
+}
+
+- (void)_linkEntryAtHead:(TUITableViewRowHeightEntry *)entry
+{
+	entry->next = head;
+	if(head) head->previous = entry;
+	head = entry;
+	if(!tail) tail = entry;
+}
+
+- (void)_removeEntry:(TUITableViewRowHeightEntry *)entry
+{
+	[self _unlinkEntry:entry];
+	NSMutableArray *keys = [widthsByIdentifier objectForKey:entry->key->identifier];
+	[keys removeObjectIdenticalTo:entry->key];
+	if([keys count] == 0)
+		[widthsByIdentifier removeObjectForKey:entry->key->identifier];
+	[entries removeObjectForKey:entry->key]; // may release the entry
+}
+
+- (void)_evictToLimit
+{
+	while(limit > 0 && [entries count] > limit && tail != nil)
+		[self _removeEntry:tail];
+}
+
+- (BOOL)getHeight:(CGFloat *)height forIdentifier:(id)identifier width:(CGFloat)width
+{
+	TUITableViewRowHeightKey *key = [[TUITableViewRowHeightKey alloc] init];
+	key->identifier = identifier;
+	key->width = width;
+	
+	@synchronized(self) {
+		TUITableViewRowHeightEntry *entry = [entries objectForKey:key];
+		if(entry == nil)
+			return NO;
+		if(entry != head) {
+			[self _unlinkEntry:entry];
+			[self _linkEntryAtHead:entry];
+		}
+		*height = entry->height;
+		return YES;
+	}
+}
+
+- (void)setHeight:(CGFloat)height forIdentifier:(id)identifier width:(CGFloat)width
+{
+	TUITableViewRowHeightKey *key = [[TUITableViewRowHeightKey alloc] init];
+	key->identifier = [identifier copy];
+	key->width = width;
+	
+	@synchronized(self) {
+		TUITableViewRowHeightEntry *entry = [entries objectForKey:key];
+		if(entry != nil) {
+			[self _unlinkEntry:entry];
+		} else {
+			entry = [[TUITableViewRowHeightEntry alloc] init];
+			entry->key = key;
+			[entries setObject:entry forKey:key];
+			NSMutableArray *keys = [widthsByIdentifier objectForKey:key->identifier];
+			if(!keys) {
+				keys = [[NSMutableArray alloc] initWithCapacity:1];
+				[widthsByIdentifier setObject:keys forKey:key->identifier];
+			}
+			[keys addObject:key];
+		}
+		entry->height = height;
+		[self _linkEntryAtHead:entry];
+		[self _evictToLimit];
+	}
+}
+
+- (void)removeHeightsForIdentifier:(id)identifier
+{
+	@synchronized(self) {
+		for(TUITableViewRowHeightKey *key in [[widthsByIdentifier objectForKey:identifier] copy]) {
+			TUITableViewRowHeightEntry *entry = [entries objectForKey:key];
+			if(entry != nil)
+				[self _removeEntry:entry];
+		}
+	}
+}
+
+- (void)removeAllHeights
+{
+	@synchronized(self) {
+		head = nil;
+		tail = nil;
+		[entries removeAllObjects];
+		[widthsByIdentifier removeAllObjects];
+	}
+}
+
+- (void)setLimit:(NSUInteger)l
+{
+	@synchronized(self) {
+		limit = l;
+		[self _evictToLimit];
+	}
+}
+
+@end
+
+/**
+ * @brief Release a view tree's backing stores; they're redrawn once the views are back onscreen
+ */
+static void TUITableViewReleaseBackingStores(TUIView *view)
+{
+	[view _purgeBackingStore];
+	for(TUIView *subview in view.subviews)
+		TUITableViewReleaseBackingStores(subview);
+}
+
+/**
+ * @brief Empty the text layout cache and post TUITableViewDidReceiveMemoryWarningNotification when the system reports memory pressure
+ */
+static void TUITableViewStartObservingMemoryPressure(void)
+{
+#ifdef DISPATCH_SOURCE_TYPE_MEMORYPRESSURE
+	static dispatch_source_t source = NULL;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		// weakly linked: the source type only exists from 10.9 on
+		if(&_dispatch_source_type_memorypressure == NULL)
+			return;
+		source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+		if(source != NULL) {
+			dispatch_source_set_event_handler(source, ^{
+				[[TUITextLayoutCache sharedCache] removeAllLayouts];
+				[[NSNotificationCenter defaultCenter] postNotificationName:TUITableViewDidReceiveMemoryWarningNotification object:nil];
+			});
+			dispatch_resume(source);
+		}
+	});
+#endif
+}
+
 @interface TUITableView (Private)
 - (void)_updateSectionInfo;
 - (void)_updateDerepeaterViews;
+- (void)_updateVisibleCellIndexPaths;
 @end
 
 @implementation TUITableView
@@ -156,13 +741,26 @@ typedef struct {
 	if((self = [super initWithFrame:frame])) {
 		_style = style;
 		_reusableTableCells = [[NSMutableDictionary alloc] init];
+		_maximumReusableCellCount = TUI_DEFAULT_MAXIMUM_REUSABLE_CELL_COUNT;
+		_rowHeightCache = [[TUITableViewRowHeightCache alloc] init];
 		_visibleSectionHeaders = [[NSMutableIndexSet alloc] init];
-		_visibleItems = [[NSMutableDictionary alloc] init];
+		_visibleCells = [[NSMutableArray alloc] init];
+		_firstVisibleRow = TUIPackedIndexPathNotFound;
+		_lastVisibleRow = TUIPackedIndexPathNotFound;
+		_detachedDragToReorderRow = TUIPackedIndexPathNotFound;
 		_tableFlags.animateSelectionChanges = 1;
+		
+		TUITableViewStartObservingMemoryPressure();
+		[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning) name:TUITableViewDidReceiveMemoryWarningNotification object:nil];
 	}
 	return self;
 }
 
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:TUITableViewDidReceiveMemoryWarningNotification object:nil];
+}
+
 - (id)initWithFrame:(CGRect)frame
 {
 	return [self initWithFrame:frame style:TUITableViewStylePlain];
@@ -177,6 +775,7 @@ typedef struct {
 - (void)setDelegate:(id<TUITableViewDelegate>)d
 {
 	_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath = [d respondsToSelector:@selector(tableView:willDisplayCell:forRowAtIndexPath:)];
+	_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath = [d respondsToSelector:@selector(tableView:estimatedHeightForRowAtIndexPath:)];
 	[super setDelegate:d]; // must call super
 }
 
@@ -189,6 +788,57 @@ typedef struct {
 {
 	_dataSource = d;
 	_tableFlags.dataSourceNumberOfSectionsInTableView = [_dataSource respondsToSelector:@selector(numberOfSectionsInTableView:)];
+	_tableFlags.dataSourceIdentifierForRowAtIndexPath = [_dataSource respondsToSelector:@selector(tableView:identifierForRowAtIndexPath:)];
+}
+
+- (NSUInteger)rowHeightCacheLimit
+{
+	return ((TUITableViewRowHeightCache *)_rowHeightCache)->limit;
+}
+
+- (void)setRowHeightCacheLimit:(NSUInteger)limit
+{
+	[_rowHeightCache setLimit:limit];
+}
+
+- (void)invalidateCachedRowHeightForIdentifier:(id)identifier
+{
+	if(identifier != nil)
+		[_rowHeightCache removeHeightsForIdentifier:identifier];
+}
+
+- (void)invalidateAllCachedRowHeights
+{
+	[_rowHeightCache removeAllHeights];
+}
+
+- (BOOL)_hasRowIdentifiers
+{
+	return _tableFlags.dataSourceIdentifierForRowAtIndexPath;
+}
+
+- (id)_identifierForPackedIndexPath:(TUIPackedIndexPath)indexPath
+{
+	if(!_tableFlags.dataSourceIdentifierForRowAtIndexPath)
+		return nil;
+	return [_dataSource tableView:self identifierForRowAtIndexPath:[TUIFastIndexPath indexPathWithPackedIndexPath:indexPath]];
+}
+
+- (BOOL)_getCachedHeight:(CGFloat *)height forIdentifier:(id)identifier width:(CGFloat)width
+{
+	return identifier != nil && [_rowHeightCache getHeight:height forIdentifier:identifier width:width];
+}
+
+- (void)_cacheHeight:(CGFloat)height forIdentifier:(id)identifier width:(CGFloat)width
+{
+	if(identifier != nil)
+		[_rowHeightCache setHeight:height forIdentifier:identifier width:width];
+}
+
+- (void)_invalidateCachedRowHeightForRow:(TUIPackedIndexPath)indexPath
+{
+	if(_tableFlags.dataSourceIdentifierForRowAtIndexPath)
+		[self invalidateCachedRowHeightForIdentifier:[_dataSource tableView:self identifierForRowAtIndexPath:[TUIFastIndexPath indexPathWithPackedIndexPath:indexPath]]];
 }
 
 - (BOOL)animateSelectionChanges
@@ -236,9 +886,14 @@ typedef struct {
 
 - (CGRect)rectForRowAtIndexPath:(TUIFastIndexPath *)indexPath
 {
-	NSInteger section = indexPath.section;
-	NSInteger row = indexPath.row;
-	if(section >= 0 && section < [_sectionInfo count]) {
+	return (indexPath != nil) ? [self _rectForRow:indexPath.packedIndexPath] : CGRectZero;
+}
+
+- (CGRect)_rectForRow:(TUIPackedIndexPath)indexPath
+{
+	NSInteger section = TUIPackedIndexPathGetSection(indexPath);
+	NSInteger row = TUIPackedIndexPathGetRow(indexPath);
+	if(indexPath != TUIPackedIndexPathNotFound && section < [_sectionInfo count]) {
 		TUITableViewSection *s = [_sectionInfo objectAtIndex:section];
 		CGFloat offset = [s tableRowOffset:row];
 		CGFloat height = [s rowHeight:row];
@@ -255,6 +910,11 @@ typedef struct {
  */
 - (void)_updateSectionInfo {
   
+  // a non-nil section info here means only the geometry changed
+  NSArray *previousSectionInfo = _sectionInfo;
+  _tableFlags.hasProvisionalRowHeights = 0;
+	_estimatedRowCursor = TUIPackedIndexPathMake(0, 0);
+  
   if(_sectionInfo != nil){
     
     // remove any visible headers, they should be re-added when the table is laid out
@@ -271,6 +931,14 @@ typedef struct {
 	_sectionInfo = nil;
   }
   
+	// a reload may have already built the section info in the background
+	if(_preparedSectionInfo != nil) {
+		_sectionInfo = _preparedSectionInfo;
+		_contentHeight = _preparedContentHeight;
+		_preparedSectionInfo = nil;
+		return;
+	}
+  
 	NSInteger numberOfSections = 1;
 	if(_tableFlags.dataSourceNumberOfSectionsInTableView){
 		numberOfSections = [_dataSource numberOfSectionsInTableView:self];
@@ -278,10 +946,22 @@ typedef struct {
 	
 	NSMutableArray *sections = [[NSMutableArray alloc] initWithCapacity:numberOfSections];
 	
+	// during live resize keep the old heights as estimates instead of measuring every row each frame
+	BOOL provisional = [self.nsView inLiveResize] && [previousSectionInfo count] == numberOfSections;
+	
 	CGFloat offset = [_headerView bounds].size.height - self.contentInset.top*2;
 	for(int s = 0; s < numberOfSections; ++s) {
 		TUITableViewSection *section = [[TUITableViewSection alloc] initWithNumberOfRows:[_dataSource tableView:self numberOfRowsInSection:s] sectionIndex:s tableView:self];
-		[section _setupRowHeights];
+		[section _setupHeaderHeight];
+		TUITableViewSection *previousSection = provisional ? [previousSectionInfo objectAtIndex:s] : nil;
+		if(previousSection != nil && [previousSection numberOfRows] == [section numberOfRows]) {
+			[section _setupRowHeightsFromSection:previousSection];
+			// tables with delegate estimates measure lazily anyway; otherwise fill in the rest when idle
+			if(!_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath)
+				_tableFlags.hasProvisionalRowHeights = 1;
+		} else {
+			[section _setupRowHeightsEstimated:_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath];
+		}
 		section.sectionOffset = offset;
 		offset += [section sectionHeight];
 		[sections addObject:section];
@@ -290,6 +970,349 @@ typedef struct {
 	_contentHeight = offset - self.contentInset.bottom;
 	_sectionInfo = sections;
 	
+	if(_tableFlags.hasProvisionalRowHeights)
+		[self _scheduleProvisionalRowMeasurement];
+	
+}
+
+/**
+ * @brief Group index paths into sets of rows keyed by section
+ */
+static NSDictionary *TUITableViewRowsBySection(NSArray *indexPaths)
+{
+	NSMutableDictionary *rows = [NSMutableDictionary dictionary];
+	for(TUIFastIndexPath *indexPath in indexPaths) {
+		NSNumber *key = [NSNumber numberWithInteger:indexPath.section];
+		NSMutableIndexSet *set = [rows objectForKey:key];
+		if(set == nil) {
+			set = [NSMutableIndexSet indexSet];
+			[rows setObject:set forKey:key];
+		}
+		[set addIndex:indexPath.row];
+	}
+	return rows;
+}
+
+/**
+ * @brief Map a row index from before an update to after it
+ * 
+ * @return the new row index or NSNotFound if the row was deleted
+ */
+static NSInteger TUITableViewRowAfterUpdate(NSInteger row, NSIndexSet *deleted, NSIndexSet *inserted)
+{
+	if([deleted containsIndex:row])
+		return NSNotFound;
+	
+	// position among the surviving rows, then step over any rows inserted at or before it
+	NSInteger newRow = row - [deleted countOfIndexesInRange:NSMakeRange(0, row)];
+	for(NSUInteger i = [inserted firstIndex]; i != NSNotFound && i <= newRow; i = [inserted indexGreaterThanIndex:i])
+		++newRow;
+	return newRow;
+}
+
+- (void)beginUpdates
+{
+	if(_updateNestingLevel++ == 0) {
+		_indexPathsToDelete = [[NSMutableArray alloc] init];
+		_indexPathsToInsert = [[NSMutableArray alloc] init];
+		_indexPathsToReload = [[NSMutableArray alloc] init];
+	}
+}
+
+- (void)endUpdates
+{
+	if(_updateNestingLevel <= 0) {
+		NSLog(@"!!! Warning: -endUpdates called without matching -beginUpdates");
+		return;
+	}
+	
+	if(--_updateNestingLevel == 0) {
+		NSDictionary *deleted = TUITableViewRowsBySection(_indexPathsToDelete);
+		NSDictionary *inserted = TUITableViewRowsBySection(_indexPathsToInsert);
+		NSDictionary *reloaded = TUITableViewRowsBySection(_indexPathsToReload);
+		BOOL animated = _tableFlags.animateUpdates;
+		
+		_indexPathsToDelete = nil;
+		_indexPathsToInsert = nil;
+		_indexPathsToReload = nil;
+		_tableFlags.animateUpdates = 0;
+		
+		[self _updateRowsDeleting:deleted inserting:inserted reloading:reloaded animated:animated];
+	}
+}
+
+- (void)insertRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated
+{
+	[self beginUpdates];
+	[_indexPathsToInsert addObjectsFromArray:indexPaths];
+	if(animated) _tableFlags.animateUpdates = 1;
+	[self endUpdates];
+}
+
+- (void)deleteRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated
+{
+	[self beginUpdates];
+	[_indexPathsToDelete addObjectsFromArray:indexPaths];
+	if(animated) _tableFlags.animateUpdates = 1;
+	[self endUpdates];
+}
+
+- (void)reloadRowsAtIndexPaths:(NSArray *)indexPaths animated:(BOOL)animated
+{
+	[self beginUpdates];
+	[_indexPathsToReload addObjectsFromArray:indexPaths];
+	if(animated) _tableFlags.animateUpdates = 1;
+	[self endUpdates];
+}
+
+- (void)prependRows:(NSUInteger)count toSection:(NSInteger)section
+{
+	if(count == 0)
+		return;
+	
+	if(_sectionInfo == nil || _updateNestingLevel > 0 || section < 0 || section >= [_sectionInfo count]) {
+		// nothing laid out yet, or a batch is open; describe it as a plain insert
+		NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:count];
+		for(NSUInteger row = 0; row < count; ++row)
+			[indexPaths addObject:[TUIFastIndexPath indexPathForRow:row inSection:section]];
+		[self insertRowsAtIndexPaths:indexPaths animated:NO];
+		return;
+	}
+	
+	TUITableViewSection *s = [_sectionInfo objectAtIndex:section];
+	if(_tableFlags.calculatingSectionInfo) {
+		// the pending snapshot predates these rows, start over
+		[self reloadData];
+		return;
+	}
+	if([s numberOfRows] + count != [_dataSource tableView:self numberOfRowsInSection:section]) {
+		NSLog(@"!!! Warning: prepended rows don't match the data source, reloading the table instead");
+		[self reloadData];
+		return;
+	}
+	
+	// the top visible row decides what stays still (see below)
+	CGRect visible = [self visibleRect];
+	TUIPackedIndexPath anchor = [self _firstRowEndingAtOrAfterContentOffset:_contentHeight - CGRectGetMaxY(visible)];
+	
+	CGFloat height = [s _prependRows:count estimated:_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath];
+	_estimatedRowCursor = TUIPackedIndexPathMake(0, 0);
+	for(NSInteger i = section + 1; i < [_sectionInfo count]; ++i) {
+		TUITableViewSection *following = [_sectionInfo objectAtIndex:i];
+		following.sectionOffset += height;
+	}
+	_contentHeight += height;
+	
+	// shift the visible window; new rows only land inside it when it spans into this section from above
+	if(_firstVisibleRow != TUIPackedIndexPathNotFound && TUIPackedIndexPathGetSection(_firstVisibleRow) < section && TUIPackedIndexPathGetSection(_lastVisibleRow) >= section) {
+		NSInteger slot = [self _visibleSlotForRow:TUIPackedIndexPathMake(section, 0)];
+		for(NSUInteger i = 0; i < count; ++i)
+			[_visibleCells insertObject:[NSNull null] atIndex:slot];
+		_tableFlags.visibleCellsHaveGaps = 1;
+	}
+	// rows are the low word, so shifting rows within a section is plain addition
+	if(_firstVisibleRow != TUIPackedIndexPathNotFound && TUIPackedIndexPathGetSection(_firstVisibleRow) == section)
+		_firstVisibleRow += count;
+	if(_lastVisibleRow != TUIPackedIndexPathNotFound && TUIPackedIndexPathGetSection(_lastVisibleRow) == section)
+		_lastVisibleRow += count;
+	if(_detachedDragToReorderRow != TUIPackedIndexPathNotFound && TUIPackedIndexPathGetSection(_detachedDragToReorderRow) == section)
+		_detachedDragToReorderRow += count;
+	[self _updateVisibleCellIndexPaths];
+	
+	if(_selectedIndexPath.section == section && _selectedIndexPath != nil)
+		_selectedIndexPath = [TUIFastIndexPath indexPathForRow:_selectedIndexPath.row + count inSection:section];
+	if(_indexPathShouldBeFirstResponder.section == section && _indexPathShouldBeFirstResponder != nil)
+		_indexPathShouldBeFirstResponder = [TUIFastIndexPath indexPathForRow:_indexPathShouldBeFirstResponder.row + count inSection:section];
+	
+	// the table is laid out bottom-up, so everything below the new rows keeps its
+	// position and the content offset can stay as it is.  only when the viewport is
+	// above the insertion point does it need to follow the content up.
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	CGPoint contentOffset = self.contentOffset;
+	if(anchor != TUIPackedIndexPathNotFound && TUIPackedIndexPathGetSection(anchor) < section)
+		contentOffset.y -= height;
+	self.contentOffset = contentOffset;
+	
+	[TUIView setAnimationsEnabled:NO block:^{
+		[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+			cell.frame = [self _rectForRow:indexPath];
+		}];
+	}];
+	
+	[self layoutSubviews];
+}
+
+- (TUIPackedIndexPath)_rowAfterUpdate:(TUIPackedIndexPath)indexPath deleting:(NSDictionary *)deleted inserting:(NSDictionary *)inserted
+{
+	if(indexPath == TUIPackedIndexPathNotFound)
+		return TUIPackedIndexPathNotFound;
+	NSUInteger section = TUIPackedIndexPathGetSection(indexPath);
+	NSNumber *key = [NSNumber numberWithInteger:section];
+	NSInteger row = TUITableViewRowAfterUpdate(TUIPackedIndexPathGetRow(indexPath), [deleted objectForKey:key], [inserted objectForKey:key]);
+	return (row != NSNotFound) ? TUIPackedIndexPathMake(section, row) : TUIPackedIndexPathNotFound;
+}
+
+- (TUIFastIndexPath *)_indexPathAfterUpdate:(TUIFastIndexPath *)indexPath deleting:(NSDictionary *)deleted inserting:(NSDictionary *)inserted
+{
+	if(indexPath == nil)
+		return nil;
+	TUIPackedIndexPath row = [self _rowAfterUpdate:indexPath.packedIndexPath deleting:deleted inserting:inserted];
+	return (row != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:row] : nil;
+}
+
+/**
+ * @brief Apply a batch of row updates without reloading the table
+ * 
+ * The row info of affected sections is patched in place and section offsets
+ * are recomputed.  Visible cells for untouched rows are kept and re-keyed to
+ * their new index paths; cells for deleted or reloaded rows are recycled and
+ * requested again by the following layout.  The distance from the top of the
+ * content to the top of the viewport is preserved, so rows above the changes
+ * stay put and rows below them move (optionally animated).
+ */
+- (void)_updateRowsDeleting:(NSDictionary *)deleted inserting:(NSDictionary *)inserted reloading:(NSDictionary *)reloaded animated:(BOOL)animated
+{
+	if(_sectionInfo == nil) {
+		// nothing has been laid out yet, the next layout will pick everything up
+		[self setNeedsLayout];
+		return;
+	}
+	
+	if(_tableFlags.calculatingSectionInfo) {
+		// the pending snapshot predates these changes, start over
+		[self reloadData];
+		return;
+	}
+	
+	// the updates must account for the data source's new row counts; if not, fall back
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger newNumberOfSections = (_tableFlags.dataSourceNumberOfSectionsInTableView) ? [_dataSource numberOfSectionsInTableView:self] : 1;
+	BOOL consistent = (newNumberOfSections == numberOfSections);
+	for(NSInteger s = 0; consistent && s < numberOfSections; ++s) {
+		NSNumber *key = [NSNumber numberWithInteger:s];
+		NSInteger expected = [[_sectionInfo objectAtIndex:s] numberOfRows] - [[deleted objectForKey:key] count] + [[inserted objectForKey:key] count];
+		consistent = (expected == [_dataSource tableView:self numberOfRowsInSection:s]);
+	}
+	if(!consistent) {
+		NSLog(@"!!! Warning: row updates don't match the data source, reloading the table instead");
+		[self reloadData];
+		return;
+	}
+	
+	CGFloat previousOffset = self.contentSize.height + self.contentOffset.y;
+	CGRect previousVisible = [self visibleRect];
+	
+	// note the visible cells while index paths still refer to the old rows
+	NSMutableData *previousRows = [NSMutableData dataWithCapacity:sizeof(TUIPackedIndexPath) * ([_visibleCells count] + 1)];
+	NSMutableArray *previousCells = [NSMutableArray arrayWithCapacity:[_visibleCells count]];
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+		[previousRows appendBytes:&indexPath length:sizeof(indexPath)];
+		[previousCells addObject:cell];
+	}];
+	
+	// patch the sections that changed and recompute section offsets
+	for(NSInteger s = 0; s < numberOfSections; ++s) {
+		NSNumber *key = [NSNumber numberWithInteger:s];
+		if([deleted objectForKey:key] || [inserted objectForKey:key] || [reloaded objectForKey:key]) {
+			TUITableViewSection *section = [_sectionInfo objectAtIndex:s];
+			[section _updateRowsDeleting:[deleted objectForKey:key] inserting:[inserted objectForKey:key] reloading:[reloaded objectForKey:key] estimated:_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath];
+		}
+	}
+	CGFloat offset = (numberOfSections > 0) ? [[_sectionInfo objectAtIndex:0] sectionOffset] : 0.0;
+	for(TUITableViewSection *section in _sectionInfo) {
+		section.sectionOffset = offset;
+		offset += [section sectionHeight];
+	}
+	_contentHeight = offset - self.contentInset.bottom;
+	_estimatedRowCursor = TUIPackedIndexPathMake(0, 0);
+	
+	// rebuild the visible window from the surviving cells, recycling deleted and reloaded
+	// rows.  survivors keep their order, but inserted rows may leave gaps between them
+	[_visibleCells removeAllObjects];
+	_firstVisibleRow = TUIPackedIndexPathNotFound;
+	_lastVisibleRow = TUIPackedIndexPathNotFound;
+	_detachedDragToReorderCell = nil;
+	_detachedDragToReorderRow = TUIPackedIndexPathNotFound;
+	const TUIPackedIndexPath *rows = [previousRows bytes];
+	for(NSUInteger i = 0; i < [previousCells count]; ++i) {
+		TUITableViewCell *cell = [previousCells objectAtIndex:i];
+		TUIPackedIndexPath newRow = [self _rowAfterUpdate:rows[i] deleting:deleted inserting:inserted];
+		if(newRow == TUIPackedIndexPathNotFound || [[reloaded objectForKey:[NSNumber numberWithInteger:TUIPackedIndexPathGetSection(rows[i])]] containsIndex:TUIPackedIndexPathGetRow(rows[i])]) {
+			if(cell == _dragToReorderCell)
+				_dragToReorderCell = nil;
+			[self _enqueueReusableCell:cell];
+			[cell removeFromSuperview];
+		} else {
+			if(_firstVisibleRow == TUIPackedIndexPathNotFound) {
+				_firstVisibleRow = newRow;
+				_lastVisibleRow = newRow;
+				[_visibleCells addObject:cell];
+			} else {
+				while(_lastVisibleRow < newRow) {
+					_lastVisibleRow = [self _rowAfterRow:_lastVisibleRow];
+					[_visibleCells addObject:[NSNull null]];
+				}
+				[_visibleCells replaceObjectAtIndex:[_visibleCells count] - 1 withObject:cell];
+			}
+			cell->_packedIndexPath = newRow;
+		}
+	}
+	_tableFlags.visibleCellsHaveGaps = 1;
+	
+	_selectedIndexPath = [self _indexPathAfterUpdate:_selectedIndexPath deleting:deleted inserting:inserted];
+	_indexPathShouldBeFirstResponder = [self _indexPathAfterUpdate:_indexPathShouldBeFirstResponder deleting:deleted inserting:inserted];
+	
+	// restore the scroll position
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	self.contentOffset = CGPointMake(self.contentOffset.x, previousOffset - self.contentSize.height);
+	CGFloat visibleShift = CGRectGetMinY([self visibleRect]) - CGRectGetMinY(previousVisible);
+	
+	if(animated) {
+		// keep cells where they were on screen so they slide from there
+		[TUIView setAnimationsEnabled:NO block:^{
+			[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+				CGRect frame = cell.frame;
+				frame.origin.y += visibleShift;
+				cell.frame = frame;
+			}];
+		}];
+		[TUIView beginAnimations:NSStringFromSelector(_cmd) context:NULL];
+	}
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+		cell.frame = [self _rectForRow:indexPath];
+		[cell setNeedsLayout];
+	}];
+	if(animated)
+		[TUIView commitAnimations];
+	
+	// add cells for newly visible rows and recycle any that moved offscreen
+	[self layoutSubviews];
+}
+
+/**
+ * @brief Obtain the reuse pool for an identifier, creating it if needed
+ */
+- (TUITableViewReusePool *)_reusePoolForIdentifier:(NSString *)identifier
+{
+	TUITableViewReusePool *pool = [_reusableTableCells objectForKey:identifier];
+	if(!pool) {
+		pool = [[TUITableViewReusePool alloc] init];
+		[_reusableTableCells setObject:pool forKey:identifier];
+	}
+	return pool;
+}
+
+- (NSUInteger)_maximumCountForReusePool:(TUITableViewReusePool *)pool
+{
+	return (pool->maximumCount > 0) ? pool->maximumCount : _maximumReusableCellCount;
+}
+
+- (NSUInteger)_prewarmCountForReusePool:(TUITableViewReusePool *)pool
+{
+	NSUInteger maximumCount = [self _maximumCountForReusePool:pool];
+	if(pool->factory == nil)
+		return 0;
+	return (maximumCount > 0) ? MIN(pool->prewarmCount, maximumCount) : pool->prewarmCount;
 }
 
 - (void)_enqueueReusableCell:(TUITableViewCell *)cell
@@ -299,12 +1322,13 @@ typedef struct {
 	if(!identifier)
 		return;
 	
-	NSMutableArray *array = [_reusableTableCells objectForKey:identifier];
-	if(!array) {
-		array = [[NSMutableArray alloc] init];
-		[_reusableTableCells setObject:array forKey:identifier];
+	TUITableViewReusePool *pool = [self _reusePoolForIdentifier:identifier];
+	NSUInteger maximumCount = [self _maximumCountForReusePool:pool];
+	if(maximumCount > 0 && [pool->cells count] >= maximumCount) {
+		pool->statistics.evictions++;
+		return;
 	}
-	[array addObject:cell];
+	[pool->cells addObject:cell];
 }
 
 - (TUITableViewCell *)dequeueReusableCellWithIdentifier:(NSString *)identifier
@@ -312,76 +1336,291 @@ typedef struct {
 	if(!identifier)
 		return nil;
 	
-	NSMutableArray *array = [_reusableTableCells objectForKey:identifier];
-	if(array) {
-		TUITableViewCell *c = [array lastObject];
-		if(c) {
-			[array removeLastObject];
-			[c prepareForReuse];
-			return c;
+	TUITableViewReusePool *pool = [self _reusePoolForIdentifier:identifier];
+	TUITableViewCell *c = [pool->cells lastObject];
+	if(c) {
+		pool->statistics.hits++;
+		[pool->cells removeLastObject];
+		[c prepareForReuse];
+		[self _scheduleReusePoolPrewarming];
+		return c;
+	}
+	
+	pool->statistics.misses++;
+	[self _scheduleReusePoolPrewarming];
+	return (pool->factory != nil) ? pool->factory() : nil;
+}
+
+- (NSUInteger)maximumReusableCellCount
+{
+	return _maximumReusableCellCount;
+}
+
+- (void)setMaximumReusableCellCount:(NSUInteger)count
+{
+	_maximumReusableCellCount = count;
+	for(TUITableViewReusePool *pool in [_reusableTableCells allValues]) {
+		NSUInteger maximumCount = [self _maximumCountForReusePool:pool];
+		while(maximumCount > 0 && [pool->cells count] > maximumCount) {
+			[pool->cells removeLastObject];
+			pool->statistics.evictions++;
+		}
+	}
+}
+
+- (void)setMaximumReusableCellCount:(NSUInteger)count forReuseIdentifier:(NSString *)identifier
+{
+	if(!identifier)
+		return;
+	
+	TUITableViewReusePool *pool = [self _reusePoolForIdentifier:identifier];
+	pool->maximumCount = count;
+	NSUInteger maximumCount = [self _maximumCountForReusePool:pool];
+	while(maximumCount > 0 && [pool->cells count] > maximumCount) {
+		[pool->cells removeLastObject];
+		pool->statistics.evictions++;
+	}
+}
+
+- (void)registerCellFactory:(TUITableViewCellFactory)factory prewarmCount:(NSUInteger)prewarmCount forReuseIdentifier:(NSString *)identifier
+{
+	if(!identifier)
+		return;
+	
+	TUITableViewReusePool *pool = [self _reusePoolForIdentifier:identifier];
+	pool->factory = [factory copy];
+	pool->prewarmCount = (factory != nil) ? prewarmCount : 0;
+	[self _scheduleReusePoolPrewarming];
+}
+
+- (TUITableViewReusePoolStatistics)reusePoolStatisticsForReuseIdentifier:(NSString *)identifier
+{
+	TUITableViewReusePoolStatistics statistics = {0, 0, 0, 0, 0};
+	for(NSString *key in _reusableTableCells) {
+		if(identifier != nil && ![identifier isEqualToString:key])
+			continue;
+		TUITableViewReusePool *pool = [_reusableTableCells objectForKey:key];
+		statistics.hits += pool->statistics.hits;
+		statistics.misses += pool->statistics.misses;
+		statistics.evictions += pool->statistics.evictions;
+		statistics.prewarmed += pool->statistics.prewarmed;
+		statistics.count += [pool->cells count];
+	}
+	return statistics;
+}
+
+/**
+ * @brief Schedule a prewarming pass for the next time the run loop is idle
+ * 
+ * Performing in the default mode only keeps prewarming out of scrolling and
+ * live resize, which run the loop in tracking modes.
+ */
+- (void)_scheduleReusePoolPrewarming
+{
+	if(_tableFlags.prewarmScheduled)
+		return;
+	
+	for(TUITableViewReusePool *pool in [_reusableTableCells allValues]) {
+		if([pool->cells count] < [self _prewarmCountForReusePool:pool]) {
+			_tableFlags.prewarmScheduled = 1;
+			[self performSelector:@selector(_prewarmReusePools) withObject:nil afterDelay:0.0 inModes:[NSArray arrayWithObject:NSDefaultRunLoopMode]];
+			return;
 		}
 	}
-	return nil;
 }
 
 /**
- * @brief Obtain the header view for the specified section
+ * @brief Create one cell for the first pool that's below its prewarm count
+ */
+- (void)_prewarmReusePools
+{
+	_tableFlags.prewarmScheduled = 0;
+	
+	for(NSString *identifier in [_reusableTableCells allKeys]) {
+		TUITableViewReusePool *pool = [_reusableTableCells objectForKey:identifier];
+		if([pool->cells count] < [self _prewarmCountForReusePool:pool]) {
+			TUITableViewCell *cell = pool->factory();
+			if(![cell.reuseIdentifier isEqualToString:identifier]) {
+				NSLog(@"!!! Warning: cell factory for reuse identifier %@ returned a cell with identifier %@", identifier, cell.reuseIdentifier);
+				pool->prewarmCount = 0;
+				continue;
+			}
+			pool->statistics.prewarmed++;
+			[self _enqueueReusableCell:cell];
+			break;
+		}
+	}
+	
+	[self _scheduleReusePoolPrewarming];
+}
+
+- (void)didReceiveMemoryWarning
+{
+	for(TUITableViewReusePool *pool in [_reusableTableCells allValues]) {
+		while([pool->cells count] > [self _prewarmCountForReusePool:pool]) {
+			[pool->cells removeLastObject];
+			pool->statistics.evictions++;
+		}
+		for(TUITableViewCell *cell in pool->cells)
+			TUITableViewReleaseBackingStores(cell);
+	}
+	// the bitmaps just released are idle in the pool, free them for real
+	TUIBackingStorePurgePool();
+}
+
+/**
+ * @brief Obtain the header view for the specified section
+ * 
+ * If the section has no header, nil is returned.
+ * 
+ * @param section the section
+ * @return section header
+ */
+- (TUIView *)headerViewForSection:(NSInteger)section {
+  if(section >= 0 && section < [_sectionInfo count]){
+    return [(TUITableViewSection *)[_sectionInfo objectAtIndex:section] headerView];
+  }else{
+    return nil;
+  }
+}
+
+/**
+ * @brief Obtain the row after @p indexPath, skipping empty sections
+ * @return the next row or TUIPackedIndexPathNotFound if @p indexPath is the last row
+ */
+- (TUIPackedIndexPath)_rowAfterRow:(TUIPackedIndexPath)indexPath
+{
+	if(indexPath == TUIPackedIndexPathNotFound)
+		return TUIPackedIndexPathNotFound;
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger section = TUIPackedIndexPathGetSection(indexPath);
+	NSInteger row = TUIPackedIndexPathGetRow(indexPath) + 1;
+	while(section < numberOfSections && row >= [[_sectionInfo objectAtIndex:section] numberOfRows]) {
+		++section;
+		row = 0;
+	}
+	return (section < numberOfSections) ? TUIPackedIndexPathMake(section, row) : TUIPackedIndexPathNotFound;
+}
+
+/**
+ * @brief Obtain the row before @p indexPath, skipping empty sections
+ * @return the previous row or TUIPackedIndexPathNotFound if @p indexPath is the first row
+ */
+- (TUIPackedIndexPath)_rowBeforeRow:(TUIPackedIndexPath)indexPath
+{
+	if(indexPath == TUIPackedIndexPathNotFound)
+		return TUIPackedIndexPathNotFound;
+	NSInteger section = TUIPackedIndexPathGetSection(indexPath);
+	NSInteger row = (NSInteger)TUIPackedIndexPathGetRow(indexPath) - 1;
+	while(row < 0 && --section >= 0) {
+		row = [[_sectionInfo objectAtIndex:section] numberOfRows] - 1;
+	}
+	return (section >= 0) ? TUIPackedIndexPathMake(section, row) : TUIPackedIndexPathNotFound;
+}
+
+/**
+ * @brief Obtain the slot in the visible window for a row
  * 
- * If the section has no header, nil is returned.
+ * Visible rows are always one contiguous range, so visible cells are kept in a
+ * window: an array with one slot per row from _firstVisibleRow to _lastVisibleRow.
+ * Slots hold a cell, or NSNull for rows in the range which don't have one (zero
+ * height rows, or rows inserted by an update that haven't been laid out yet).
+ * The window's bounds are packed index paths, so keeping it up to date while
+ * scrolling doesn't allocate; index path objects are only made for the public API.
  * 
- * @param section the section
- * @return section header
+ * @return the slot or NSNotFound if @p indexPath is outside the window
  */
-- (TUIView *)headerViewForSection:(NSInteger)section {
-  if(section >= 0 && section < [_sectionInfo count]){
-    return [(TUITableViewSection *)[_sectionInfo objectAtIndex:section] headerView];
-  }else{
-    return nil;
-  }
+- (NSInteger)_visibleSlotForRow:(TUIPackedIndexPath)indexPath
+{
+	if(indexPath == TUIPackedIndexPathNotFound || _firstVisibleRow == TUIPackedIndexPathNotFound)
+		return NSNotFound;
+	if(indexPath < _firstVisibleRow || indexPath > _lastVisibleRow)
+		return NSNotFound;
+	
+	NSInteger slot = (NSInteger)TUIPackedIndexPathGetRow(indexPath) - (NSInteger)TUIPackedIndexPathGetRow(_firstVisibleRow);
+	for(NSInteger section = TUIPackedIndexPathGetSection(_firstVisibleRow); section < TUIPackedIndexPathGetSection(indexPath); ++section)
+		slot += [[_sectionInfo objectAtIndex:section] numberOfRows];
+	return (slot >= 0 && slot < [_visibleCells count]) ? slot : NSNotFound;
 }
 
-- (TUITableViewCell *)cellForRowAtIndexPath:(TUIFastIndexPath *)indexPath // returns nil if cell is not visible or index path is out of range
+/**
+ * @brief Enumerate visible cells top to bottom along with their rows
+ * 
+ * A dragged cell which has scrolled out of the window is included last.
+ */
+- (void)_enumerateVisibleCellsUsingBlock:(void (^)(TUITableViewCell *cell, TUIPackedIndexPath indexPath))block
 {
-	return [_visibleItems objectForKey:indexPath];
+	TUIPackedIndexPath indexPath = _firstVisibleRow;
+	for(id cell in _visibleCells) {
+		if(cell != [NSNull null])
+			block(cell, indexPath);
+		indexPath = [self _rowAfterRow:indexPath];
+	}
+	if(_detachedDragToReorderRow != TUIPackedIndexPathNotFound)
+		block(_detachedDragToReorderCell, _detachedDragToReorderRow);
 }
 
-- (NSArray *)visibleCells
+- (TUITableViewCell *)cellForRowAtIndexPath:(TUIFastIndexPath *)indexPath // returns nil if cell is not visible or index path is out of range
 {
-	return [_visibleItems allValues];
+	if(indexPath == nil)
+		return nil;
+	TUIPackedIndexPath row = indexPath.packedIndexPath;
+	NSInteger slot = [self _visibleSlotForRow:row];
+	if(slot != NSNotFound) {
+		id cell = [_visibleCells objectAtIndex:slot];
+		return (cell != [NSNull null]) ? cell : nil;
+	}
+	if(_detachedDragToReorderRow != TUIPackedIndexPathNotFound && row == _detachedDragToReorderRow)
+		return _detachedDragToReorderCell;
+	return nil;
 }
 
-static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
+- (NSArray *)visibleCells
 {
-	if(a.frame.origin.y > b.frame.origin.y)
-		return NSOrderedAscending;
-	return NSOrderedDescending;
+	return [self sortedVisibleCells];
 }
 
 - (NSArray *)sortedVisibleCells
 {
-	NSArray *v = [self visibleCells];
-	return [v sortedArrayUsingComparator:(NSComparator)^NSComparisonResult(TUITableViewCell *a, TUITableViewCell *b) {
-		if(a.frame.origin.y > b.frame.origin.y)
-			return NSOrderedAscending;
-		return NSOrderedDescending;
+	NSMutableArray *cells = [NSMutableArray arrayWithCapacity:[_visibleCells count]];
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+		[cells addObject:cell];
 	}];
+	return cells;
 }
 
-#define INDEX_PATHS_FOR_VISIBLE_ROWS [_visibleItems allKeys]
-
 - (NSArray *)indexPathsForVisibleRows
 {
-	return INDEX_PATHS_FOR_VISIBLE_ROWS;
+	NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:[_visibleCells count]];
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+		[indexPaths addObject:[TUIFastIndexPath indexPathWithPackedIndexPath:indexPath]];
+	}];
+	return indexPaths;
 }
 
 - (TUIFastIndexPath *)indexPathForCell:(TUITableViewCell *)c
 {
-	for(TUIFastIndexPath *i in _visibleItems) {
-		TUITableViewCell *cell = [_visibleItems objectForKey:i];
-		if(cell == c)
-			return i;
-	}
-	return nil;
+	if(c == nil)
+		return nil;
+	if(c == _detachedDragToReorderCell)
+		return (_detachedDragToReorderRow != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:_detachedDragToReorderRow] : nil;
+	
+	// the cell carries its row; a cell that has been recycled (or belongs to another table) won't be in that slot
+	TUIPackedIndexPath row = c->_packedIndexPath;
+	NSInteger slot = [self _visibleSlotForRow:row];
+	if(slot == NSNotFound || [_visibleCells objectAtIndex:slot] != c)
+		return nil;
+	return [TUIFastIndexPath indexPathWithPackedIndexPath:row];
+}
+
+/**
+ * @brief Tell visible cells their rows again after the window has been renumbered
+ */
+- (void)_updateVisibleCellIndexPaths
+{
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
+		cell->_packedIndexPath = indexPath;
+	}];
 }
 
 /**
@@ -422,23 +1661,258 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 	return indexes;
 }
 
-- (NSArray *)indexPathsForRowsInRect:(CGRect)rect
+/**
+ * @brief Obtain the first index path whose row extends to or past a content offset
+ * 
+ * Offsets are measured from the top of the content, the same way section and
+ * row offsets are stored.  Sections and then rows are located by binary search,
+ * so this is O(log n) in the number of rows rather than a walk of the table.
+ * 
+ * @param offset offset from the top of the content
+ * @return the first such row or TUIPackedIndexPathNotFound if no row ends at or past @p offset
+ */
+- (TUIPackedIndexPath)_firstRowEndingAtOrAfterContentOffset:(CGFloat)offset
 {
-	NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:50];
-	NSInteger sectionIndex = 0;
-	for(TUITableViewSection *section in _sectionInfo) {
-		NSInteger numberOfRows = [section numberOfRows];
-		for(NSInteger row = 0; row < numberOfRows; ++row) {
-			TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:row inSection:sectionIndex];
-			CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-			if(CGRectIntersectsRect(cellRect, rect)) {
-				[indexPaths addObject:indexPath];
-			} else {
-				// not visible
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger low = 0;
+	NSInteger high = numberOfSections;
+	while(low < high) {
+		NSInteger mid = low + (high - low) / 2;
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:mid];
+		if([section sectionOffset] + [section sectionHeight] < offset) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	
+	// empty sections (or the tail of a header-only section) fall through to the next one
+	for(NSInteger sectionIndex = low; sectionIndex < numberOfSections; ++sectionIndex) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:sectionIndex];
+		NSInteger row = [section indexOfFirstRowEndingAtOrAfterOffset:offset - [section sectionOffset]];
+		if(row < [section numberOfRows]) {
+			return TUIPackedIndexPathMake(sectionIndex, row);
+		}
+	}
+	
+	return TUIPackedIndexPathNotFound;
+}
+
+/**
+ * @brief Enumerate the rows which may lie within a vertical span
+ * 
+ * The block is invoked, in order, for every row which ends at or below @p top and
+ * begins at or above @p bottom (both measured from the top of the content).  Callers
+ * do the exact geometry test, this only narrows the candidates.
+ */
+- (void)_enumerateRowsBetweenContentOffset:(CGFloat)top andContentOffset:(CGFloat)bottom usingBlock:(void (^)(TUIPackedIndexPath indexPath, BOOL *stop))block
+{
+	TUIPackedIndexPath first = [self _firstRowEndingAtOrAfterContentOffset:top];
+	if(first == TUIPackedIndexPathNotFound) return;
+	
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger row = TUIPackedIndexPathGetRow(first);
+	for(NSInteger s = TUIPackedIndexPathGetSection(first); s < numberOfSections; ++s, row = 0) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:s];
+		for(NSInteger rowCount = [section numberOfRows]; row < rowCount; ++row) {
+			if([section tableRowOffset:row] > bottom)
+				return;
+			BOOL stop = NO;
+			block(TUIPackedIndexPathMake(s, row), &stop);
+			if(stop) return;
+		}
+	}
+}
+
+/**
+ * @brief Measure estimated rows in and around the visible rect
+ * 
+ * Only rows within a screenful of the viewport are measured.  Corrections are
+ * folded into each section's row height tree and the offsets of the sections
+ * that follow it, and the content offset is adjusted so the top visible row
+ * stays where it is on screen.
+ * 
+ * @return YES if any row height changed and visible cells need to be relaid out
+ */
+- (BOOL)_measureEstimatedRowsNearVisibleRect
+{
+	BOOL changed = NO;
+	if(_tableFlags.calculatingSectionInfo)
+		return changed; // rows laid out don't match the data source any more
+	
+	// measuring can pull more rows into range, so repeat until nothing is left to measure
+	for(;;) {
+		CGRect visible = [self visibleRect];
+		CGFloat margin = visible.size.height;
+		CGFloat top = _contentHeight - CGRectGetMaxY(visible);
+		CGFloat bottom = _contentHeight - CGRectGetMinY(visible);
+		
+		NSMutableData *unmeasured = [NSMutableData data];
+		[self _enumerateRowsBetweenContentOffset:top - margin andContentOffset:bottom + margin usingBlock:^(TUIPackedIndexPath indexPath, BOOL *stop) {
+			if([[_sectionInfo objectAtIndex:TUIPackedIndexPathGetSection(indexPath)] rowHeightIsEstimated:TUIPackedIndexPathGetRow(indexPath)])
+				[unmeasured appendBytes:&indexPath length:sizeof(indexPath)];
+		}];
+		NSUInteger count = [unmeasured length] / sizeof(TUIPackedIndexPath);
+		if(count == 0)
+			break;
+		
+		changed = [self _measureRows:[unmeasured bytes] count:count] || changed;
+	}
+	
+	return changed;
+}
+
+/**
+ * @brief Measure the real heights of rows whose heights are estimated
+ * 
+ * Section offsets and the content size are updated and the top visible row
+ * is kept in place.
+ * 
+ * @return YES if any row height changed
+ */
+- (BOOL)_measureRows:(const TUIPackedIndexPath *)rows count:(NSUInteger)count
+{
+	CGRect visible = [self visibleRect];
+	TUIPackedIndexPath anchor = [self _firstRowEndingAtOrAfterContentOffset:_contentHeight - CGRectGetMaxY(visible)];
+	
+	NSInteger firstChangedSection = NSNotFound;
+	CGFloat totalDelta = 0.0;
+	CGFloat anchorDelta = 0.0;
+	for(NSUInteger i = 0; i < count; ++i) {
+		NSInteger section = TUIPackedIndexPathGetSection(rows[i]);
+		CGFloat delta = [[_sectionInfo objectAtIndex:section] measureHeightForRow:TUIPackedIndexPathGetRow(rows[i])];
+		if(delta != 0.0) {
+			firstChangedSection = MIN(firstChangedSection, section);
+			totalDelta += delta;
+			// the table is laid out bottom-up: a correction moves the rows above it
+			// and leaves the rows below it in place
+			if(anchor != TUIPackedIndexPathNotFound && rows[i] >= anchor)
+				anchorDelta += delta;
+		}
+	}
+	if(firstChangedSection == NSNotFound)
+		return NO;
+	
+	CGFloat offset = [[_sectionInfo objectAtIndex:firstChangedSection] sectionOffset];
+	for(NSInteger i = firstChangedSection; i < [_sectionInfo count]; ++i) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:i];
+		section.sectionOffset = offset;
+		offset += [section sectionHeight];
+	}
+	_contentHeight += totalDelta;
+	
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	if(anchorDelta != 0.0) {
+		CGPoint contentOffset = self.contentOffset;
+		self.contentOffset = CGPointMake(contentOffset.x, contentOffset.y - anchorDelta);
+	}
+	
+	return YES;
+}
+
+/**
+ * @brief Collect rows whose heights are still estimated
+ * 
+ * Picks up where the last call left off, so measuring every row in chunks is
+ * one pass over the table.  The caller has to measure the rows returned; the
+ * cursor goes back to the start whenever rows are laid out again.
+ * 
+ * @param rows filled in with up to @p limit rows
+ * @return the number of rows collected, 0 once every row has been measured
+ */
+- (NSUInteger)_getEstimatedRows:(TUIPackedIndexPath *)rows limit:(NSUInteger)limit
+{
+	NSUInteger count = 0;
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger row = TUIPackedIndexPathGetRow(_estimatedRowCursor);
+	for(NSInteger s = TUIPackedIndexPathGetSection(_estimatedRowCursor); s < numberOfSections; ++s, row = 0) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:s];
+		while((row = [section indexOfFirstEstimatedRowAtOrAfterRow:row]) != NSNotFound) {
+			rows[count++] = TUIPackedIndexPathMake(s, row);
+			++row;
+			if(count >= limit) {
+				_estimatedRowCursor = TUIPackedIndexPathMake(s, row);
+				return count;
 			}
 		}
-		++sectionIndex;
 	}
+	_estimatedRowCursor = TUIPackedIndexPathMake(numberOfSections, 0);
+	return count;
+}
+
+#define TUI_PROVISIONAL_MEASURE_CHUNK_SIZE 16
+#define TUI_PROVISIONAL_MEASURE_TIME_SLICE 0.004
+
+- (void)_scheduleProvisionalRowMeasurement
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_measureProvisionalRows) object:nil];
+	// common modes, so this also runs while the live resize is tracking
+	[self performSelector:@selector(_measureProvisionalRows) withObject:nil afterDelay:0.0 inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+}
+
+/**
+ * @brief Measure rows left with provisional heights, for a short time slice
+ */
+- (void)_measureProvisionalRows
+{
+	if(!_tableFlags.hasProvisionalRowHeights || _sectionInfo == nil || _tableFlags.calculatingSectionInfo)
+		return;
+	
+	BOOL changed = NO;
+	BOOL done = NO;
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	TUIPackedIndexPath rows[TUI_PROVISIONAL_MEASURE_CHUNK_SIZE];
+	while(CFAbsoluteTimeGetCurrent() - start < TUI_PROVISIONAL_MEASURE_TIME_SLICE) {
+		NSUInteger count = [self _getEstimatedRows:rows limit:TUI_PROVISIONAL_MEASURE_CHUNK_SIZE];
+		if(count == 0) {
+			done = YES;
+			break;
+		}
+		changed = [self _measureRows:rows count:count] || changed;
+	}
+	
+	if(done)
+		_tableFlags.hasProvisionalRowHeights = 0;
+	else
+		[self _scheduleProvisionalRowMeasurement];
+	if(changed)
+		[self setNeedsLayout];
+}
+
+- (void)viewDidEndLiveResize
+{
+	[super viewDidEndLiveResize];
+	
+	// reconcile: cache what was measured at the final width, then measure whatever
+	// is still provisional (from the cache where possible), keeping the top row in place
+	if(_tableFlags.hasProvisionalRowHeights && _sectionInfo != nil) {
+		[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_measureProvisionalRows) object:nil];
+		[_sectionInfo makeObjectsPerformSelector:@selector(_endProvisionalHeights)];
+		_estimatedRowCursor = TUIPackedIndexPathMake(0, 0);
+		BOOL changed = NO;
+		TUIPackedIndexPath rows[TUI_PROVISIONAL_MEASURE_CHUNK_SIZE];
+		NSUInteger count;
+		while((count = [self _getEstimatedRows:rows limit:TUI_PROVISIONAL_MEASURE_CHUNK_SIZE]) > 0)
+			changed = [self _measureRows:rows count:count] || changed;
+		if(changed)
+			[self setNeedsLayout];
+	}
+	_tableFlags.hasProvisionalRowHeights = 0;
+}
+
+- (NSArray *)indexPathsForRowsInRect:(CGRect)rect
+{
+	NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:50];
+	CGFloat top = _contentHeight - CGRectGetMaxY(rect);
+	CGFloat bottom = _contentHeight - CGRectGetMinY(rect);
+	[self _enumerateRowsBetweenContentOffset:top andContentOffset:bottom usingBlock:^(TUIPackedIndexPath indexPath, BOOL *stop) {
+		CGRect cellRect = [self _rectForRow:indexPath];
+		if(CGRectIntersectsRect(cellRect, rect)) {
+			[indexPaths addObject:[TUIFastIndexPath indexPathWithPackedIndexPath:indexPath]];
+		} else {
+			// not visible
+		}
+	}];
 	return indexPaths;
 }
 
@@ -452,20 +1926,18 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
  * @return index path of the row at @p point
  */
 - (TUIFastIndexPath *)indexPathForRowAtPoint:(CGPoint)point {
-  
-	NSInteger sectionIndex = 0;
-  for(TUITableViewSection *section in _sectionInfo){
-    for(NSInteger row = 0; row < [section numberOfRows]; row++){
-      TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:row inSection:sectionIndex];
-      CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-      if(CGRectContainsPoint(cellRect, point)){
-        return indexPath;
-      }
-    }
-		++sectionIndex;
-  }
 	
-	return nil;
+	__block TUIPackedIndexPath result = TUIPackedIndexPathNotFound;
+	CGFloat offset = _contentHeight - point.y;
+	[self _enumerateRowsBetweenContentOffset:offset andContentOffset:offset usingBlock:^(TUIPackedIndexPath indexPath, BOOL *stop) {
+		CGRect cellRect = [self _rectForRow:indexPath];
+		if(CGRectContainsPoint(cellRect, point)){
+			result = indexPath;
+			*stop = YES;
+		}
+	}];
+	
+	return (result != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:result] : nil;
 }
 
 /**
@@ -478,20 +1950,18 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
  * @return index path of the row at @p offset
  */
 - (TUIFastIndexPath *)indexPathForRowAtVerticalOffset:(CGFloat)offset {
-  
-	NSInteger sectionIndex = 0;
-  for(TUITableViewSection *section in _sectionInfo){
-    for(NSInteger row = 0; row < [section numberOfRows]; row++){
-      TUIFastIndexPath *indexPath = [TUIFastIndexPath indexPathForRow:row inSection:sectionIndex];
-      CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-      if(offset >= cellRect.origin.y && offset <= (cellRect.origin.y + cellRect.size.height)){
-        return indexPath;
-      }
-    }
-		++sectionIndex;
-  }
 	
-	return nil;
+	__block TUIPackedIndexPath result = TUIPackedIndexPathNotFound;
+	CGFloat contentOffset = _contentHeight - offset;
+	[self _enumerateRowsBetweenContentOffset:contentOffset andContentOffset:contentOffset usingBlock:^(TUIPackedIndexPath indexPath, BOOL *stop) {
+		CGRect cellRect = [self _rectForRow:indexPath];
+		if(offset >= cellRect.origin.y && offset <= (cellRect.origin.y + cellRect.size.height)){
+			result = indexPath;
+			*stop = YES;
+		}
+	}];
+	
+	return (result != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:result] : nil;
 }
 
 /**
@@ -601,11 +2071,7 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 
 - (TUIFastIndexPath *)_topVisibleIndexPath
 {
-	TUIFastIndexPath *topVisibleIndex = nil;
-	NSArray *v = [INDEX_PATHS_FOR_VISIBLE_ROWS sortedArrayUsingSelector:@selector(compare:)];
-	if([v count])
-		topVisibleIndex = [v objectAtIndex:0];
-	return topVisibleIndex;
+	return [self indexPathForFirstVisibleRow];
 }
 
 - (void)setFrame:(CGRect)f
@@ -662,9 +2128,8 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 		} else {
 			if(_tableFlags.forceSaveScrollPosition || [self.nsView inLiveResize]) {
 				_tableFlags.forceSaveScrollPosition = 0;
-				NSArray *a = [INDEX_PATHS_FOR_VISIBLE_ROWS sortedArrayUsingSelector:@selector(compare:)];
-				if([a count]) {
-					savedIndexPath = [a objectAtIndex:0];
+				savedIndexPath = [self _topVisibleIndexPath];
+				if(savedIndexPath != nil) {
 					CGRect v = [self visibleRect];
 					CGRect r = [self rectForRowAtIndexPath:savedIndexPath];
 					relativeOffset = ((v.origin.y + v.size.height) - (r.origin.y + r.size.height));
@@ -783,87 +2248,184 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 	
 }
 
+/**
+ * @brief Return a visible cell to the reuse queue
+ */
+- (void)_recycleVisibleCell:(id)cell atRow:(TUIPackedIndexPath)indexPath
+{
+	if(cell == [NSNull null])
+		return;
+	
+	if(cell == _dragToReorderCell) {
+		// don't reuse the dragged cell; hang on to it outside the window
+		_detachedDragToReorderCell = cell;
+		_detachedDragToReorderRow = indexPath;
+	} else {
+		[self _enqueueReusableCell:cell];
+		[cell removeFromSuperview];
+	}
+}
+
+/**
+ * @brief Obtain a cell from the data source and bring it onscreen
+ * 
+ * @return the cell or NSNull if the row doesn't intersect @p visible
+ */
+- (id)_displayCellForRow:(TUIPackedIndexPath)row visibleRect:(CGRect)visible
+{
+	CGRect frame = [self _rectForRow:row];
+	if(!CGRectIntersectsRect(frame, visible))
+		return [NSNull null];
+	
+	if(_detachedDragToReorderRow != TUIPackedIndexPathNotFound && row == _detachedDragToReorderRow) {
+		// the dragged cell is back in range
+		TUITableViewCell *cell = _detachedDragToReorderCell;
+		_detachedDragToReorderCell = nil;
+		_detachedDragToReorderRow = TUIPackedIndexPathNotFound;
+		return cell;
+	}
+	
+	// the data source and delegate get an object, nothing else on the way here needs one
+	TUIFastIndexPath *i = [TUIFastIndexPath indexPathWithPackedIndexPath:row];
+	TUITableViewCell *cell = [_dataSource tableView:self cellForRowAtIndexPath:i];
+	cell->_packedIndexPath = row;
+	[self.nsView invalidateHoverForView:cell];
+	
+	cell.frame = frame;
+	cell.layer.zPosition = 0;
+	
+	[cell setNeedsLayout];
+	[cell prepareForDisplay];
+	
+	if(_selectedIndexPath != nil && _selectedIndexPath.packedIndexPath == row) {
+		[cell setSelected:YES animated:NO];
+	} else {
+		[cell setSelected:NO animated:NO];
+	}
+	
+	if(_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath) {
+		[_delegate tableView:self willDisplayCell:cell forRowAtIndexPath:i];
+	}
+	
+	[self addSubview:cell];
+	
+	if(_indexPathShouldBeFirstResponder != nil && _indexPathShouldBeFirstResponder.packedIndexPath == row) {
+	  // only make cells first responder if they accept it
+	  if([cell acceptsFirstResponder]){
+	    [self.nsWindow makeFirstResponderIfNotAlreadyInResponderChain:cell withFutureRequestToken:_futureMakeFirstResponderToken];
+	  }
+		_indexPathShouldBeFirstResponder = nil;
+	}
+	
+	return cell;
+}
+
 - (void)_layoutCells:(BOOL)visibleCellsNeedRelayout
 {
-  
 	if(visibleCellsNeedRelayout) {
 		// update remaining visible cells if needed
-		for(TUIFastIndexPath *i in _visibleItems) {
-			TUITableViewCell *cell = [_visibleItems objectForKey:i];
-			cell.frame = [self rectForRowAtIndexPath:i];
+		[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath i) {
+			cell.frame = [self _rectForRow:i];
 			cell.layer.zPosition = 0;
 			[cell setNeedsLayout];
-		}
+		}];
+	}
+	
+	if(_tableFlags.calculatingSectionInfo) {
+		// the data source has moved on from the rows laid out, so its index paths
+		// may not be valid any more; keep showing the cells already out (placed by
+		// the current section info) and ask for new ones once the new layout is in
+		return;
+	}
+	
+	if(_detachedDragToReorderCell != nil && _detachedDragToReorderCell != _dragToReorderCell) {
+		// the drag ended while the cell was out of the window
+		[self _enqueueReusableCell:_detachedDragToReorderCell];
+		[_detachedDragToReorderCell removeFromSuperview];
+		_detachedDragToReorderCell = nil;
+		_detachedDragToReorderRow = TUIPackedIndexPathNotFound;
 	}
 	
 	CGRect visible = [self visibleRect];
 	
+	// Visible rows are one contiguous range, so the window only changes at its ends.
 	// Example:
 	// old:            0 1 2 3 4 5 6 7
 	// new:                2 3 4 5 6 7 8 9
 	// to remove:      0 1
 	// to add:                         8 9
 	
-	NSArray *oldVisibleIndexPaths = INDEX_PATHS_FOR_VISIBLE_ROWS;
-	NSArray *newVisibleIndexPaths = [self indexPathsForRowsInRect:visible];
-	
-	NSMutableArray *indexPathsToRemove = [oldVisibleIndexPaths mutableCopy];
-	[indexPathsToRemove removeObjectsInArray:newVisibleIndexPaths];
+	__block TUIPackedIndexPath first = TUIPackedIndexPathNotFound;
+	__block TUIPackedIndexPath last = TUIPackedIndexPathNotFound;
+	[self _enumerateRowsBetweenContentOffset:_contentHeight - CGRectGetMaxY(visible) andContentOffset:_contentHeight - CGRectGetMinY(visible) usingBlock:^(TUIPackedIndexPath indexPath, BOOL *stop) {
+		if(CGRectIntersectsRect([self _rectForRow:indexPath], visible)) {
+			if(first == TUIPackedIndexPathNotFound) first = indexPath;
+			last = indexPath;
+		}
+	}];
 	
-	NSMutableArray *indexPathsToAdd = [newVisibleIndexPaths mutableCopy];
-	[indexPathsToAdd removeObjectsInArray:oldVisibleIndexPaths];
+	NSUInteger numberOfCellsAdded = 0;
 	
-	// remove offscreen cells
-	for(TUIFastIndexPath *i in indexPathsToRemove) {
-		TUITableViewCell *cell = [self cellForRowAtIndexPath:i];
-		// don't reuse the dragged cell
-		if(_dragToReorderCell == nil || ![cell isEqual:_dragToReorderCell]){
-      [self _enqueueReusableCell:cell];
-      [cell removeFromSuperview];
-      [_visibleItems removeObjectForKey:i];
-    }
+	if(first == TUIPackedIndexPathNotFound || _firstVisibleRow == TUIPackedIndexPathNotFound || _lastVisibleRow < first || _firstVisibleRow > last) {
+		// no overlap with the current window (a jump), start over
+		TUIPackedIndexPath indexPath = _firstVisibleRow;
+		for(id cell in _visibleCells) {
+			[self _recycleVisibleCell:cell atRow:indexPath];
+			indexPath = [self _rowAfterRow:indexPath];
+		}
+		[_visibleCells removeAllObjects];
+		_firstVisibleRow = first;
+		_lastVisibleRow = first;
+		if(first != TUIPackedIndexPathNotFound) {
+			[_visibleCells addObject:[self _displayCellForRow:first visibleRect:visible]];
+			++numberOfCellsAdded;
+		}
 	}
 	
-	// add new cells
-	for(TUIFastIndexPath *i in indexPathsToAdd) {
-		if([_visibleItems objectForKey:i]) {
-			NSLog(@"!!! Warning: already have a cell in place for index path %@\n\n\n", i);
-		} else {
-			TUITableViewCell *cell = [_dataSource tableView:self cellForRowAtIndexPath:i];
-			[self.nsView invalidateHoverForView:cell];
-			
-			cell.frame = [self rectForRowAtIndexPath:i];
-			cell.layer.zPosition = 0;
-			
-			[cell setNeedsLayout];
-			[cell prepareForDisplay];
-			
-			if([i isEqual:_selectedIndexPath]) {
-				[cell setSelected:YES animated:NO];
-			} else {
-				[cell setSelected:NO animated:NO];
-			}
-			
-			if(_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath) {
-				[_delegate tableView:self willDisplayCell:cell forRowAtIndexPath:i];
-			}
-			
-			[self addSubview:cell];
-			
-			if([_indexPathShouldBeFirstResponder isEqual:i]) {
-			  // only make cells first responder if they accept it
-			  if([cell acceptsFirstResponder]){
-			    [self.nsWindow makeFirstResponderIfNotAlreadyInResponderChain:cell withFutureRequestToken:_futureMakeFirstResponderToken];
-			  }
-				_indexPathShouldBeFirstResponder = nil;
+	if(first != TUIPackedIndexPathNotFound) {
+		// remove offscreen cells
+		while(_firstVisibleRow < first) {
+			[self _recycleVisibleCell:[_visibleCells objectAtIndex:0] atRow:_firstVisibleRow];
+			[_visibleCells removeObjectAtIndex:0];
+			_firstVisibleRow = [self _rowAfterRow:_firstVisibleRow];
+		}
+		while(_lastVisibleRow > last) {
+			[self _recycleVisibleCell:[_visibleCells lastObject] atRow:_lastVisibleRow];
+			[_visibleCells removeLastObject];
+			_lastVisibleRow = [self _rowBeforeRow:_lastVisibleRow];
+		}
+		
+		// fill slots left empty by updates or geometry changes
+		if(visibleCellsNeedRelayout || _tableFlags.visibleCellsHaveGaps) {
+			TUIPackedIndexPath indexPath = _firstVisibleRow;
+			for(NSUInteger slot = 0; slot < [_visibleCells count]; ++slot) {
+				if([_visibleCells objectAtIndex:slot] == [NSNull null]) {
+					id cell = [self _displayCellForRow:indexPath visibleRect:visible];
+					if(cell != [NSNull null]) {
+						[_visibleCells replaceObjectAtIndex:slot withObject:cell];
+						++numberOfCellsAdded;
+					}
+				}
+				indexPath = [self _rowAfterRow:indexPath];
 			}
-			
-			[_visibleItems setObject:cell forKey:i];
+			_tableFlags.visibleCellsHaveGaps = 0;
+		}
+		
+		// add new cells (NSMutableArray is a deque, so inserting at the front is cheap)
+		while(_firstVisibleRow > first) {
+			_firstVisibleRow = [self _rowBeforeRow:_firstVisibleRow];
+			[_visibleCells insertObject:[self _displayCellForRow:_firstVisibleRow visibleRect:visible] atIndex:0];
+			++numberOfCellsAdded;
+		}
+		while(_lastVisibleRow < last) {
+			_lastVisibleRow = [self _rowAfterRow:_lastVisibleRow];
+			[_visibleCells addObject:[self _displayCellForRow:_lastVisibleRow visibleRect:visible]];
+			++numberOfCellsAdded;
 		}
 	}
 	
   // if we have a dragged cell, make sure it's on top of the newly added cells
-  if([indexPathsToAdd count] > 0 && _dragToReorderCell != nil){
+  if(numberOfCellsAdded > 0 && _dragToReorderCell != nil){
     [[_dragToReorderCell superview] bringSubviewToFront:_dragToReorderCell];
   }
   
@@ -922,27 +2484,102 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 
 - (void)reloadData
 {
+	++_reloadGeneration;
+	_tableFlags.calculatingSectionInfo = 0;
   
   // notify our delegate we're about to reload the table
   if(self.delegate != nil && [self.delegate respondsToSelector:@selector(tableViewWillReloadData:)]){
     [self.delegate tableViewWillReloadData:self];
   }
 	
+	// keep serving the current layout while heights are calculated in the background
+	if(_sectionInfo != nil && [self.delegate respondsToSelector:@selector(tableViewCanCalculateRowHeightsConcurrently:)] && [self.delegate tableViewCanCalculateRowHeightsConcurrently:self]) {
+		_tableFlags.calculatingSectionInfo = 1;
+		[self _calculateSectionInfoConcurrentlyForReload:_reloadGeneration];
+		return;
+	}
+	
+	[self _finishReloadData];
+}
+
+/**
+ * @brief Calculate new section info off the main thread
+ * 
+ * Sections, row counts, headers and row identifiers come from the data source on
+ * the main thread.  Row heights are then calculated for all sections in parallel
+ * (only the delegate's height callbacks run in the background), and the finished
+ * snapshot is handed back to the main thread to be swapped in by the reload.
+ * Until then the current section info keeps serving scrolling and the visible
+ * cells stay where they are, but no new ones are requested, see #_layoutCells:.  A
+ * snapshot is dropped if a newer reload started in the meantime, and ignored
+ * (heights are recalculated synchronously) if the table was resized.
+ */
+- (void)_calculateSectionInfoConcurrentlyForReload:(NSUInteger)generation
+{
+	NSInteger numberOfSections = 1;
+	if(_tableFlags.dataSourceNumberOfSectionsInTableView){
+		numberOfSections = [_dataSource numberOfSectionsInTableView:self];
+	}
+	
+	NSMutableArray *sections = [[NSMutableArray alloc] initWithCapacity:numberOfSections];
+	for(int s = 0; s < numberOfSections; ++s) {
+		TUITableViewSection *section = [[TUITableViewSection alloc] initWithNumberOfRows:[_dataSource tableView:self numberOfRowsInSection:s] sectionIndex:s tableView:self];
+		[section _setupHeaderHeight];
+		[section _captureRowIdentifiers];
+		[sections addObject:section];
+	}
+	
+	CGFloat offset = [_headerView bounds].size.height - self.contentInset.top*2;
+	CGFloat bottomInset = self.contentInset.bottom;
+	CGSize size = self.bounds.size;
+	BOOL estimated = _tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath;
+	
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_async(queue, ^{
+		dispatch_apply([sections count], queue, ^(size_t i) {
+			[[sections objectAtIndex:i] _setupRowHeightsEstimated:estimated];
+		});
+		
+		CGFloat sectionOffset = offset;
+		for(TUITableViewSection *section in sections) {
+			section.sectionOffset = sectionOffset;
+			sectionOffset += [section sectionHeight];
+		}
+		CGFloat contentHeight = sectionOffset - bottomInset;
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if(generation != _reloadGeneration)
+				return; // a newer reload owns the table now
+			_tableFlags.calculatingSectionInfo = 0;
+			if(CGSizeEqualToSize(self.bounds.size, size)) {
+				_preparedSectionInfo = sections;
+				_preparedContentHeight = contentHeight;
+			}
+			[self _finishReloadData];
+		});
+	});
+}
+
+- (void)_finishReloadData
+{
 	_selectedIndexPath = nil;
   
 	// need to recycle all visible cells, have them be regenerated on layoutSubviews
 	// because the same cells might have different content
-	for(TUIFastIndexPath *i in _visibleItems) {
-		TUITableViewCell *cell = [_visibleItems objectForKey:i];
+	[self _enumerateVisibleCellsUsingBlock:^(TUITableViewCell *cell, TUIPackedIndexPath indexPath) {
 		[self _enqueueReusableCell:cell];
 		[cell removeFromSuperview];
-	}
+	}];
 	
 	// if we have a dragged cell, clear it
 	_dragToReorderCell = nil;
+	_detachedDragToReorderCell = nil;
+	_detachedDragToReorderRow = TUIPackedIndexPathNotFound;
 	
 	// clear visible cells
-	[_visibleItems removeAllObjects];
+	[_visibleCells removeAllObjects];
+	_firstVisibleRow = TUIPackedIndexPathNotFound;
+	_lastVisibleRow = TUIPackedIndexPathNotFound;
 	
 	// remove any visible headers, they should be re-added when the table is laid out
 	for(TUITableViewSection *section in _sectionInfo){
@@ -976,6 +2613,8 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 			[CATransaction setDisableActions:YES];
 			
 			BOOL visibleCellsNeedRelayout = [self _preLayoutCells];
+			if(_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath || _tableFlags.hasProvisionalRowHeights)
+				visibleCellsNeedRelayout = [self _measureEstimatedRowsNearVisibleRect] || visibleCellsNeedRelayout;
 			[super layoutSubviews]; // this will munge with the contentOffset
 			[self _layoutSectionHeaders:visibleCellsNeedRelayout];
 			[self _layoutCells:visibleCellsNeedRelayout];
@@ -997,6 +2636,8 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 	_sectionInfo = nil; // will be regenerated on next layout
 	
 	[self _preLayoutCells];
+	if(_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath || _tableFlags.hasProvisionalRowHeights)
+		[self _measureEstimatedRowsNearVisibleRect];
 	[super layoutSubviews]; // this will munge with the contentOffset
 	[self _layoutSectionHeaders:YES];
 	[self _layoutCells:YES];
@@ -1111,24 +2752,32 @@ static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
 
 - (TUIFastIndexPath *)indexPathForFirstVisibleRow 
 {
-	TUIFastIndexPath *firstIndexPath = nil;
-	for(TUIFastIndexPath *indexPath in _visibleItems) {
-		if(firstIndexPath == nil || [indexPath compare:firstIndexPath] == NSOrderedAscending) {
-			firstIndexPath = indexPath;
-		}
+	TUIPackedIndexPath indexPath = _firstVisibleRow;
+	for(id cell in _visibleCells) {
+		if(cell != [NSNull null])
+			break;
+		indexPath = [self _rowAfterRow:indexPath];
 	}
-	return firstIndexPath;
+	if(indexPath != TUIPackedIndexPathNotFound && indexPath > _lastVisibleRow)
+		indexPath = TUIPackedIndexPathNotFound;
+	if(_detachedDragToReorderRow < indexPath) // not found is greater than every row
+		indexPath = _detachedDragToReorderRow;
+	return (indexPath != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:indexPath] : nil;
 }
 
 - (TUIFastIndexPath *)indexPathForLastVisibleRow 
 {
-	TUIFastIndexPath *lastIndexPath = nil;
-	for(TUIFastIndexPath *indexPath in _visibleItems) {
-		if(lastIndexPath == nil || [indexPath compare:lastIndexPath] == NSOrderedDescending) {
-			lastIndexPath = indexPath;
-		}
+	TUIPackedIndexPath indexPath = _lastVisibleRow;
+	for(id cell in [_visibleCells reverseObjectEnumerator]) {
+		if(cell != [NSNull null])
+			break;
+		indexPath = [self _rowBeforeRow:indexPath];
 	}
-	return lastIndexPath;
+	if(indexPath != TUIPackedIndexPathNotFound && indexPath < _firstVisibleRow)
+		indexPath = TUIPackedIndexPathNotFound;
+	if(_detachedDragToReorderRow != TUIPackedIndexPathNotFound && (indexPath == TUIPackedIndexPathNotFound || _detachedDragToReorderRow > indexPath))
+		indexPath = _detachedDragToReorderRow;
+	return (indexPath != TUIPackedIndexPathNotFound) ? [TUIFastIndexPath indexPathWithPackedIndexPath:indexPath] : nil;
 }
 
 - (BOOL)performKeyAction:(NSEvent *)event
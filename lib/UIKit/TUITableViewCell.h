@@ -34,6 +34,8 @@ typedef enum {
 		unsigned int selected:1;
 	} _tableViewCellFlags;
 	
+	@package
+	TUIPackedIndexPath _packedIndexPath; // row the table last showed the cell at, kept up to date while it's visible
 }
 
 - (id)initWithStyle:(TUITableViewCellStyle)style reuseIdentifier:(NSString *)reuseIdentifier;
@@ -31,6 +31,7 @@
 	if((self = [super initWithFrame:CGRectZero]))
 	{
 		[self setReuseIdentifier:reuseIdentifier];
+		_packedIndexPath = TUIPackedIndexPathNotFound;
 	}
 	return self;
 }
@@ -0,0 +1,99 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "CoreText+Additions.h"
+
+typedef struct {
+	NSUInteger count;      // layouts cached
+	NSUInteger bytes;      // estimated memory held by them
+	NSUInteger byteLimit;
+	NSUInteger hits;
+	NSUInteger misses;
+	NSUInteger evictions;  // layouts dropped to stay under the limit
+} TUITextLayoutCacheStatistics;
+
+/**
+ An attributed string laid out in a container of a given size.  The container
+ sits at the origin; whoever draws the frame translates it into place.  Layouts
+ never change once made, so one can be shared by every renderer and measurement
+ of the same text.
+ */
+@interface TUITextLayout : NSObject
+
+@property (nonatomic, readonly) NSAttributedString *attributedString; // an immutable copy
+@property (nonatomic, readonly) CGSize containerSize;
+@property (nonatomic, readonly) NSUInteger numberOfLines; // 0 for no limit
+
+@property (nonatomic, readonly) CTFramesetterRef ctFramesetter;
+@property (nonatomic, readonly) CTFrameRef ctFrame;
+@property (nonatomic, readonly) CGPathRef ctPath;
+
+@property (nonatomic, readonly) CFIndex lineCount;
+@property (nonatomic, readonly) const CGPoint *lineOrigins; // lineCount of them
+
+/**
+ Size of the text, counting at most numberOfLines lines.
+ */
+@property (nonatomic, readonly) CGSize size;
+
+/**
+ YES if every character of the string fit in the container.
+ */
+@property (nonatomic, readonly) BOOL containsEntireString;
+
+@property (nonatomic, readonly) NSUInteger cost; // rough estimate, in bytes, of what the layout keeps alive (its frame included, even if shared)
+
+/**
+ Draw the text with the top of the container at the top of @p rect.  Doesn't
+ touch any shared state, so layouts can be drawn from any thread.
+ */
+- (void)drawInRect:(CGRect)rect context:(CGContextRef)context;
+
+@end
+
+/**
+ Process-wide cache of text layouts, keyed by string contents, container size and
+ line limit, so text measured for a row height isn't laid out again to be drawn.
+
+ A layout that fit all of its text is also handed out for taller containers of
+ the same width, since the lines come out the same, just further from the bottom
+ (a string measured at an effectively unlimited height matches the row it's then
+ drawn in).  Layouts of the same string share one framesetter.  Least recently
+ used layouts are dropped past byteLimit (8MB by default); a frame shared by
+ several layouts counts towards it once, for as long as any of them is cached.
+ TUITableView empties the shared cache on system memory pressure.  Safe to use
+ from any thread.
+ */
+@interface TUITextLayoutCache : NSObject
+
++ (TUITextLayoutCache *)sharedCache;
+
+@property (nonatomic, assign) NSUInteger byteLimit;
+
+/**
+ Layout of @p attributedString in a container of @p size.  @p numberOfLines only
+ limits the measured size (0 for no limit), the frame still holds every line that
+ fit.  The returned layout's containerSize may be taller than @p size.
+ */
+- (TUITextLayout *)layoutForAttributedString:(NSAttributedString *)attributedString size:(CGSize)size numberOfLines:(NSUInteger)numberOfLines;
+
+- (void)removeAllLayouts;
+
+- (TUITextLayoutCacheStatistics)statistics;
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,433 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUITextLayout.h"
+
+#define TUITextLayoutCacheDefaultByteLimit (8 * 1024 * 1024)
+
+static inline NSUInteger TUITextLayoutHashFloat(CGFloat f)
+{
+	union { CGFloat f; NSUInteger u; } v = { .f = f };
+	return v.u;
+}
+
+@interface TUITextLayoutKey : NSObject <NSCopying>
+{
+@public
+	NSAttributedString *attributedString; // not copied, the cache keys off the layout's own copy
+	CGSize size;
+	NSUInteger numberOfLines;
+	BOOL anyHeight;
+}
+- (id)initWithAttributedString:(NSAttributedString *)s size:(CGSize)size numberOfLines:(NSUInteger)n anyHeight:(BOOL)anyHeight;
+@end
+
+@implementation TUITextLayoutKey
+
+- (id)initWithAttributedString:(NSAttributedString *)s size:(CGSize)aSize numberOfLines:(NSUInteger)n anyHeight:(BOOL)any
+{
+	if((self = [super init])) {
+		attributedString = s;
+		size = aSize;
+		numberOfLines = n;
+		anyHeight = any;
+		if(anyHeight)
+			size.height = 0.0;
+	}
+	return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	return self;
+}
+
+- (NSUInteger)hash
+{
+	return [[attributedString string] hash] ^ (TUITextLayoutHashFloat(size.width) * 31) ^ (TUITextLayoutHashFloat(size.height) * 17) ^ numberOfLines;
+}
+
+- (BOOL)isEqual:(id)object
+{
+	if(![object isKindOfClass:[TUITextLayoutKey class]])
+		return NO;
+	TUITextLayoutKey *other = object;
+	return CGSizeEqualToSize(size, other->size) &&
+		numberOfLines == other->numberOfLines &&
+		anyHeight == other->anyHeight &&
+		(attributedString == other->attributedString || [attributedString isEqualToAttributedString:other->attributedString]);
+}
+
+@end
+
+@interface TUITextLayout ()
+{
+@public
+	TUITextLayoutKey *key;
+	CGPoint *lineOrigins;
+	NSUInteger frameCost; // the part of cost that's ctFrame (and its framesetter), shared with layouts limited to fewer lines
+	__unsafe_unretained TUITextLayout *previous; // more recently used, in the cache's LRU list
+	__unsafe_unretained TUITextLayout *next;     // less recently used
+}
+- (id)initWithAttributedString:(NSAttributedString *)s framesetter:(CTFramesetterRef)framesetter containerSize:(CGSize)size;
+- (id)initWithLayout:(TUITextLayout *)layout numberOfLines:(NSUInteger)n;
+@end
+
+@implementation TUITextLayout
+
+@synthesize attributedString;
+@synthesize containerSize;
+@synthesize numberOfLines;
+@synthesize ctFramesetter;
+@synthesize ctFrame;
+@synthesize ctPath;
+@synthesize lineCount;
+@synthesize size;
+@synthesize containsEntireString;
+@synthesize cost;
+
+- (id)initWithAttributedString:(NSAttributedString *)s framesetter:(CTFramesetterRef)framesetter containerSize:(CGSize)aSize
+{
+	if((self = [super init])) {
+		attributedString = [s copy];
+		containerSize = aSize;
+
+		if(framesetter != NULL) {
+			ctFramesetter = (CTFramesetterRef)CFRetain(framesetter);
+		} else {
+			ctFramesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)attributedString);
+		}
+
+		ctPath = CGPathCreateMutable();
+		CGPathAddRect((CGMutablePathRef)ctPath, NULL, CGRectMake(0.0, 0.0, containerSize.width, containerSize.height));
+
+		// framesetters are shared between layouts, and Core Text doesn't want one used by two threads at once
+		@synchronized((__bridge id)ctFramesetter) {
+			ctFrame = CTFramesetterCreateFrame(ctFramesetter, CFRangeMake(0, 0), ctPath, NULL);
+		}
+
+		if(ctFrame != NULL) {
+			lineCount = CFArrayGetCount(CTFrameGetLines(ctFrame));
+			lineOrigins = (CGPoint *)malloc(sizeof(CGPoint) * MAX(lineCount, 1));
+			CTFrameGetLineOrigins(ctFrame, CFRangeMake(0, lineCount), lineOrigins);
+
+			CFRange visibleRange = CTFrameGetVisibleStringRange(ctFrame);
+			containsEntireString = (NSUInteger)(visibleRange.location + visibleRange.length) >= [attributedString length];
+			size = AB_CTFrameGetSize(ctFrame);
+		}
+
+		// a guess at what Core Text keeps around: glyphs, advances and positions for
+		// each character, plus line and run objects
+		if(ctFrame != NULL)
+			frameCost = 256 + [attributedString length] * 64 + lineCount * 192;
+		cost = frameCost + lineCount * sizeof(CGPoint);
+	}
+	return self;
+}
+
+- (id)initWithLayout:(TUITextLayout *)layout numberOfLines:(NSUInteger)n
+{
+	if((self = [super init])) {
+		attributedString = layout->attributedString;
+		containerSize = layout->containerSize;
+		numberOfLines = n;
+		ctFramesetter = (CTFramesetterRef)CFRetain(layout->ctFramesetter);
+		ctPath = CGPathRetain(layout->ctPath);
+		ctFrame = layout->ctFrame ? (CTFrameRef)CFRetain(layout->ctFrame) : NULL;
+		lineCount = layout->lineCount;
+		lineOrigins = (CGPoint *)malloc(sizeof(CGPoint) * MAX(lineCount, 1));
+		if(lineCount > 0)
+			memcpy(lineOrigins, layout->lineOrigins, sizeof(CGPoint) * lineCount);
+		containsEntireString = layout->containsEntireString;
+		size = layout->size;
+
+		if(n > 0 && (NSUInteger)lineCount > n) {
+			NSArray *lines = (__bridge NSArray *)CTFrameGetLines(ctFrame);
+			CGFloat w = 0.0;
+			for(NSUInteger i = 0; i < n; ++i)
+				w = MAX(w, AB_CTLineGetSize((__bridge CTLineRef)[lines objectAtIndex:i]).width);
+
+			CGFloat ascent, descent, leading;
+			CTLineGetTypographicBounds((__bridge CTLineRef)[lines objectAtIndex:n - 1], &ascent, &descent, &leading);
+			size = CGSizeMake(ceil(w), ceil(containerSize.height - lineOrigins[n - 1].y + descent));
+		}
+
+		frameCost = layout->frameCost;
+		cost = frameCost + 64 + lineCount * sizeof(CGPoint);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if(ctFrame)
+		CFRelease(ctFrame);
+	if(ctPath)
+		CGPathRelease(ctPath);
+	if(ctFramesetter)
+		CFRelease(ctFramesetter);
+	free(lineOrigins);
+}
+
+- (const CGPoint *)lineOrigins
+{
+	return lineOrigins;
+}
+
+- (void)drawInRect:(CGRect)rect context:(CGContextRef)context
+{
+	if(ctFrame == NULL)
+		return;
+
+	CGContextSaveGState(context);
+	CGContextSetTextMatrix(context, CGAffineTransformIdentity);
+	CGContextTranslateCTM(context, rect.origin.x, CGRectGetMaxY(rect) - containerSize.height);
+	CTFrameDraw(ctFrame, context);
+	CGContextRestoreGState(context);
+}
+
+@end
+
+@interface TUITextLayoutCache ()
+{
+	NSMutableDictionary *layouts;         // TUITextLayoutKey -> TUITextLayout
+	NSMutableDictionary *fittingLayouts;  // key ignoring height -> latest layout that fit all its text
+	NSMutableDictionary *framesetterLayouts; // attributed string -> a layout whose framesetter can be reused
+	NSCountedSet *frames;                    // CTFrames of cached layouts (as NSValue pointers), by number of layouts holding them
+	__unsafe_unretained TUITextLayout *head; // most recently used
+	__unsafe_unretained TUITextLayout *tail; // least recently used
+	TUITextLayoutCacheStatistics statistics;
+}
+@end
+
+@implementation TUITextLayoutCache
+
++ (TUITextLayoutCache *)sharedCache
+{
+	static TUITextLayoutCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedCache = [[TUITextLayoutCache alloc] init];
+	});
+	return sharedCache;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		layouts = [[NSMutableDictionary alloc] init];
+		fittingLayouts = [[NSMutableDictionary alloc] init];
+		framesetterLayouts = [[NSMutableDictionary alloc] init];
+		frames = [[NSCountedSet alloc] init];
+		statistics.byteLimit = TUITextLayoutCacheDefaultByteLimit;
+	}
+	return self;
+}
+
+- (NSUInteger)byteLimit
+{
+	@synchronized(self) {
+		return statistics.byteLimit;
+	}
+}
+
+- (void)_unlinkLayout:(TUITextLayout *)layout
+{
+	if(layout->previous) layout->previous->next = layout->next; else head = layout->next;
+	if(layout->next) layout->next->previous = layout->previous; else tail = layout->previous;
+	layout->previous = nil;
+	layout->next = nil;
+}
+
+- (void)_linkLayoutAtHead:(TUITextLayout *)layout
+{
+	layout->next = head;
+	if(head) head->previous = layout;
+	head = layout;
+	if(!tail) tail = layout;
+}
+
+/**
+ * @brief Count @p layout in the statistics.  Must be called from within @synchronized(self).
+ * 
+ * A frame shared by several cached layouts (a layout and the ones limiting it to
+ * fewer lines) is only counted once, so it stays counted for as long as any of
+ * them is cached.
+ */
+- (void)_addCostOfLayout:(TUITextLayout *)layout
+{
+	statistics.count++;
+	statistics.bytes += layout.cost - layout->frameCost;
+	if(layout.ctFrame != NULL) {
+		NSValue *frame = [NSValue valueWithPointer:layout.ctFrame];
+		if([frames countForObject:frame] == 0)
+			statistics.bytes += layout->frameCost;
+		[frames addObject:frame];
+	}
+}
+
+/**
+ * @brief Take @p layout out of the statistics, and its frame once no other cached layout holds it.  Must be called from within @synchronized(self).
+ */
+- (void)_removeCostOfLayout:(TUITextLayout *)layout
+{
+	statistics.count--;
+	statistics.bytes -= layout.cost - layout->frameCost;
+	if(layout.ctFrame != NULL) {
+		NSValue *frame = [NSValue valueWithPointer:layout.ctFrame];
+		[frames removeObject:frame];
+		if([frames countForObject:frame] == 0)
+			statistics.bytes -= layout->frameCost;
+	}
+}
+
+/**
+ * @brief Forget @p layout.  Must be called from within @synchronized(self).
+ */
+- (void)_removeLayout:(TUITextLayout *)layout
+{
+	[self _unlinkLayout:layout];
+	[self _removeCostOfLayout:layout];
+
+	TUITextLayoutKey *key = layout->key;
+	NSAttributedString *attributedString = layout.attributedString;
+	TUITextLayoutKey *fittingKey = [[TUITextLayoutKey alloc] initWithAttributedString:key->attributedString size:key->size numberOfLines:0 anyHeight:YES];
+	if([fittingLayouts objectForKey:fittingKey] == layout)
+		[fittingLayouts removeObjectForKey:fittingKey];
+	if([framesetterLayouts objectForKey:attributedString] == layout)
+		[framesetterLayouts removeObjectForKey:attributedString];
+	if([layouts objectForKey:key] == layout)
+		[layouts removeObjectForKey:key]; // may release the layout
+}
+
+/**
+ * @brief Drop least recently used layouts until under the limit.  Must be called from within @synchronized(self).
+ */
+- (void)_trim
+{
+	while(statistics.bytes > statistics.byteLimit && tail != nil) {
+		[self _removeLayout:tail];
+		statistics.evictions++;
+	}
+}
+
+- (void)setByteLimit:(NSUInteger)limit
+{
+	@synchronized(self) {
+		statistics.byteLimit = limit;
+		[self _trim];
+	}
+}
+
+- (TUITextLayout *)layoutForAttributedString:(NSAttributedString *)attributedString size:(CGSize)size numberOfLines:(NSUInteger)numberOfLines
+{
+	if(attributedString == nil)
+		return nil;
+
+	TUITextLayoutKey *key = [[TUITextLayoutKey alloc] initWithAttributedString:attributedString size:size numberOfLines:numberOfLines anyHeight:NO];
+	TUITextLayout *framesetterLayout = nil;
+
+	@synchronized(self) {
+		TUITextLayout *layout = [layouts objectForKey:key];
+		if(layout == nil && numberOfLines == 0) {
+			TUITextLayoutKey *fittingKey = [[TUITextLayoutKey alloc] initWithAttributedString:attributedString size:size numberOfLines:0 anyHeight:YES];
+			layout = [fittingLayouts objectForKey:fittingKey];
+			if(layout.size.height > size.height)
+				layout = nil;
+		}
+
+		if(layout != nil) {
+			statistics.hits++;
+			if(layout != head) {
+				[self _unlinkLayout:layout];
+				[self _linkLayoutAtHead:layout];
+			}
+			return layout;
+		}
+
+		statistics.misses++;
+		if(numberOfLines == 0)
+			framesetterLayout = [framesetterLayouts objectForKey:attributedString];
+	}
+
+	// lay out without holding the lock, other threads can carry on measuring
+	TUITextLayout *layout = nil;
+	if(numberOfLines > 0) {
+		TUITextLayout *fullLayout = [self layoutForAttributedString:attributedString size:size numberOfLines:0];
+		layout = [[TUITextLayout alloc] initWithLayout:fullLayout numberOfLines:numberOfLines];
+	} else {
+		layout = [[TUITextLayout alloc] initWithAttributedString:attributedString framesetter:framesetterLayout.ctFramesetter containerSize:size];
+	}
+	layout->key = [[TUITextLayoutKey alloc] initWithAttributedString:layout.attributedString size:size numberOfLines:numberOfLines anyHeight:NO];
+
+	@synchronized(self) {
+		TUITextLayout *existing = [layouts objectForKey:key];
+		if(existing != nil) // someone else got here first
+			return existing;
+
+		[layouts setObject:layout forKey:layout->key];
+		if(numberOfLines == 0) {
+			if(layout.containsEntireString) {
+				TUITextLayoutKey *fittingKey = [[TUITextLayoutKey alloc] initWithAttributedString:layout.attributedString size:size numberOfLines:0 anyHeight:YES];
+				[fittingLayouts setObject:layout forKey:fittingKey];
+			}
+			[framesetterLayouts setObject:layout forKey:layout.attributedString];
+		}
+		[self _linkLayoutAtHead:layout];
+		[self _addCostOfLayout:layout];
+		[self _trim];
+	}
+	return layout;
+}
+
+- (void)removeAllLayouts
+{
+	@synchronized(self) {
+		// unlink before the dictionaries let go, layouts handed out may outlive the cache's hold on them
+		for(TUITextLayout *layout = head; layout != nil; ) {
+			TUITextLayout *next = layout->next;
+			layout->previous = nil;
+			layout->next = nil;
+			layout = next;
+		}
+		head = nil;
+		tail = nil;
+		[layouts removeAllObjects];
+		[fittingLayouts removeAllObjects];
+		[framesetterLayouts removeAllObjects];
+		[frames removeAllObjects];
+		statistics.count = 0;
+		statistics.bytes = 0;
+	}
+}
+
+- (TUITextLayoutCacheStatistics)statistics
+{
+	@synchronized(self) {
+		return statistics;
+	}
+}
+
+- (void)resetStatistics
+{
+	@synchronized(self) {
+		statistics.hits = 0;
+		statistics.misses = 0;
+		statistics.evictions = 0;
+	}
+}
+
+@end
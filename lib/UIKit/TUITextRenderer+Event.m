@@ -25,6 +25,9 @@
 - (CTFrameRef)ctFrame;
 - (CGPathRef)ctPath;
 - (CFRange)_selectedRange;
+- (AB_CTFrameMetrics *)_lineMetrics;
+- (void)_getRectsForRange:(CFRange)range aggregationType:(AB_CTLineRectAggregationType)aggregationType rects:(CGRect[])rects count:(CFIndex *)rectCount;
+- (CGPoint)_framePointForPoint:(CGPoint)p;
 @end
 
 @implementation TUITextRenderer (Event)
@@ -65,7 +68,10 @@
 
 - (CFIndex)stringIndexForPoint:(CGPoint)p
 {
-	return AB_CTFrameGetStringIndexForPosition([self ctFrame], p);
+	AB_CTFrameMetrics *metrics = [self _lineMetrics];
+	if(!metrics)
+		return 0;
+	return AB_CTFrameMetricsGetStringIndexForPosition(metrics, [self _framePointForPoint:p]);
 }
 
 - (CFIndex)stringIndexForEvent:(NSEvent *)event
@@ -250,12 +256,11 @@ normal:
 }
 
 - (CGRect)rectForRange:(CFRange)range {
-	CTFrameRef textFrame = [self ctFrame];
 	CGRect totalRect = CGRectNull;
 	if(range.length > 0) {
 		CFIndex rectCount = 100;
 		CGRect rects[rectCount];
-		AB_CTFrameGetRectsForRangeWithAggregationType(textFrame, range, AB_CTLineRectAggregationTypeBlock, rects, &rectCount);
+		[self _getRectsForRange:range aggregationType:AB_CTLineRectAggregationTypeBlock rects:rects count:&rectCount];
 		
 		for(CFIndex i = 0; i < rectCount; ++i) {
 			CGRect rect = rects[i];
@@ -20,6 +20,7 @@
 
 @class TUIColor;
 @class TUIFont;
+@class TUITextLayout;
 @class TUIView;
 
 typedef enum {
@@ -31,13 +32,13 @@ typedef enum {
 
 typedef enum {
 	TUITextVerticalAlignmentTop = 0,
-	// Note that TUITextVerticalAlignmentMiddle and TUITextVerticalAlignmentBottom both have a performance hit because they have to create the CTFrame twice: once to find its height and then again to shift it to match the alignment and height.
-	// Also note that text selection doesn't work properly with anything but TUITextVerticalAlignmentTop.
+	// Text is laid out once for every alignment; Middle and Bottom just shift it when drawing and hit testing, so they cost the same as Top and selection works with all of them.
 	TUITextVerticalAlignmentMiddle,
 	TUITextVerticalAlignmentBottom,
 } TUITextVerticalAlignment;
 
 @protocol TUITextRendererDelegate;
+struct TUITextDecorationTable;
 
 @interface TUITextRenderer : TUIResponder
 {
@@ -48,6 +49,10 @@ typedef enum {
 	CTFramesetterRef _ct_framesetter;
 	CGPathRef _ct_path;
 	CTFrameRef _ct_frame;
+	TUITextLayout *_layout;
+	CGPoint _layoutOffset; // from _ct_frame's coordinates to the view's
+	AB_CTFrameMetrics *_lineMetrics; // of _ct_frame, built on first use
+	struct TUITextDecorationTable *_decorations; // background and pre-draw runs, built on first draw
 	
 	CFIndex _selectionStart;
 	CFIndex _selectionEnd;
@@ -19,10 +19,50 @@
 #import "TUIFont.h"
 #import "TUIColor.h"
 #import "TUIKit.h"
+#import "TUITextLayout.h"
 #import "CoreText+Additions.h"
 
+/**
+ Every run of the string with a background color or a pre-draw block, along
+ with its rects, worked out once per layout so redraws just replay it.
+ */
+typedef struct {
+	NSRange range;
+	AB_CTLineRectAggregationType fillStyle;
+	CGColorRef color;          // retained, background runs only
+	const void *preDrawBlock;  // retained TUIAttributedStringPreDrawBlock, pre-draw runs only
+	CFIndex firstRect;         // into the table's rects
+	CFIndex rectCount;
+} TUITextDecorationRun;
+
+struct TUITextDecorationTable {
+	CFIndex preDrawRunCount;   // pre-draw runs come first
+	CFIndex backgroundRunCount;
+	TUITextDecorationRun *runs;
+	CGRect *rects;
+};
+
+static void TUITextDecorationTableRelease(struct TUITextDecorationTable *table)
+{
+	if(table) {
+		for(CFIndex i = 0; i < table->preDrawRunCount + table->backgroundRunCount; ++i) {
+			if(table->runs[i].color)
+				CGColorRelease(table->runs[i].color);
+			if(table->runs[i].preDrawBlock)
+				CFRelease(table->runs[i].preDrawBlock);
+		}
+		free(table->runs);
+		free(table->rects);
+		free(table);
+	}
+}
+
 @interface TUITextRenderer ()
 @property (nonatomic, retain) NSMutableDictionary *lineRects;
+- (AB_CTFrameMetrics *)_lineMetrics;
+- (struct TUITextDecorationTable *)_decorations;
+- (void)_getRectsForRange:(CFRange)range aggregationType:(AB_CTLineRectAggregationType)aggregationType rects:(CGRect[])rects count:(CFIndex *)rectCount;
+- (CGPoint)_framePointForPoint:(CGPoint)p;
 @end
 
 @implementation TUITextRenderer
@@ -48,6 +88,12 @@
 		_ct_path = NULL;
 	}
 	
+	AB_CTFrameMetricsRelease(_lineMetrics);
+	_lineMetrics = NULL;
+	TUITextDecorationTableRelease(_decorations);
+	_decorations = NULL;
+	_layout = nil;
+	_layoutOffset = CGPointZero;
 	lineRects = nil;
 }
 
@@ -66,65 +112,81 @@
 	[self _resetFramesetter];
 }
 
-- (void)_buildFrameWithEffectiveFrame:(CGRect)effectiveFrame
-{
-	[self _resetFrame];
-	
-	_ct_path = CGPathCreateMutable();
-	CGPathAddRect((CGMutablePathRef)_ct_path, NULL, effectiveFrame);
-	_ct_frame = CTFramesetterCreateFrame(_ct_framesetter, CFRangeMake(0, 0), _ct_path, NULL);
-}
-
 - (void)_buildFrame
 {
-	if(!_ct_path) {
-		[self _buildFrameWithEffectiveFrame:frame];
+	if(!_ct_path && attributedString) {
+		// likely already laid out when the text was measured
+		_layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:attributedString size:frame.size numberOfLines:0];
+		if(!_ct_framesetter)
+			_ct_framesetter = (CTFramesetterRef)CFRetain(_layout.ctFramesetter);
+		_ct_path = CGPathRetain(_layout.ctPath);
+		_ct_frame = _layout.ctFrame ? (CTFrameRef)CFRetain(_layout.ctFrame) : NULL;
 		
-		// TUITextVerticalAlignmentTop is easy since that's how Core Text always draws. For Middle and Bottom we have to shift the CTFrame down.
-		if(verticalAlignment != TUITextVerticalAlignmentTop) {
-			CGRect effectiveFrame = frame;
-			
-			CGSize size = AB_CTFrameGetSize(_ct_frame);
-			if(verticalAlignment == TUITextVerticalAlignmentMiddle) {
-				effectiveFrame.origin.y = size.height/2 - frame.size.height/2;
-			} else if(verticalAlignment == TUITextVerticalAlignmentBottom) {
-				effectiveFrame.origin.y = size.height;
-			}
-			
-			effectiveFrame = CGRectIntegral(effectiveFrame);
-			
-			[self _buildFrameWithEffectiveFrame:effectiveFrame];
+		// Core Text lays out from the top of the container, which sits at the origin and may be
+		// taller than our frame.  Line the tops up, then shift down for the other alignments.
+		CGFloat shift = 0.0;
+		if(verticalAlignment == TUITextVerticalAlignmentMiddle) {
+			shift = floor((frame.size.height - _layout.size.height) / 2);
+		} else if(verticalAlignment == TUITextVerticalAlignmentBottom) {
+			shift = floor(frame.size.height - _layout.size.height);
 		}
+		_layoutOffset = CGPointMake(frame.origin.x, CGRectGetMaxY(frame) - _layout.containerSize.height - shift);
 	}
 }
 
-- (void)_buildFramesetter
-{
-	if(!_ct_framesetter) {
-		_ct_framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)attributedString);
-	}
-	
-	[self _buildFrame];
-}
-
 - (CTFramesetterRef)ctFramesetter
 {
-	[self _buildFramesetter];
+	[self _buildFrame];
 	return _ct_framesetter;
 }
 
 - (CTFrameRef)ctFrame
 {
-	[self _buildFramesetter];
+	[self _buildFrame];
 	return _ct_frame;
 }
 
 - (CGPathRef)ctPath
 {
-	[self _buildFramesetter];
+	[self _buildFrame];
 	return _ct_path;
 }
 
+- (AB_CTFrameMetrics *)_lineMetrics
+{
+	CTFrameRef f = [self ctFrame];
+	if(!_lineMetrics && f)
+		_lineMetrics = AB_CTFrameMetricsCreate(f);
+	return _lineMetrics;
+}
+
+/**
+ * @brief Rects for @p range in the view's coordinates
+ */
+- (void)_getRectsForRange:(CFRange)range aggregationType:(AB_CTLineRectAggregationType)aggregationType rects:(CGRect[])rects count:(CFIndex *)rectCount
+{
+	AB_CTFrameMetrics *metrics = [self _lineMetrics];
+	if(!metrics) {
+		*rectCount = 0;
+		return;
+	}
+	
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, range, aggregationType, rects, rectCount);
+	for(CFIndex i = 0; i < *rectCount; ++i)
+		rects[i] = CGRectOffset(rects[i], _layoutOffset.x, _layoutOffset.y);
+}
+
+/**
+ * @brief Point relative to our frame's origin -> point relative to the CTFrame's path, for hit testing
+ */
+- (CGPoint)_framePointForPoint:(CGPoint)p
+{
+	[self _buildFrame];
+	p.x += frame.origin.x - _layoutOffset.x;
+	p.y += frame.origin.y - _layoutOffset.y;
+	return p;
+}
+
 - (CFIndex)_clampToValidRange:(CFIndex)index
 {
 	if(index < 0) return 0;
@@ -206,6 +268,57 @@
 	return [[attributedString string] substringWithRange:[self selectedRange]];
 }
 
+/**
+ * @brief Add a run for every range of @p attributeName to @p table, returns how many
+ */
+- (CFIndex)_addDecorationRunsForAttribute:(NSString *)attributeName toTable:(struct TUITextDecorationTable *)table runCapacity:(CFIndex *)runCapacity rectCapacity:(CFIndex *)rectCapacity
+{
+	__block CFIndex added = 0;
+	[attributedString enumerateAttribute:attributeName inRange:NSMakeRange(0, [attributedString length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
+		if(value == NULL) return;
+		
+		CFIndex runIndex = table->preDrawRunCount + table->backgroundRunCount + added;
+		if(runIndex == *runCapacity) {
+			*runCapacity = MAX(*runCapacity * 2, 8);
+			table->runs = (TUITextDecorationRun *) realloc(table->runs, sizeof(TUITextDecorationRun) * *runCapacity);
+		}
+		
+		CFIndex firstRect = runIndex > 0 ? table->runs[runIndex - 1].firstRect + table->runs[runIndex - 1].rectCount : 0;
+		if(firstRect + 100 > *rectCapacity) {
+			*rectCapacity = MAX(*rectCapacity * 2, firstRect + 100);
+			table->rects = (CGRect *) realloc(table->rects, sizeof(CGRect) * *rectCapacity);
+		}
+		
+		TUITextDecorationRun *run = &table->runs[runIndex];
+		memset(run, 0, sizeof(TUITextDecorationRun));
+		run->range = range;
+		run->fillStyle = (AB_CTLineRectAggregationType) [[attributedString attribute:TUIAttributedStringBackgroundFillStyleName atIndex:range.location effectiveRange:NULL] integerValue];
+		if([attributeName isEqualToString:TUIAttributedStringBackgroundColorAttributeName]) {
+			run->color = CGColorRetain((__bridge CGColorRef)value);
+		} else {
+			run->preDrawBlock = CFBridgingRetain(value);
+		}
+		run->firstRect = firstRect;
+		run->rectCount = 100;
+		[self _getRectsForRange:CFRangeMake(range.location, range.length) aggregationType:run->fillStyle rects:table->rects + firstRect count:&run->rectCount];
+		added++;
+	}];
+	return added;
+}
+
+- (struct TUITextDecorationTable *)_decorations
+{
+	if(!_decorations && attributedString) {
+		struct TUITextDecorationTable *table = (struct TUITextDecorationTable *) calloc(1, sizeof(struct TUITextDecorationTable));
+		CFIndex runCapacity = 0;
+		CFIndex rectCapacity = 0;
+		table->preDrawRunCount = [self _addDecorationRunsForAttribute:TUIAttributedStringPreDrawBlockName toTable:table runCapacity:&runCapacity rectCapacity:&rectCapacity];
+		table->backgroundRunCount = [self _addDecorationRunsForAttribute:TUIAttributedStringBackgroundColorAttributeName toTable:table runCapacity:&runCapacity rectCapacity:&rectCapacity];
+		_decorations = table;
+	}
+	return _decorations;
+}
+
 - (void)draw
 {
 	[self drawInContext:TUIGraphicsGetCurrentContext()];
@@ -219,53 +332,35 @@
 		CTFrameRef f = [self ctFrame];
 		
 		if(_flags.preDrawBlocksEnabled && !_flags.drawMaskDragSelection) {
-			[self.attributedString enumerateAttribute:TUIAttributedStringPreDrawBlockName inRange:NSMakeRange(0, [self.attributedString length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
-				if(value == NULL) return;
+			struct TUITextDecorationTable *decorations = [self _decorations];
+			for(CFIndex i = 0; i < decorations->preDrawRunCount; ++i) {
+				TUITextDecorationRun *run = &decorations->runs[i];
 				
 				CGContextSaveGState(context);
 				
-				AB_CTLineRectAggregationType aggregationType = (AB_CTLineRectAggregationType) [[self.attributedString attribute:TUIAttributedStringBackgroundFillStyleName atIndex:range.location effectiveRange:NULL] integerValue];
-				NSArray *rectsArray = [self rectsForCharacterRange:CFRangeMake(range.location, range.length) aggregationType:aggregationType];
-				
-				CFIndex rectCount = rectsArray.count;
-				CGRect rects[rectCount];
-				for(NSUInteger i = 0; i < rectCount; i++) {
-					rects[i] = [[rectsArray objectAtIndex:i] rectValue];
-				}
+				TUIAttributedStringPreDrawBlock block = (__bridge TUIAttributedStringPreDrawBlock)run->preDrawBlock;
+				block(self.attributedString, run->range, decorations->rects + run->firstRect, run->rectCount);
 				
-				TUIAttributedStringPreDrawBlock block = value;
-				block(self.attributedString, range, rects, rectCount);
-					
 				CGContextRestoreGState(context);
-			}];
+			}
 		}
 		
 		if(_flags.backgroundDrawingEnabled && !_flags.drawMaskDragSelection) {
 			CGContextSaveGState(context);
 			
-			[self.attributedString enumerateAttribute:TUIAttributedStringBackgroundColorAttributeName inRange:NSMakeRange(0, [self.attributedString length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
-				if(value == NULL) return;
-				
-				CGColorRef color = (__bridge CGColorRef) value;
-				CGContextSetFillColorWithColor(context, color);
-				
-				AB_CTLineRectAggregationType aggregationType = (AB_CTLineRectAggregationType) [[self.attributedString attribute:TUIAttributedStringBackgroundFillStyleName atIndex:range.location effectiveRange:NULL] integerValue];
-				NSArray *rectsArray = [self rectsForCharacterRange:CFRangeMake(range.location, range.length) aggregationType:aggregationType];
-				
-				CFIndex rectCount = rectsArray.count;
-				CGRect rects[rectCount];
-				for(NSUInteger i = 0; i < rectCount; i++) {
-					rects[i] = [[rectsArray objectAtIndex:i] rectValue];
-				}
+			struct TUITextDecorationTable *decorations = [self _decorations];
+			for(CFIndex i = decorations->preDrawRunCount; i < decorations->preDrawRunCount + decorations->backgroundRunCount; ++i) {
+				TUITextDecorationRun *run = &decorations->runs[i];
+				CGContextSetFillColorWithColor(context, run->color);
 				
-				for(CFIndex i = 0; i < rectCount; ++i) {
-					CGRect r = rects[i];
+				for(CFIndex j = 0; j < run->rectCount; ++j) {
+					CGRect r = decorations->rects[run->firstRect + j];
 					r = CGRectInset(r, -2, -1);
 					r = CGRectIntegral(r);
 					if(r.size.width > 1)
 						CGContextFillRect(context, r);
 				}
-			}];
+			}
 			
 			CGContextRestoreGState(context);
 		}
@@ -278,7 +373,7 @@
 			CFRange r = {_r.location, _r.length};
 			CFIndex nRects = 10;
 			CGRect rects[nRects];
-			AB_CTFrameGetRectsForRange(f, r, rects, &nRects);
+			[self _getRectsForRange:r aggregationType:AB_CTLineRectAggregationTypeInline rects:rects count:&nRects];
 			for(int i = 0; i < nRects; ++i) {
 				CGRect rect = rects[i];
 				rect = CGRectInset(rect, -2, -1);
@@ -299,7 +394,7 @@
 			// draw (or mask) selection
 			CFIndex rectCount = 100;
 			CGRect rects[rectCount];
-			AB_CTFrameGetRectsForRange(f, selectedRange, rects, &rectCount);
+			[self _getRectsForRange:selectedRange aggregationType:AB_CTLineRectAggregationTypeInline rects:rects count:&rectCount];
 			if(_flags.drawMaskDragSelection) {
 				CGContextClipToRects(context, rects, rectCount);
 			} else {
@@ -312,6 +407,7 @@
 		if(shadowColor)
 			CGContextSetShadowWithColor(context, shadowOffset, shadowBlur, shadowColor.CGColor);
 
+		CGContextTranslateCTM(context, _layoutOffset.x, _layoutOffset.y);
 		CTFrameDraw(f, context); // draw actual text
 				
 		CGContextRestoreGState(context);
@@ -331,34 +427,24 @@
 - (CGSize)size
 {
 	if(attributedString) {
-		return AB_CTFrameGetSize([self ctFrame]);
+		[self _buildFrame];
+		return _layout.size;
 	}
 	return CGSizeZero;
 }
 
 - (CGSize)sizeConstrainedToWidth:(CGFloat)width
 {
-	if(attributedString) {
-		CGRect oldFrame = frame;
-		self.frame = CGRectMake(0.0f, 0.0f, width, 1000000.0f);
-
-		CGSize size = [self size];
-		
-		self.frame = oldFrame;
-		
-		return size;
-	}
-	return CGSizeZero;
+	return [self sizeConstrainedToWidth:width numberOfLines:0];
 }
 
 - (CGSize)sizeConstrainedToWidth:(CGFloat)width numberOfLines:(NSUInteger)numberOfLines
 {
-	NSMutableAttributedString *fake = [self.attributedString mutableCopy];
-	[fake replaceCharactersInRange:NSMakeRange(0, [fake length]) withString:@"M"];
-	CGFloat singleLineHeight = [fake ab_sizeConstrainedToWidth:width].height;
-	CGFloat maxHeight = singleLineHeight * numberOfLines;
-	CGSize size = [self sizeConstrainedToWidth:width];
-	return CGSizeMake(size.width, MIN(maxHeight, size.height));
+	if(attributedString) {
+		TUITextLayout *layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:attributedString size:CGSizeMake(width, 1000000.0f) numberOfLines:numberOfLines];
+		return layout.size;
+	}
+	return CGSizeZero;
 }
 
 - (void)setAttributedString:(NSAttributedString *)a
@@ -370,6 +456,9 @@
 
 - (void)setFrame:(CGRect)f
 {
+	if(CGRectEqualToRect(frame, f))
+		return; // views set this on every draw, keep the layout, metrics and decorations
+	
 	frame = f;
 	[self _resetFrame];
 }
@@ -383,7 +472,7 @@
 {
 	CFIndex rectCount = 1;
 	CGRect rects[rectCount];
-	AB_CTFrameGetRectsForRange([self ctFrame], range, rects, &rectCount);
+	[self _getRectsForRange:range aggregationType:AB_CTLineRectAggregationTypeInline rects:rects count:&rectCount];
 	if(rectCount > 0) {
 		return rects[0];
 	}
@@ -406,7 +495,7 @@
 	if(cachedRects == nil) {
 		CFIndex rectCount = 100;
 		CGRect rects[rectCount];
-		AB_CTFrameGetRectsForRangeWithAggregationType([self ctFrame], range, aggregationType, rects, &rectCount);
+		[self _getRectsForRange:range aggregationType:aggregationType rects:rects count:&rectCount];
 		
 		NSMutableArray *wrappedRects = [NSMutableArray arrayWithCapacity:rectCount];
 		for(CFIndex i = 0; i < rectCount; i++) {
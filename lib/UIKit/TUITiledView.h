@@ -0,0 +1,67 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIView.h"
+
+@class TUIScrollView;
+
+/**
+ A view for content much bigger than the screen (a long document, a big image in
+ a TUIScrollView).  Rather than one bitmap the size of its bounds, it keeps a grid
+ of tiles, and only tiles within visibleMargin of the visible part of the view
+ exist.  Tiles are drawn in the background, several at once (through the shared
+ TUIDrawScheduler, visible tiles first), and tiles that scroll away are recycled.
+ Inside a TUIScrollView, tiles ahead of the scroll direction are prefetched using
+ the scroll view's velocity.
+
+ Subclasses override -drawRect: (or set the drawRect block) as usual, but it's
+ called once per tile with the tile's rect, on background threads and possibly
+ for several tiles at the same time, so it must be thread-safe.
+ */
+@interface TUITiledView : TUIView
+{
+	CGSize tileSize;
+	CGFloat visibleMargin;
+	NSTimeInterval prefetchInterval;
+
+	NSMutableDictionary *_tiles; // packed row/column -> TUITiledViewTile
+	NSMutableArray *_reusableTiles;
+	CGSize _tiledSize; // bounds size the tiles were laid out for
+	CGFloat _tileScale;
+	__unsafe_unretained TUIScrollView *_observedScrollView;
+}
+
+/**
+ Size of a tile in points. Default is 256x256.
+ */
+@property (nonatomic, assign) CGSize tileSize;
+
+/**
+ How far beyond the visible part of the view tiles are kept around. Default is 128.
+ */
+@property (nonatomic, assign) CGFloat visibleMargin;
+
+/**
+ How far ahead to prefetch while scrolling, in seconds at the current scroll velocity. Default is 0.25.
+ */
+@property (nonatomic, assign) NSTimeInterval prefetchInterval;
+
+/**
+ Number of tiles that currently exist (drawn or waiting to be).
+ */
+@property (nonatomic, readonly) NSUInteger tileCount;
+
+@end
@@ -0,0 +1,335 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUITiledView.h"
+#import "TUIKit.h"
+#import "TUIDrawScheduler.h"
+
+#define TUITiledViewMaximumReusableTiles 16
+
+@interface TUITiledViewTile : NSObject
+{
+@public
+	CALayer   *layer;
+	CGRect     rect;
+	NSUInteger generation; // bumped when the tile is invalidated or recycled; older draws are dropped
+	BOOL       needsDisplay;
+}
+@end
+
+@implementation TUITiledViewTile
+@end
+
+@interface TUITiledView ()
+- (void)_updateTiles;
+@end
+
+@implementation TUITiledView
+
+@synthesize tileSize;
+@synthesize visibleMargin;
+@synthesize prefetchInterval;
+
+- (id)initWithFrame:(CGRect)frame
+{
+	if((self = [super initWithFrame:frame])) {
+		tileSize = CGSizeMake(256, 256);
+		visibleMargin = 128;
+		prefetchInterval = 0.25;
+		_tiles = [[NSMutableDictionary alloc] init];
+		_reusableTiles = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (NSUInteger)tileCount
+{
+	return [_tiles count];
+}
+
+- (void)_invalidateTileLayout
+{
+	_tiledSize = CGSizeZero;
+	[self.layer setNeedsDisplay];
+}
+
+- (void)setTileSize:(CGSize)s
+{
+	tileSize = CGSizeMake(MAX(s.width, 1), MAX(s.height, 1));
+	[self _invalidateTileLayout];
+}
+
+- (void)setVisibleMargin:(CGFloat)m
+{
+	visibleMargin = m;
+	[self.layer setNeedsDisplay];
+}
+
+#pragma mark Scrolling
+
+- (void)_scrollViewDidScroll:(NSNotification *)notification
+{
+	[self _updateTiles];
+}
+
+- (void)_updateScrollViewObservation
+{
+	TUIScrollView *scrollView = (TUIScrollView *)[self.superview firstSuperviewOfClass:[TUIScrollView class]];
+	if(self.nsView == nil)
+		scrollView = nil;
+
+	if(scrollView != _observedScrollView) {
+		if(_observedScrollView != nil) {
+			[[NSNotificationCenter defaultCenter] removeObserver:self name:TUIScrollViewDidScrollNotification object:_observedScrollView];
+			[_observedScrollView endPostingDidScrollNotifications];
+		}
+		_observedScrollView = scrollView;
+		if(_observedScrollView != nil) {
+			[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_scrollViewDidScroll:) name:TUIScrollViewDidScrollNotification object:_observedScrollView];
+			[_observedScrollView beginPostingDidScrollNotifications];
+		}
+	}
+	[self.layer setNeedsDisplay];
+}
+
+- (void)didMoveToWindow
+{
+	[super didMoveToWindow];
+	[self _updateScrollViewObservation];
+}
+
+- (void)didMoveToSuperview
+{
+	[super didMoveToSuperview];
+	[self _updateScrollViewObservation];
+}
+
+#pragma mark Tiles
+
+/**
+ * @brief The part of the view that shows through all of its ancestors, or CGRectNull
+ */
+- (CGRect)_visibleTileRect
+{
+	if(self.nsView == nil)
+		return CGRectNull;
+
+	CGRect r = self.bounds;
+	TUIView *v = self;
+	for(TUIView *superview = self.superview; superview != nil; superview = superview.superview) {
+		r = CGRectIntersection([v convertRect:r toView:superview], superview.bounds);
+		if(CGRectIsEmpty(r))
+			return CGRectNull;
+		v = superview;
+	}
+	return [self convertRect:r fromView:v];
+}
+
+- (BOOL)_drawsTiles
+{
+	return self.drawRect != nil || [self methodForSelector:@selector(drawRect:)] != [TUIView instanceMethodForSelector:@selector(drawRect:)];
+}
+
+- (void)_recycleTile:(TUITiledViewTile *)tile
+{
+	tile->generation++;
+	tile->needsDisplay = NO;
+	[[TUIDrawScheduler sharedScheduler] cancelDrawForTarget:tile];
+	[tile->layer removeFromSuperlayer];
+	tile->layer.contents = nil;
+	if([_reusableTiles count] < TUITiledViewMaximumReusableTiles)
+		[_reusableTiles addObject:tile];
+}
+
+- (void)_recycleAllTiles
+{
+	for(TUITiledViewTile *tile in [_tiles allValues])
+		[self _recycleTile:tile];
+	[_tiles removeAllObjects];
+}
+
+- (TUITiledViewTile *)_dequeueTile
+{
+	TUITiledViewTile *tile = [_reusableTiles lastObject];
+	if(tile != nil) {
+		[_reusableTiles removeLastObject];
+		return tile;
+	}
+
+	tile = [[TUITiledViewTile alloc] init];
+	tile->layer = [CALayer layer];
+	tile->layer.actions = [NSDictionary dictionaryWithObjectsAndKeys:
+						   [NSNull null], @"position",
+						   [NSNull null], @"bounds",
+						   [NSNull null], @"contents",
+						   nil];
+	return tile;
+}
+
+/**
+ * @brief Render a tile on the draw scheduler and hand the image to its layer on the main thread
+ */
+- (void)_scheduleDrawForTile:(TUITiledViewTile *)tile priority:(TUIDrawPriority)priority
+{
+	typedef void (*DrawRectIMP)(id,SEL,CGRect);
+	SEL drawRectSEL = @selector(drawRect:);
+	DrawRectIMP drawRectIMP = (DrawRectIMP)[self methodForSelector:drawRectSEL];
+	TUIViewDrawRect drawRectBlock = self.drawRect;
+	NSUInteger generation = tile->generation;
+	CGRect rect = tile->rect;
+	CGFloat scale = _tileScale;
+	BOOL smoothFonts = !_viewFlags.disableSubpixelTextRendering;
+
+	tile->needsDisplay = NO;
+
+	[[TUIDrawScheduler sharedScheduler] scheduleDrawForTarget:tile priority:priority block:^BOOL{
+		if(tile->generation != generation)
+			return NO;
+
+		size_t width = (size_t)ceil(rect.size.width * scale);
+		size_t height = (size_t)ceil(rect.size.height * scale);
+		CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+		CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+		CGColorSpaceRelease(colorSpace);
+
+		CGContextScaleCTM(context, scale, scale);
+		CGContextTranslateCTM(context, -rect.origin.x, -rect.origin.y);
+		CGContextClipToRect(context, rect);
+		CGContextSetShouldSmoothFonts(context, smoothFonts);
+		TUIGraphicsPushContext(context);
+		if(drawRectBlock)
+			drawRectBlock(self, rect);
+		else
+			drawRectIMP(self, drawRectSEL, rect);
+		TUIGraphicsPopContext();
+
+		CGImageRef image = CGBitmapContextCreateImage(context);
+		CGContextRelease(context);
+
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if(tile->generation == generation)
+				tile->layer.contents = (__bridge id)image;
+			CGImageRelease(image);
+		});
+		return tile->generation == generation;
+	}];
+}
+
+- (void)_updateTiles
+{
+	CGRect b = self.bounds;
+	CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+	if(!CGSizeEqualToSize(b.size, _tiledSize) || fabs(scale - _tileScale) > 0.1f) {
+		[self _recycleAllTiles];
+		_tiledSize = b.size;
+		_tileScale = scale;
+	}
+
+	CGRect visible = [self _visibleTileRect];
+	if(CGRectIsNull(visible) || ![self _drawsTiles]) {
+		[self _recycleAllTiles];
+		return;
+	}
+
+	// everything near what's visible, and whatever the current scroll will bring into view soon
+	CGRect wanted = CGRectInset(visible, -visibleMargin, -visibleMargin);
+	if(_observedScrollView != nil) {
+		CGPoint velocity = _observedScrollView.scrollVelocity;
+		wanted = CGRectUnion(wanted, CGRectOffset(visible, velocity.x * prefetchInterval, velocity.y * prefetchInterval));
+	}
+	wanted = CGRectIntersection(wanted, b);
+	if(CGRectIsEmpty(wanted)) {
+		[self _recycleAllTiles];
+		return;
+	}
+
+	NSInteger firstColumn = floor((CGRectGetMinX(wanted) - b.origin.x) / tileSize.width);
+	NSInteger lastColumn = ceil((CGRectGetMaxX(wanted) - b.origin.x) / tileSize.width) - 1;
+	NSInteger firstRow = floor((CGRectGetMinY(wanted) - b.origin.y) / tileSize.height);
+	NSInteger lastRow = ceil((CGRectGetMaxY(wanted) - b.origin.y) / tileSize.height) - 1;
+
+	for(NSNumber *key in [_tiles allKeys]) {
+		unsigned long long packed = [key unsignedLongLongValue];
+		NSInteger row = (NSInteger)(packed >> 32);
+		NSInteger column = (NSInteger)(packed & 0xffffffff);
+		if(row < firstRow || row > lastRow || column < firstColumn || column > lastColumn) {
+			[self _recycleTile:[_tiles objectForKey:key]];
+			[_tiles removeObjectForKey:key];
+		}
+	}
+
+	for(NSInteger row = firstRow; row <= lastRow; ++row) {
+		for(NSInteger column = firstColumn; column <= lastColumn; ++column) {
+			NSNumber *key = [NSNumber numberWithUnsignedLongLong:((unsigned long long)row << 32) | (unsigned long long)column];
+			TUITiledViewTile *tile = [_tiles objectForKey:key];
+			if(tile == nil) {
+				tile = [self _dequeueTile];
+				tile->rect = CGRectIntersection(CGRectMake(b.origin.x + column * tileSize.width, b.origin.y + row * tileSize.height, tileSize.width, tileSize.height), b);
+				tile->needsDisplay = YES;
+				tile->layer.frame = tile->rect;
+				if([tile->layer respondsToSelector:@selector(setContentsScale:)])
+					tile->layer.contentsScale = scale;
+				[self.layer insertSublayer:tile->layer atIndex:0]; // below the subviews
+				[_tiles setObject:tile forKey:key];
+			}
+			if(tile->needsDisplay)
+				[self _scheduleDrawForTile:tile priority:CGRectIntersectsRect(tile->rect, visible) ? TUIDrawPriorityHigh : TUIDrawPriorityLow];
+		}
+	}
+}
+
+#pragma mark TUIView
+
+- (void)setNeedsDisplay
+{
+	for(TUITiledViewTile *tile in [_tiles allValues]) {
+		tile->generation++;
+		tile->needsDisplay = YES;
+	}
+	[self.layer setNeedsDisplay];
+}
+
+- (void)setNeedsDisplayInRect:(CGRect)rect
+{
+	for(TUITiledViewTile *tile in [_tiles allValues]) {
+		if(CGRectIntersectsRect(tile->rect, rect)) {
+			tile->generation++;
+			tile->needsDisplay = YES;
+		}
+	}
+	[self.layer setNeedsDisplay];
+}
+
+- (void)displayLayer:(CALayer *)layer
+{
+	// never one big bitmap: this just brings the tiles up to date
+	if(_viewFlags.delegateWillDisplayLayer)
+		[self.viewDelegate viewWillDisplayLayer:self];
+	[self _updateTiles];
+}
+
+- (void)layoutSubviews
+{
+	[super layoutSubviews];
+	[self _updateTiles];
+}
+
+@end
@@ -98,7 +98,7 @@
 			return textRenderer;
 		}
 		
-		NSArray *s = [self sortedSubviews];
+		NSArray *s = [self _subviewsForHitTestAtPoint:point];
 		for(TUIView *v in [s reverseObjectEnumerator]) {
 			TUIView *hit = [v accessibilityHitTest:[self convertPoint:point toView:v]];
 			if(hit)
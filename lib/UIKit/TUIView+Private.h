@@ -17,6 +17,17 @@
 #import "TUIView.h"
 #import "TUITextRenderer.h"
 
+extern void TUIViewDirtyRegionAddRect(TUIViewDirtyRegion *region, CGRect r);
+
+/**
+ Bumped (on the main thread) whenever something that can change the result of a
+ hit test changes: views added or removed, frames, bounds, transforms, scrolling,
+ hidden, alpha or userInteractionEnabled.  Cached hit test results are good for as
+ long as it stays the same.
+ */
+extern NSUInteger TUIViewHitTestingGeneration;
+#define TUIViewHitTestingDidChange() (TUIViewHitTestingGeneration++)
+
 @interface TUIView (Private)
 
 @property (nonatomic, retain) NSArray *textRenderers;
@@ -24,5 +35,8 @@
 - (TUITextRenderer *)textRendererAtPoint:(CGPoint)point;
 
 - (void)_updateLayerScaleFactor;
+- (NSArray *)_subviewsForHitTestAtPoint:(CGPoint)point; // back to front, not a copy
+
+- (void)_purgeBackingStore; // give the bitmaps back to the pool, the view displays again once it's shown
 
 @end
@@ -66,12 +66,47 @@ typedef enum {
 @class TUINSWindow;
 
 typedef void(^TUIViewDrawRect)(TUIView *, CGRect);
+
+#define TUIViewMaximumDirtyRects 4
+
+/**
+ Parts of a view needing display: a few rects, merged when that's cheaper than keeping them apart
+ */
+typedef struct {
+	BOOL       everything; // the whole view, regardless of rects
+	NSUInteger count;      // 0 also means the whole view
+	CGRect     rects[TUIViewMaximumDirtyRects];
+} TUIViewDirtyRegion;
+
+/**
+ What flattening a subtree saves; see -flatteningStatistics
+ */
+typedef struct {
+	NSUInteger layersSaved;  // descendants drawn into the flattened bitmap rather than composited on their own
+	NSUInteger bytesSaved;   // backing stores those descendants would otherwise hold
+	NSUInteger cacheBytes;   // the flattened bitmap
+} TUIViewFlatteningStatistics;
 typedef CGRect(^TUIViewLayout)(TUIView *);
 
 extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 
 @protocol TUIViewDelegate;
 
+/**
+ What a view looked like when it was asked to display, captured on the main
+ thread for +drawSnapshot:inRect:.  Nothing in it changes after capture, so it can
+ be drawn on any thread.
+ */
+@interface TUIViewSnapshot : NSObject
+
+@property (nonatomic, readonly) CGRect bounds;
+@property (nonatomic, readonly, getter=isOpaque) BOOL opaque;
+@property (nonatomic, readonly) CGFloat contentsScale;
+@property (nonatomic, readonly, strong) TUIColor *backgroundColor;
+@property (nonatomic, readonly, strong) id contents; // from -snapshotContents
+
+@end
+
 /**
  Root view class
  */
@@ -100,10 +135,20 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 		NSInteger lastWidth;
 		NSInteger lastHeight;
 		BOOL lastOpaque;
-		CGContextRef context;
-		CGRect dirtyRect;
+		TUIViewDirtyRegion dirtyRegion;
 		CGFloat lastContentsScale;
+		TUIViewDirtyRegion backgroundDirtyRegion; // waiting for a background draw to pick it up
+		NSUInteger drawGeneration; // bumped by every background draw request; older results are dropped
+		NSUInteger displayListGeneration; // bumped when the display list is thrown away
+		CFAbsoluteTime lastDisplayTime;
+		BOOL idleCheckScheduled; // spare backing store buffers go back to the pool once idle
+		BOOL backingStorePurged; // contents dropped while hidden or out of a window, display again when shown
 	} _context;
+	id _backingStore; // TUIBackingStore
+	id _displayList; // TUIViewDisplayList, when recordsDisplayList is set
+	NSMutableArray *_sortedSubviews; // back to front by zPosition, nil until needed
+	id _subviewIndex; // TUIViewSubviewIndex, spatial buckets for hit testing views with many subviews
+	TUIColor *_flattenedBackgroundColor; // held here instead of on the layer while an ancestor draws this view
 	
 	struct {
 		unsigned int userInteractionDisabled:1;
@@ -118,6 +163,9 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 		unsigned int clearsContextBeforeDrawing:1;
 		unsigned int drawInBackground:1;
 		unsigned int needsDisplayWhenWindowsKeyednessChanges:1;
+		unsigned int flattensSubtree:1;
+		unsigned int flattened:1; // drawn into an ancestor with flattensSubtree set
+		unsigned int recordsDisplayList:1;
 		
 		unsigned int delegateMouseEntered:1;
 		unsigned int delegateMouseExited:1;
@@ -188,7 +236,7 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 @property (nonatomic, assign) TUIViewContentMode contentMode;
 
 /**
- If YES, drawing will be done in a background queue. If `drawQueue` is nil, it will be performed in the DISPATCH_QUEUE_PRIORITY_DEFAULT global queue. Note that `-viewWillDisplayLayer:` will still be called on the main thread.
+ If YES, drawing will be done in a background queue. If `drawQueue` is nil, it will be scheduled by the shared TUIDrawScheduler: onscreen views are drawn first, repeated requests are coalesced and results that are out of date by the time they finish are dropped. Note that `-viewWillDisplayLayer:` will still be called on the main thread.
  
  Defaults to NO.
  */
@@ -272,6 +320,9 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 - (CGSize)sizeThatFits:(CGSize)size;
 - (void)sizeToFit;                       // calls sizeThatFits: with current view bounds and changes bounds size.
 
+/**
+ Subviews in back to front order (by layer zPosition, then subview order).  Kept up to date as subviews are added and removed and repaired in place when zPositions change, rather than sorted on every call.
+ */
 - (NSArray *)sortedSubviews;
 
 @end
@@ -347,6 +398,21 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
  */
 - (void)drawRect:(CGRect)rect;
 
+/**
+ Opt-in thread-safe drawing.  Subclasses that override this (instead of -drawRect:) are drawn from a snapshot taken on the main thread rather than from the live view, so with drawInBackground many of them can be rasterized in parallel while the main thread keeps changing them.  Draw into TUIGraphicsGetCurrentContext() and don't touch the view.  The default fills the bounds with the background color.
+ */
++ (void)drawSnapshot:(TUIViewSnapshot *)snapshot inRect:(CGRect)rect;
+
+/**
+ Called on the main thread, for views whose class overrides +drawSnapshot:inRect:, each time the view displays.  Return an immutable copy of whatever that drawing needs beyond the bounds, scale and background color (text, images, state).  Default returns nil.
+ */
+- (id)snapshotContents;
+
+/**
+ When YES, the view's drawing is recorded into a resolution-independent display list (a PDF page: paths, images, text runs and state changes) and the bitmap is rendered from that.  When the backing scale changes, such as moving between Retina and non-Retina displays, the list is replayed into a new bitmap without calling back into -drawRect:, and with drawInBackground the replay runs off the main thread.  -setNeedsDisplay records the list again in full; -setNeedsDisplayInRect: records only the invalidated rects and replays them over the rest, until enough of those pile up that the next one records the whole view again.  Default is NO.
+ */
+@property (nonatomic, assign) BOOL recordsDisplayList;
+
 /**
  Marks the view as needing display, will happen before the next run loop cycle
  */
@@ -358,6 +424,16 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
  */
 - (void)setEverythingNeedsDisplay;
 
+/**
+ When YES, the view's descendants are drawn into the view's own bitmap, back to front with their background colors, alpha and transforms, and their layers keep no contents or background of their own.  The bitmap is drawn again only when a descendant needs display, moves, resizes, is shown, hidden or faded, or a subview is added or removed, so it suits mostly static hierarchies like table cells with a handful of labels and images.  Descendants are drawn clipped to the view's bounds, always on the main thread, and a descendant with flattensSubtree set is drawn into this view too.  Events and hit testing still go to the subviews.  Default is NO.
+ */
+@property (nonatomic, assign) BOOL flattensSubtree;
+
+/**
+ Layers and bytes saved by flattensSubtree, given the subtree as it is now.  Zeroes if flattensSubtree is NO.
+ */
+- (TUIViewFlatteningStatistics)flatteningStatistics;
+
 /**
  When YES, content and subviews are clipped to the bounds of the view. Default is NO.
  */
@@ -18,6 +18,8 @@
 #import "TUIKit.h"
 #import "TUIView+Private.h"
 #import "TUIViewController.h"
+#import "TUIBackingStore.h"
+#import "TUIDrawScheduler.h"
 
 NSString * const TUIViewWillMoveToWindowNotification = @"TUIViewWillMoveToWindowNotification";
 NSString * const TUIViewDidMoveToWindowNotification = @"TUIViewDidMoveToWindowNotification";
@@ -25,6 +27,8 @@ NSString * const TUIViewWindow = @"TUIViewWindow";
 
 CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 
+NSUInteger TUIViewHitTestingGeneration = 0;
+
 @class TUIViewController;
 
 @interface CALayer (TUIViewAdditions)
@@ -55,8 +59,254 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 @end
 
 
+#define TUIViewDisplayListMaximumRecordings 8 // partial recordings kept before recording the whole view again
+
+/**
+ One page of a display list: the whole view, or just the rects that were invalidated.
+ */
+@interface TUIViewDisplayListRecording : NSObject
+{
+@public
+	CGPDFDocumentRef document;
+	TUIViewDirtyRegion region; // no rects for the whole view
+	BOOL clears; // clearsContextBeforeDrawing when it was recorded
+}
+- (id)initWithSize:(CGSize)s region:(const TUIViewDirtyRegion *)r clearsContext:(BOOL)c drawing:(void(^)(CGRect))draw;
+@end
+
+@implementation TUIViewDisplayListRecording
+
+- (id)initWithSize:(CGSize)s region:(const TUIViewDirtyRegion *)r clearsContext:(BOOL)c drawing:(void(^)(CGRect))draw
+{
+	if((self = [super init])) {
+		CGRect mediaBox = CGRectMake(0, 0, s.width, s.height);
+		CGRect rect = mediaBox;
+		if(r != NULL && !r->everything && r->count > 0) {
+			region = *r;
+			rect = CGRectNull;
+			for(NSUInteger i = 0; i < region.count; ++i)
+				rect = CGRectUnion(rect, region.rects[i]);
+		}
+		clears = c;
+		
+		TUIViewDirtyRegion clip = region;
+		NSData *data = TUIGraphicsDrawAsPDF(&mediaBox, ^(CGContextRef ctx) {
+			if(clip.count > 0)
+				CGContextClipToRects(ctx, clip.rects, clip.count);
+			draw(rect);
+		});
+		CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)data);
+		document = CGPDFDocumentCreateWithProvider(provider);
+		CGDataProviderRelease(provider);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	CGPDFDocumentRelease(document);
+}
+
+@end
+
+/**
+ A view's drawing kept as one page PDFs, so it can be rendered again at any scale.
+ The first recording covers the whole view; each one after it covers only the rects
+ invalidated since, and is replayed over the ones before clipped to those rects, the
+ same way the backing store is painted.  Never changed once made, so a background
+ draw can replay one while the main thread moves on.
+ */
+@interface TUIViewDisplayList : NSObject
+{
+	CGSize size;
+	NSArray *recordings; // TUIViewDisplayListRecording, oldest first
+}
+- (id)initWithSize:(CGSize)s drawing:(void(^)(CGRect))draw;
+- (TUIViewDisplayList *)displayListByRecordingRegion:(const TUIViewDirtyRegion *)region clearsContext:(BOOL)clears drawing:(void(^)(CGRect))draw;
+@property (nonatomic, readonly) CGSize size;
+- (void)drawInContext:(CGContextRef)ctx;
+@end
+
+@implementation TUIViewDisplayList
+
+@synthesize size;
+
+- (id)initWithSize:(CGSize)s recordings:(NSArray *)r
+{
+	if((self = [super init])) {
+		size = s;
+		recordings = r;
+	}
+	return self;
+}
+
+- (id)initWithSize:(CGSize)s drawing:(void(^)(CGRect))draw
+{
+	TUIViewDisplayListRecording *recording = [[TUIViewDisplayListRecording alloc] initWithSize:s region:NULL clearsContext:NO drawing:draw];
+	return [self initWithSize:s recordings:[NSArray arrayWithObject:recording]];
+}
+
+- (TUIViewDisplayList *)displayListByRecordingRegion:(const TUIViewDirtyRegion *)region clearsContext:(BOOL)clears drawing:(void(^)(CGRect))draw
+{
+	// past a few the replays cost more than drawing the whole view once
+	if([recordings count] >= TUIViewDisplayListMaximumRecordings)
+		return [[TUIViewDisplayList alloc] initWithSize:size drawing:draw];
+	
+	TUIViewDisplayListRecording *recording = [[TUIViewDisplayListRecording alloc] initWithSize:size region:region clearsContext:clears drawing:draw];
+	return [[TUIViewDisplayList alloc] initWithSize:size recordings:[recordings arrayByAddingObject:recording]];
+}
+
+- (void)drawInContext:(CGContextRef)ctx
+{
+	for(TUIViewDisplayListRecording *recording in recordings) {
+		CGPDFPageRef page = CGPDFDocumentGetPage(recording->document, 1);
+		if(!page)
+			continue;
+		if(recording->region.count > 0) {
+			CGContextSaveGState(ctx);
+			CGContextClipToRects(ctx, recording->region.rects, recording->region.count);
+			if(recording->clears)
+				CGContextClearRect(ctx, CGRectMake(0, 0, size.width, size.height));
+			CGContextDrawPDFPage(ctx, page);
+			CGContextRestoreGState(ctx);
+		} else {
+			CGContextDrawPDFPage(ctx, page);
+		}
+	}
+}
+
+@end
+
+@interface TUIViewSnapshot ()
+- (id)initWithBounds:(CGRect)b opaque:(BOOL)o contentsScale:(CGFloat)scale backgroundColor:(TUIColor *)color contents:(id)c;
+@end
+
+@implementation TUIViewSnapshot
+
+@synthesize bounds;
+@synthesize opaque;
+@synthesize contentsScale;
+@synthesize backgroundColor;
+@synthesize contents;
+
+- (id)initWithBounds:(CGRect)b opaque:(BOOL)o contentsScale:(CGFloat)scale backgroundColor:(TUIColor *)color contents:(id)c
+{
+	if((self = [super init])) {
+		bounds = b;
+		opaque = o;
+		contentsScale = scale;
+		backgroundColor = color;
+		contents = c;
+	}
+	return self;
+}
+
+@end
+
+#define TUIViewSubviewIndexMinimumCount 32 // fewer subviews than this are just scanned
+
+static NSUInteger TUIViewSubviewIndexCount = 0; // indexes alive, main thread only; while there are none, moving a view needn't look up its superview
+
+/**
+ Buckets a view's subviews on a grid by frame, so hit testing only has to look at
+ the subviews overlapping the grid cell under the point.  Built lazily and thrown
+ away whenever a subview is added, removed, reordered or moved.
+ */
+@interface TUIViewSubviewIndex : NSObject
+{
+	CGRect          rect;       // union of the indexed frames
+	NSUInteger      columns;
+	NSUInteger      rows;
+	CGFloat         cellWidth;
+	CGFloat         cellHeight;
+	NSMutableArray *buckets;    // columns * rows arrays of subviews, back to front
+	NSMutableArray *everywhere; // autoresizing subviews, whose frames change without telling us
+}
+- (id)initWithSortedSubviews:(NSArray *)sortedSubviews;
+- (NSArray *)subviewsAtPoint:(CGPoint)point;
+@end
+
+@implementation TUIViewSubviewIndex
+
+- (id)initWithSortedSubviews:(NSArray *)sortedSubviews
+{
+	if((self = [super init])) {
+		TUIViewSubviewIndexCount++;
+		NSUInteger count = [sortedSubviews count];
+		rect = CGRectNull;
+		everywhere = [[NSMutableArray alloc] init];
+		for(TUIView *v in sortedSubviews) {
+			if(v.autoresizingMask == TUIViewAutoresizingNone)
+				rect = CGRectUnion(rect, v.frame);
+		}
+		
+		if(CGRectIsNull(rect) || rect.size.width <= 0.0 || rect.size.height <= 0.0) {
+			[everywhere addObjectsFromArray:sortedSubviews];
+			return self;
+		}
+		
+		// about two subviews per cell, shaped after the indexed area (a table ends up as a single column of rows)
+		NSUInteger cells = MAX(count / 2, 1);
+		columns = MIN(MAX((NSUInteger)round(sqrt(cells * rect.size.width / rect.size.height)), 1), cells);
+		rows = (cells + columns - 1) / columns;
+		cellWidth = rect.size.width / columns;
+		cellHeight = rect.size.height / rows;
+		
+		buckets = [[NSMutableArray alloc] initWithCapacity:columns * rows];
+		for(NSUInteger i = 0; i < columns * rows; ++i)
+			[buckets addObject:[NSMutableArray array]];
+		
+		for(TUIView *v in sortedSubviews) {
+			if(v.autoresizingMask != TUIViewAutoresizingNone) {
+				[everywhere addObject:v];
+				[buckets makeObjectsPerformSelector:@selector(addObject:) withObject:v];
+				continue;
+			}
+			CGRect f = v.frame;
+			NSUInteger firstColumn = MIN((NSUInteger)((CGRectGetMinX(f) - rect.origin.x) / cellWidth), columns - 1);
+			NSUInteger lastColumn = MIN((NSUInteger)((CGRectGetMaxX(f) - rect.origin.x) / cellWidth), columns - 1);
+			NSUInteger firstRow = MIN((NSUInteger)((CGRectGetMinY(f) - rect.origin.y) / cellHeight), rows - 1);
+			NSUInteger lastRow = MIN((NSUInteger)((CGRectGetMaxY(f) - rect.origin.y) / cellHeight), rows - 1);
+			for(NSUInteger row = firstRow; row <= lastRow; ++row) {
+				for(NSUInteger column = firstColumn; column <= lastColumn; ++column)
+					[[buckets objectAtIndex:row * columns + column] addObject:v];
+			}
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	TUIViewSubviewIndexCount--;
+}
+
+- (NSArray *)subviewsAtPoint:(CGPoint)point
+{
+	if(buckets == nil || !CGRectContainsPoint(rect, point))
+		return everywhere;
+	NSUInteger column = MIN((NSUInteger)((point.x - rect.origin.x) / cellWidth), columns - 1);
+	NSUInteger row = MIN((NSUInteger)((point.y - rect.origin.y) / cellHeight), rows - 1);
+	return [buckets objectAtIndex:row * columns + column];
+}
+
+@end
+
 @interface TUIView ()
 @property (nonatomic, strong) NSMutableArray *subviews;
+- (void)_cancelBackgroundDraw;
+- (void)_cancelBackgroundDrawsInSubtree;
+- (void)_subviewGeometryDidChange;
+- (void)_geometryDidChange;
+- (void)_setFlattened:(BOOL)f;
+- (TUIView *)_flatteningRoot;
+- (void)_flattenedContentDidChange;
+- (void)_drawFlattenedSubviewsInContext:(CGContextRef)ctx;
+- (void)_invalidateDisplayList;
+- (void)_setNeedsRedisplay;
+- (BOOL)_isHiddenInHierarchy;
+- (void)_restorePurgedBackingStores;
+- (void)_noteBackingStoresHiddenInSubtree;
 @end
 
 @implementation TUIView
@@ -104,12 +354,10 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 
 - (void)dealloc
 {
+	if(_viewFlags.drawInBackground)
+		[[TUIDrawScheduler sharedScheduler] cancelDrawForTarget:self];
 	[self setTextRenderers:nil];
 	_layer.delegate = nil;
-	if(_context.context) {
-		CGContextRelease(_context.context);
-		_context.context = NULL;
-	}
 }
 
 - (id)initWithFrame:(CGRect)frame
@@ -164,6 +412,7 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 - (void)setUserInteractionEnabled:(BOOL)b
 {
 	_viewFlags.userInteractionDisabled = !b;
+	TUIViewHitTestingDidChange();
 }
 
 - (BOOL)moveWindowByDragging
@@ -248,7 +497,20 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 	return NO;
 }
 
-- (CGContextRef)_CGContext
+/**
+ * @brief Bounding rect of a dirty region, or @p bounds if it covers the whole view
+ */
+static CGRect TUIViewDirtyRegionGetBounds(TUIViewDirtyRegion *region, CGRect bounds)
+{
+	if(region->everything || region->count == 0)
+		return bounds;
+	CGRect r = CGRectNull;
+	for(NSUInteger i = 0; i < region->count; ++i)
+		r = CGRectUnion(r, region->rects[i]);
+	return r;
+}
+
+- (TUIBackingStore *)_backingStore
 {
 	CGRect b = self.bounds;
 	NSInteger w = b.size.width;
@@ -256,19 +518,18 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 	BOOL o = self.opaque;
 	CGFloat currentScale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
 	
-	if(_context.context) {
+	if(_backingStore) {
 		// kill if we're a different size
 		if(w != _context.lastWidth || 
 		   h != _context.lastHeight ||
 		   o != _context.lastOpaque ||
 		   fabs(currentScale - _context.lastContentsScale) > 0.1f) 
 		{
-			CGContextRelease(_context.context);
-			_context.context = NULL;
+			_backingStore = nil;
 		}
 	}
 	
-	if(!_context.context) {
+	if(!_backingStore) {
 		// create a new context with the correct parameters
 		_context.lastWidth = w;
 		_context.lastHeight = h;
@@ -279,15 +540,184 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 		b.size.height *= currentScale;
 		if(b.size.width < 1) b.size.width = 1;
 		if(b.size.height < 1) b.size.height = 1;
-		CGContextRef ctx = TUICreateGraphicsContextWithOptions(b.size, o);
-		_context.context = ctx;
+		_backingStore = [[TUIBackingStore alloc] initWithPixelWidth:b.size.width height:b.size.height opaque:o scale:currentScale];
+	}
+	
+	return _backingStore;
+}
+
+/**
+ * @brief Add every rect of @p other to @p region
+ * 
+ * A region with no rects that isn't marked as everything stands for a full redraw, as in -displayLayer:.
+ */
+static void TUIViewDirtyRegionUnion(TUIViewDirtyRegion *region, const TUIViewDirtyRegion *other)
+{
+	if(region->everything)
+		return;
+	if(other->everything || other->count == 0) {
+		region->everything = YES;
+		region->count = 0;
+		return;
+	}
+	for(NSUInteger i = 0; i < other->count; ++i)
+		TUIViewDirtyRegionAddRect(region, other->rects[i]);
+}
+
+/**
+ * @brief Whether any part of the view shows in its TUINSView, for draw priority
+ */
+- (BOOL)_isOnscreenForDrawing
+{
+	if(_nsView == nil || self.hidden)
+		return NO;
+	
+	CGRect r = self.frame;
+	for(TUIView *v = self.superview; v != nil; v = v.superview) {
+		if(v.hidden)
+			return NO;
+		CGRect b = v.bounds;
+		r = CGRectIntersection(r, b);
+		if(CGRectIsEmpty(r))
+			return NO;
+		CGRect f = v.frame;
+		r = CGRectOffset(r, f.origin.x - b.origin.x, f.origin.y - b.origin.y);
+	}
+	return CGRectIntersectsRect(r, [_nsView visibleRect]);
+}
+
+/**
+ * @brief Stop a background draw that hasn't started yet, and drop the result of one that has
+ * 
+ * The dirty region stays put for the next draw, which happens once the view can be
+ * seen again.
+ */
+- (void)_cancelBackgroundDraw
+{
+	@synchronized(self) {
+		_context.drawGeneration++;
+	}
+	[[TUIDrawScheduler sharedScheduler] cancelDrawForTarget:self];
+	_context.backingStorePurged = YES;
+}
+
+/**
+ * @brief Cancel background draws for this view and every view under it
+ * 
+ * For when the subtree is hidden or taken out of the hierarchy, so nothing is drawn that can't be seen.
+ */
+- (void)_cancelBackgroundDrawsInSubtree
+{
+	if(_viewFlags.drawInBackground)
+		[self _cancelBackgroundDraw];
+	for(TUIView *subview in self.subviews)
+		[subview _cancelBackgroundDrawsInSubtree];
+}
+
+#define TUIViewBackingStoreIdleInterval 2.0
+
+/**
+ * @brief Once the view hasn't displayed for a while, give back backing store buffers it isn't showing
+ */
+- (void)_backingStoreIdleCheck
+{
+	_context.idleCheckScheduled = NO;
+	if(_backingStore == nil)
+		return;
+	
+	NSTimeInterval idle = CFAbsoluteTimeGetCurrent() - _context.lastDisplayTime;
+	if(idle < TUIViewBackingStoreIdleInterval) {
+		_context.idleCheckScheduled = YES;
+		[self performSelector:@selector(_backingStoreIdleCheck) withObject:nil afterDelay:TUIViewBackingStoreIdleInterval - idle];
+	} else if(_nsView == nil || [self _isHiddenInHierarchy]) {
+		[self _purgeBackingStore];
+	} else {
+		[(TUIBackingStore *)_backingStore releaseSpareBuffers];
 	}
+}
+
+- (BOOL)_isHiddenInHierarchy
+{
+	for(TUIView *v = self; v != nil; v = v.superview) {
+		if(v.hidden)
+			return YES;
+	}
+	return NO;
+}
+
+/**
+ * @brief Drop the backing store and the layer's contents
+ * 
+ * For views nobody can see.  The bitmaps go back to the pool right away (or as soon as
+ * Core Animation lets go of them), and the view displays from scratch once it's shown again.
+ */
+- (void)_purgeBackingStore
+{
+	if(_backingStore == nil)
+		return;
 	
-	return _context.context;
+	if(_viewFlags.drawInBackground)
+		[self _cancelBackgroundDraw];
+	_backingStore = nil;
+	self.layer.contents = nil;
+	_context.backingStorePurged = YES;
+}
+
+/**
+ * @brief Display views under this one whose backing stores were purged, now that they may be seen
+ */
+- (void)_restorePurgedBackingStores
+{
+	if(self.hidden)
+		return;
+	
+	if(_context.backingStorePurged) {
+		_context.backingStorePurged = NO;
+		[self _setNeedsRedisplay];
+	}
+	for(TUIView *subview in self.subviews)
+		[subview _restorePurgedBackingStores];
+}
+
+- (void)_noteBackingStoreUse
+{
+	_context.lastDisplayTime = CFAbsoluteTimeGetCurrent();
+	if(!_context.idleCheckScheduled) {
+		_context.idleCheckScheduled = YES;
+		[self performSelector:@selector(_backingStoreIdleCheck) withObject:nil afterDelay:TUIViewBackingStoreIdleInterval];
+	}
+}
+
+/**
+ * @brief Start the idle interval over for backing stores under this view, now that it's hidden
+ * 
+ * A hidden view doesn't display, so the interval runs from the moment it was hidden
+ * and -_backingStoreIdleCheck purges whatever is still hidden once it's up.
+ */
+- (void)_noteBackingStoresHiddenInSubtree
+{
+	if(_backingStore != nil)
+		[self _noteBackingStoreUse];
+	for(TUIView *subview in self.subviews)
+		[subview _noteBackingStoresHiddenInSubtree];
 }
 
 - (void)displayLayer:(CALayer *)layer
 {
+	if(_viewFlags.flattened) {
+		// drawn by the flattening ancestor; whatever this display was for is its to redraw
+		layer.contents = nil;
+		if(_context.dirtyRegion.everything || _context.dirtyRegion.count == 0) {
+			[self setNeedsDisplay];
+		} else {
+			for(NSUInteger i = 0; i < _context.dirtyRegion.count; ++i)
+				[self setNeedsDisplayInRect:_context.dirtyRegion.rects[i]];
+		}
+		_context.dirtyRegion.everything = NO;
+		_context.dirtyRegion.count = 0;
+		return;
+	}
+	
 	if(_viewFlags.delegateWillDisplayLayer)
 		[_viewDelegate viewWillDisplayLayer:self];
 	
@@ -295,67 +725,190 @@ CGRect(^TUIViewCenteredLayout)(TUIView*) = nil;
 	SEL drawRectSEL = @selector(drawRect:);
 	DrawRectIMP drawRectIMP = (DrawRectIMP)[self methodForSelector:drawRectSEL];
 	DrawRectIMP dontCallThisBasicDrawRectIMP = (DrawRectIMP)[TUIView instanceMethodForSelector:drawRectSEL];
+	BOOL drawsSnapshot = [[self class] methodForSelector:@selector(drawSnapshot:inRect:)] != [TUIView methodForSelector:@selector(drawSnapshot:inRect:)];
+	
+	TUIViewDrawRect drawRectBlock = drawRect;
+	BOOL flattensSubtree = _viewFlags.flattensSubtree;
+	BOOL drawsRect = (drawRectIMP != dontCallThisBasicDrawRectIMP) && ![self _disableDrawRect];
+	if(!drawRectBlock && !drawsSnapshot && !drawsRect && !flattensSubtree) {
+		// drawRect isn't overridden by subclass, don't call, let the CA machinery just handle backgroundColor (fast path)
+		return;
+	}
 
 #if 0
 #define CA_COLOR_OVERLAY_DEBUG \
-if(self.opaque) CGContextSetRGBFillColor(context, 0, 1, 0, 0.3); \
+if(opaque) CGContextSetRGBFillColor(context, 0, 1, 0, 0.3); \
 else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context, b);
 #else
 #define CA_COLOR_OVERLAY_DEBUG
 #endif
 
+// the backing store keeps the last drawing, so only the dirty region (widened to whatever is
+// stale in the buffer being drawn into) needs to be repainted
 #define PRE_DRAW \
-	CGRect b = self.bounds; \
-	CGContextRef context = [self _CGContext]; \
+	TUIViewDirtyRegion region = dirtyRegion; \
+	TUIBackingStoreDrawing drawing = [backingStore beginDrawingInRegion:&region]; \
+	CGContextRef context = drawing.context; \
+	CGRect dirtyRect = TUIViewDirtyRegionGetBounds(&region, b); \
+	BOOL partial = !CGRectEqualToRect(dirtyRect, b); \
 	TUIGraphicsPushContext(context); \
-	if(_viewFlags.clearsContextBeforeDrawing) \
-		CGContextClearRect(context, b); \
-	CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f; \
+	CGContextSaveGState(context); \
 	CGContextScaleCTM(context, scale, scale); \
+	if(partial) \
+		CGContextClipToRects(context, region.rects, region.count); \
+	if(clearsContextBeforeDrawing) \
+		CGContextClearRect(context, dirtyRect); \
 	CGContextSetAllowsAntialiasing(context, true); \
 	CGContextSetShouldAntialias(context, true); \
-	CGContextSetShouldSmoothFonts(context, !_viewFlags.disableSubpixelTextRendering);
+	CGContextSetShouldSmoothFonts(context, smoothFonts);
 	
+// a background draw that has been superseded still finishes its buffer (the backing store
+// keeps track of what it drew) but doesn't get to show it
 #define POST_DRAW \
 	CA_COLOR_OVERLAY_DEBUG \
-	TUIImage *image = TUIGraphicsGetImageFromCurrentImageContext(); \
-	layer.contents = (id)image.CGImage; \
-	CGContextScaleCTM(context, 1.0f / scale, 1.0f / scale); \
+	CGContextRestoreGState(context); \
 	TUIGraphicsPopContext(); \
-	if(self.drawInBackground) [CATransaction flush];
-
-	CGRect rectToDraw = self.bounds;
-	if(!CGRectEqualToRect(_context.dirtyRect, CGRectZero)) {
-		rectToDraw = _context.dirtyRect;
-		_context.dirtyRect = CGRectZero;
+	CGImageRef image = [backingStore copyImageAndFinishDrawing:&drawing]; \
+	BOOL current = !background || generation == self->_context.drawGeneration; \
+	if(current) \
+		layer.contents = (__bridge id)image; \
+	CGImageRelease(image); \
+	if(background) [CATransaction flush]; \
+	return current;
+
+	// take the dirty region; anything invalidated from here on is for the next display
+	TUIViewDirtyRegion dirtyRegion = _context.dirtyRegion;
+	_context.dirtyRegion.everything = NO;
+	_context.dirtyRegion.count = 0;
+	
+	if(!dirtyRegion.everything && dirtyRegion.count > 0) {
+		// the bounds may have changed since the rects were added
+		NSUInteger count = 0;
+		for(NSUInteger i = 0; i < dirtyRegion.count; ++i) {
+			CGRect r = CGRectIntersection(dirtyRegion.rects[i], self.bounds);
+			if(!CGRectIsEmpty(r))
+				dirtyRegion.rects[count++] = r;
+		}
+		dirtyRegion.count = count;
 	}
 	
-	void (^drawBlock)(void) = ^{
-		if(drawRect) {
+	// everything the draw needs from the view is read here, on the main thread
+	CGRect b = self.bounds;
+	BOOL opaque = self.opaque;
+	CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+	BOOL clearsContextBeforeDrawing = _viewFlags.clearsContextBeforeDrawing;
+	BOOL smoothFonts = !_viewFlags.disableSubpixelTextRendering;
+	TUIBackingStore *backingStore = [self _backingStore];
+	[self _noteBackingStoreUse];
+	TUIViewSnapshot *snapshot = nil;
+	if(!drawRectBlock && drawsSnapshot)
+		snapshot = [[TUIViewSnapshot alloc] initWithBounds:b opaque:opaque contentsScale:scale backgroundColor:self.backgroundColor contents:[self snapshotContents]];
+	Class viewClass = [self class];
+	
+	void (^drawContent)(CGRect) = ^(CGRect rect) {
+		if(drawRectBlock) {
 			// drawRect is implemented via a block
-			PRE_DRAW
-			drawRect(self, rectToDraw);
-			POST_DRAW
-		} else if((drawRectIMP != dontCallThisBasicDrawRectIMP) && ![self _disableDrawRect]) {
+			drawRectBlock(self, rect);
+		} else if(snapshot) {
+			// drawn from the snapshot alone, safe on any thread
+			[viewClass drawSnapshot:snapshot inRect:rect];
+		} else if(drawsRect) {
 			// drawRect is overridden by subclass
-			PRE_DRAW
-			drawRectIMP(self, drawRectSEL, rectToDraw);
-			POST_DRAW
+			drawRectIMP(self, drawRectSEL, rect);
+		}
+		if(flattensSubtree)
+			[self _drawFlattenedSubviewsInContext:TUIGraphicsGetCurrentContext()];
+	};
+	
+	BOOL recordsDisplayList = _viewFlags.recordsDisplayList;
+	BOOL background = self.drawInBackground && !flattensSubtree; // descendants are live views, main thread only
+	BOOL (^drawBlock)(TUIViewDirtyRegion, NSUInteger) = ^BOOL(TUIViewDirtyRegion dirtyRegion, NSUInteger generation) {
+		// with a display list that's still good (only the scale changed, say) the view's drawing code isn't
+		// called at all, and invalidated rects are recorded on their own and replayed over the rest
+		TUIViewDisplayList *displayList = nil;
+		if(recordsDisplayList) {
+			NSUInteger displayListGeneration;
+			TUIViewDisplayList *previous;
+			@synchronized(self) {
+				previous = self->_displayList;
+				displayListGeneration = self->_context.displayListGeneration;
+			}
+			if(previous != nil && !CGSizeEqualToSize(previous.size, b.size))
+				previous = nil;
+			
+			if(previous == nil) {
+				displayList = [[TUIViewDisplayList alloc] initWithSize:b.size drawing:drawContent];
+				dirtyRegion.everything = YES;
+			} else if(!dirtyRegion.everything && dirtyRegion.count > 0) {
+				displayList = [previous displayListByRecordingRegion:&dirtyRegion clearsContext:clearsContextBeforeDrawing drawing:drawContent];
+			} else {
+				displayList = previous; // nothing changed, just paint it again
+			}
+			
+			if(displayList != previous) {
+				BOOL raced = NO;
+				@synchronized(self) {
+					// unless the view was invalidated again while recording
+					if(displayListGeneration == self->_context.displayListGeneration) {
+						if(self->_displayList == previous || previous == nil) {
+							self->_displayList = displayList;
+						} else {
+							// another draw recorded on top of it meanwhile (a concurrent drawQueue),
+							// neither list has both changes
+							self->_displayList = nil;
+							self->_context.displayListGeneration++;
+							raced = YES;
+						}
+					}
+				}
+				if(raced) {
+					dispatch_async(dispatch_get_main_queue(), ^{
+						[self setNeedsDisplay];
+					});
+				}
+			}
+		}
+		
+		PRE_DRAW
+		if(recordsDisplayList) {
+			[displayList drawInContext:context];
 		} else {
-			// drawRect isn't overridden by subclass, don't call, let the CA machinery just handle backgroundColor (fast path)
+			drawContent(dirtyRect);
 		}
+		POST_DRAW
 	};
 	
-	if(self.drawInBackground) {
-		layer.contents = nil;
+	if(background) {
+		// requests that pile up before a draw starts share one region; whichever draw is current
+		// when it starts takes all of it
+		NSUInteger generation;
+		@synchronized(self) {
+			TUIViewDirtyRegionUnion(&_context.backgroundDirtyRegion, &dirtyRegion);
+			generation = ++_context.drawGeneration;
+		}
+		
+		TUIDrawSchedulerBlock backgroundDrawBlock = ^BOOL{
+			TUIViewDirtyRegion region;
+			@synchronized(self) {
+				if(generation != self->_context.drawGeneration)
+					return NO;
+				region = self->_context.backgroundDirtyRegion;
+				self->_context.backgroundDirtyRegion.everything = NO;
+				self->_context.backgroundDirtyRegion.count = 0;
+			}
+			return drawBlock(region, generation);
+		};
 		
 		if(self.drawQueue != nil) {
-			[self.drawQueue addOperationWithBlock:drawBlock];
+			[self.drawQueue addOperationWithBlock:^{
+				backgroundDrawBlock();
+			}];
 		} else {
-			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), drawBlock);
+			TUIDrawPriority priority = [self _isOnscreenForDrawing] ? TUIDrawPriorityHigh : TUIDrawPriorityLow;
+			[[TUIDrawScheduler sharedScheduler] scheduleDrawForTarget:self priority:priority block:backgroundDrawBlock];
 		}
 	} else {
-		drawBlock();
+		drawBlock(dirtyRegion, 0);
 	}
 }
 
@@ -471,6 +1024,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setFrame:(CGRect)f
 {
 	self.layer.frame = f;
+	[self _geometryDidChange];
 }
 
 - (CGRect)bounds
@@ -481,6 +1035,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setBounds:(CGRect)b
 {
 	self.layer.bounds = b;
+	[self _geometryDidChange];
 }
 
 - (void)setCenter:(CGPoint)c
@@ -505,19 +1060,92 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setTransform:(CGAffineTransform)t
 {
 	[self.layer setAffineTransform:t];
+	[self _geometryDidChange];
+}
+
+- (void)_subviewGeometryDidChange
+{
+	_subviewIndex = nil;
+}
+
+/**
+ * @brief The view moved or changed size: its superview's index is out of date, and so is hit testing
+ * 
+ * Few views have enough subviews for an index, so the superview is only looked up when some index exists.
+ */
+- (void)_geometryDidChange
+{
+	if(TUIViewSubviewIndexCount > 0)
+		[self.superview _subviewGeometryDidChange];
+	if(_viewFlags.flattened)
+		[[self _flatteningRoot] setNeedsDisplay];
+	TUIViewHitTestingDidChange();
+}
+
+/**
+ * @brief The back to front subview array, brought up to date
+ * 
+ * zPositions are set straight on the layers (by the table view on every layout, for one), so
+ * rather than being told about changes the cached order is checked on the way out: one pass
+ * when nothing moved, and an insertion sort (which keeps the order of equal zPositions) when
+ * something did.
+ */
+- (NSMutableArray *)_sortedSubviews
+{
+	if(_sortedSubviews == nil) {
+		_subviewIndex = nil;
+		_sortedSubviews = [[self.subviews sortedArrayWithOptions:NSSortStable usingComparator:(NSComparator)^NSComparisonResult(TUIView *a, TUIView *b) {
+			CGFloat x = a.layer.zPosition;
+			CGFloat y = b.layer.zPosition;
+			if(x > y)
+				return NSOrderedDescending;
+			else if(x < y)
+				return NSOrderedAscending;
+			return NSOrderedSame;
+		}] mutableCopy];
+		return _sortedSubviews;
+	}
+	
+	NSUInteger count = [_sortedSubviews count];
+	CGFloat previous = -CGFLOAT_MAX;
+	for(NSUInteger i = 0; i < count; ++i) {
+		TUIView *v = [_sortedSubviews objectAtIndex:i];
+		CGFloat z = v.layer.zPosition;
+		if(z >= previous) {
+			previous = z;
+			continue;
+		}
+		
+		NSUInteger j = i;
+		while(j > 0 && [[_sortedSubviews objectAtIndex:j - 1] layer].zPosition > z)
+			--j;
+		[_sortedSubviews removeObjectAtIndex:i];
+		[_sortedSubviews insertObject:v atIndex:j];
+		_subviewIndex = nil;
+	}
+	return _sortedSubviews;
 }
 
 - (NSArray *)sortedSubviews // back to front order
 {
-	return [self.subviews sortedArrayWithOptions:NSSortStable usingComparator:(NSComparator)^NSComparisonResult(TUIView *a, TUIView *b) {
-		CGFloat x = a.layer.zPosition;
-		CGFloat y = b.layer.zPosition;
-		if(x > y)
-			return NSOrderedDescending;
-		else if(x < y)
-			return NSOrderedAscending;
-		return NSOrderedSame;
-	}];
+	return [[self _sortedSubviews] copy];
+}
+
+/**
+ * @brief Subviews that might contain @p point, back to front
+ * 
+ * All of them, unless there are enough for the spatial index to pay off.  Either way
+ * it's an array the view keeps, not a copy, so only enumerate it.
+ */
+- (NSArray *)_subviewsForHitTestAtPoint:(CGPoint)point
+{
+	NSMutableArray *sortedSubviews = [self _sortedSubviews];
+	if([sortedSubviews count] < TUIViewSubviewIndexMinimumCount)
+		return sortedSubviews;
+	
+	if(_subviewIndex == nil)
+		_subviewIndex = [[TUIViewSubviewIndex alloc] initWithSortedSubviews:sortedSubviews];
+	return [_subviewIndex subviewsAtPoint:point];
 }
 
 - (TUIView *)hitTest:(CGPoint)point withEvent:(id)event
@@ -526,7 +1154,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 		return nil;
 	
 	if([self pointInside:point withEvent:event]) {
-		NSArray *s = [self sortedSubviews];
+		NSArray *s = [self _subviewsForHitTestAtPoint:point];
 		for(TUIView *v in [s reverseObjectEnumerator]) {
 			TUIView *hit = [v hitTest:[self convertPoint:point toView:v] withEvent:event];
 			if(hit)
@@ -570,6 +1198,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setAutoresizingMask:(TUIViewAutoresizing)m
 {
 	self.layer.autoresizingMask = (unsigned int)m;
+	[self _geometryDidChange];
 }
 
 - (CGSize)sizeThatFits:(CGSize)size
@@ -625,8 +1254,16 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 		[self willMoveToSuperview:nil];
 
 		[superview.subviews removeObjectIdenticalTo:self];
+		[superview->_sortedSubviews removeObjectIdenticalTo:self];
+		superview->_subviewIndex = nil;
+		TUIViewHitTestingDidChange();
 		[self.layer removeFromSuperlayer];
 		self.nsView = nil;
+		[self _cancelBackgroundDrawsInSubtree];
+		if(_viewFlags.flattened) {
+			[self _setFlattened:NO];
+			[superview _flattenedContentDidChange];
+		}
 
 		[self didMoveToSuperview];
 	}
@@ -700,17 +1337,42 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 	view.nsView = _nsView;
 
 #define POST_ADDSUBVIEW \
+	if(_viewFlags.flattened || _viewFlags.flattensSubtree) { \
+		[view _setFlattened:YES]; \
+		[self _flattenedContentDidChange]; \
+	} \
+	TUIViewHitTestingDidChange(); \
 	[self didAddSubview:view]; \
 	[view didMoveToSuperview]; \
 	[view setNextResponder:self]; \
 	[self _blockLayout];
 
+/**
+ * @brief Put a subview that was just added on top into the back to front array
+ * 
+ * It goes after everything with the same or a lower zPosition; inserting anywhere else
+ * just drops the array, to be sorted again when next needed.
+ */
+- (void)_addSortedSubview:(TUIView *)view
+{
+	if(_sortedSubviews == nil)
+		return;
+	
+	CGFloat z = view.layer.zPosition;
+	NSUInteger i = [_sortedSubviews count];
+	while(i > 0 && [[_sortedSubviews objectAtIndex:i - 1] layer].zPosition > z)
+		--i;
+	[_sortedSubviews insertObject:view atIndex:i];
+	_subviewIndex = nil;
+}
+
 - (void)addSubview:(TUIView *)view // everything should go through this
 {
 	if(!view)
 		return;
 	PRE_ADDSUBVIEW(NSUIntegerMax)
 	[self.layer addSublayer:view.layer];
+	[self _addSortedSubview:view];
 	POST_ADDSUBVIEW
 }
 
@@ -718,6 +1380,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 {
 	PRE_ADDSUBVIEW(index)
 	[self.layer insertSublayer:view.layer atIndex:(unsigned int)index];
+	_sortedSubviews = nil;
 	POST_ADDSUBVIEW
 }
 
@@ -729,6 +1392,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 	
 	PRE_ADDSUBVIEW(siblingIndex + 1)
 	[self.layer insertSublayer:view.layer below:siblingSubview.layer];
+	_sortedSubviews = nil;
 	POST_ADDSUBVIEW
 }
 
@@ -740,6 +1404,7 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 	
 	PRE_ADDSUBVIEW(siblingIndex)
 	[self.layer insertSublayer:view.layer above:siblingSubview.layer];
+	_sortedSubviews = nil;
 	POST_ADDSUBVIEW
 }
 
@@ -791,6 +1456,13 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)didMoveToWindow {
 	[self _updateLayerScaleFactor];
 	
+	if(self.nsView.window == nil) {
+		[self _purgeBackingStore];
+	} else if(_context.backingStorePurged && !self.hidden) {
+		_context.backingStorePurged = NO;
+		[self _setNeedsRedisplay];
+	}
+	
 	[self.subviews makeObjectsPerformSelector:_cmd];
 	
 	[[NSNotificationCenter defaultCenter] postNotificationName:TUIViewDidMoveToWindowNotification object:self userInfo:self.nsView.window != nil ? [NSDictionary dictionaryWithObject:self.nsView.window forKey:TUIViewWindow] : nil];
@@ -874,6 +1546,19 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 	CGContextFillRect(ctx, self.bounds);
 }
 
+// like -drawRect:, only called (by -displayLayer:) when overridden
++ (void)drawSnapshot:(TUIViewSnapshot *)snapshot inRect:(CGRect)rect
+{
+	CGContextRef ctx = TUIGraphicsGetCurrentContext();
+	[snapshot.backgroundColor set];
+	CGContextFillRect(ctx, snapshot.bounds);
+}
+
+- (id)snapshotContents
+{
+	return nil;
+}
+
 - (TUIViewDrawRect)drawRect
 {
 	return drawRect;
@@ -893,15 +1578,278 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 
 - (void)setNeedsDisplay
 {
+	if(_viewFlags.flattened) {
+		TUIView *root = [self _flatteningRoot];
+		[root setNeedsDisplayInRect:[root convertRect:self.bounds fromView:self]];
+		return;
+	}
+	if(_viewFlags.recordsDisplayList || _displayList != nil)
+		[self _invalidateDisplayList];
+	_context.dirtyRegion.everything = YES;
 	[self.layer setNeedsDisplay];
 }
 
+/**
+ * @brief Display the whole view again when only the pixels were lost, not what they showed
+ * 
+ * Keeps the display list, so it's replayed rather than recorded again.
+ */
+- (void)_setNeedsRedisplay
+{
+	_context.dirtyRegion.everything = YES;
+	[self.layer setNeedsDisplay];
+}
+
+static CGFloat TUIRectArea(CGRect r)
+{
+	return CGRectIsNull(r) ? 0.0 : r.size.width * r.size.height;
+}
+
+/**
+ * @brief Add a rect to a dirty region
+ * 
+ * Rects are merged with one they overlap or touch when their union is no
+ * bigger than the two apart.  When the region is full the rect is merged
+ * with whichever rect grows the least.
+ */
+void TUIViewDirtyRegionAddRect(TUIViewDirtyRegion *region, CGRect r)
+{
+	for(NSUInteger i = 0; i < region->count; ++i) {
+		if(CGRectContainsRect(region->rects[i], r))
+			return;
+		CGRect u = CGRectUnion(region->rects[i], r);
+		if(TUIRectArea(u) <= TUIRectArea(region->rects[i]) + TUIRectArea(r)) {
+			// the merged rect may now touch others, so take it out and add it again
+			region->rects[i] = region->rects[--region->count];
+			TUIViewDirtyRegionAddRect(region, u);
+			return;
+		}
+	}
+	
+	if(region->count < TUIViewMaximumDirtyRects) {
+		region->rects[region->count++] = r;
+		return;
+	}
+	
+	NSUInteger best = 0;
+	CGFloat bestGrowth = CGFLOAT_MAX;
+	for(NSUInteger i = 0; i < region->count; ++i) {
+		CGFloat growth = TUIRectArea(CGRectUnion(region->rects[i], r)) - TUIRectArea(region->rects[i]);
+		if(growth < bestGrowth) {
+			best = i;
+			bestGrowth = growth;
+		}
+	}
+	CGRect u = CGRectUnion(region->rects[best], r);
+	region->rects[best] = region->rects[--region->count];
+	TUIViewDirtyRegionAddRect(region, u);
+}
+
+- (void)_invalidateDisplayList
+{
+	@synchronized(self) {
+		_displayList = nil;
+		_context.displayListGeneration++;
+	}
+}
+
+- (BOOL)recordsDisplayList
+{
+	return _viewFlags.recordsDisplayList;
+}
+
+- (void)setRecordsDisplayList:(BOOL)b
+{
+	_viewFlags.recordsDisplayList = b;
+	[self setNeedsDisplay];
+}
+
 - (void)setNeedsDisplayInRect:(CGRect)rect
 {
-	_context.dirtyRect = rect;
+	if(_viewFlags.flattened) {
+		TUIView *root = [self _flatteningRoot];
+		[root setNeedsDisplayInRect:[root convertRect:rect fromView:self]];
+		return;
+	}
+	rect = CGRectIntegral(CGRectIntersection(rect, self.bounds));
+	if(CGRectIsEmpty(rect))
+		return;
+	if(!_context.dirtyRegion.everything)
+		TUIViewDirtyRegionAddRect(&_context.dirtyRegion, rect);
 	[self.layer setNeedsDisplayInRect:rect];
 }
 
+- (BOOL)flattensSubtree
+{
+	return _viewFlags.flattensSubtree;
+}
+
+- (void)setFlattensSubtree:(BOOL)b
+{
+	if(_viewFlags.flattensSubtree == b)
+		return;
+	_viewFlags.flattensSubtree = b;
+	for(TUIView *subview in self.subviews)
+		[subview _setFlattened:b || _viewFlags.flattened];
+	[self _flattenedContentDidChange];
+}
+
+/**
+ * @brief Start or stop being drawn by a flattening ancestor, along with everything under this view
+ * 
+ * While flattened the layer holds no contents and no background color, the ancestor's
+ * bitmap shows them instead.
+ */
+- (void)_setFlattened:(BOOL)f
+{
+	if(_viewFlags.flattened == f)
+		return;
+	
+	if(f) {
+		CGColorRef color = self.layer.backgroundColor;
+		_flattenedBackgroundColor = color ? [TUIColor colorWithCGColor:color] : nil;
+		self.layer.backgroundColor = NULL;
+		[self _purgeBackingStore];
+		self.layer.contents = nil;
+		[self _invalidateDisplayList];
+		_viewFlags.flattened = YES;
+	} else {
+		_viewFlags.flattened = NO;
+		self.layer.backgroundColor = _flattenedBackgroundColor.CGColor;
+		_flattenedBackgroundColor = nil;
+		[self setNeedsDisplay];
+	}
+	
+	for(TUIView *subview in self.subviews)
+		[subview _setFlattened:f || _viewFlags.flattensSubtree];
+}
+
+/**
+ * @brief The ancestor whose bitmap a flattened view is drawn into
+ */
+- (TUIView *)_flatteningRoot
+{
+	TUIView *v = self.superview;
+	while(v != nil && v->_viewFlags.flattened)
+		v = v.superview;
+	return v;
+}
+
+/**
+ * @brief Something this view shows in a flattened bitmap changed (geometry, visibility, subviews), so draw it again
+ */
+- (void)_flattenedContentDidChange
+{
+	if(_viewFlags.flattened)
+		[[self _flatteningRoot] setNeedsDisplay];
+	else if(_viewFlags.flattensSubtree)
+		[self setNeedsDisplay];
+}
+
+/**
+ * @brief Whether -displayLayer: would draw anything for this view beyond its background color
+ */
+- (BOOL)_drawsContent
+{
+	if(drawRect != nil)
+		return YES;
+	if([[self class] methodForSelector:@selector(drawSnapshot:inRect:)] != [TUIView methodForSelector:@selector(drawSnapshot:inRect:)])
+		return YES;
+	return [self methodForSelector:@selector(drawRect:)] != [TUIView instanceMethodForSelector:@selector(drawRect:)] && ![self _disableDrawRect];
+}
+
+/**
+ * @brief Draw the view's content the way -displayLayer: would, into the current context
+ */
+- (void)_drawContentInRect:(CGRect)rect
+{
+	if(drawRect != nil) {
+		drawRect(self, rect);
+	} else if([[self class] methodForSelector:@selector(drawSnapshot:inRect:)] != [TUIView methodForSelector:@selector(drawSnapshot:inRect:)]) {
+		CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+		TUIViewSnapshot *snapshot = [[TUIViewSnapshot alloc] initWithBounds:self.bounds opaque:self.opaque contentsScale:scale backgroundColor:self.backgroundColor contents:[self snapshotContents]];
+		[[self class] drawSnapshot:snapshot inRect:rect];
+	} else if([self _drawsContent]) {
+		[self drawRect:rect];
+	}
+}
+
+/**
+ * @brief Draw the subviews of a flattening view (and theirs) back to front into @p ctx, in this view's coordinates
+ * 
+ * Each is placed the way Core Animation would composite its layer: position, transform and
+ * anchor point, clipped if it masks to bounds, faded by its alpha.  Views outside the clip
+ * (the dirty region being drawn) only have their subviews visited.
+ */
+- (void)_drawFlattenedSubviewsInContext:(CGContextRef)ctx
+{
+	for(TUIView *subview in [[self _sortedSubviews] copy]) {
+		CALayer *l = subview.layer;
+		CGFloat alpha = l.opacity;
+		if(l.hidden || alpha <= 0.0f)
+			continue;
+		
+		CGRect b = l.bounds;
+		CGPoint position = l.position;
+		CGPoint anchor = l.anchorPoint;
+		CGContextSaveGState(ctx);
+		CGContextTranslateCTM(ctx, position.x, position.y);
+		CGContextConcatCTM(ctx, [l affineTransform]);
+		CGContextTranslateCTM(ctx, -b.origin.x - anchor.x * b.size.width, -b.origin.y - anchor.y * b.size.height);
+		if(l.masksToBounds)
+			CGContextClipToRect(ctx, b);
+		if(alpha < 1.0f) {
+			CGContextSetAlpha(ctx, alpha);
+			CGContextBeginTransparencyLayer(ctx, NULL);
+		}
+		
+		CGRect r = CGRectIntersection(CGContextGetClipBoundingBox(ctx), b);
+		if(!CGRectIsEmpty(r)) {
+			if(subview->_flattenedBackgroundColor != nil) {
+				CGContextSetFillColorWithColor(ctx, subview->_flattenedBackgroundColor.CGColor);
+				CGContextFillRect(ctx, b);
+			}
+			CGContextSaveGState(ctx);
+			[subview _drawContentInRect:r];
+			CGContextRestoreGState(ctx);
+		}
+		[subview _drawFlattenedSubviewsInContext:ctx];
+		
+		if(alpha < 1.0f)
+			CGContextEndTransparencyLayer(ctx);
+		CGContextRestoreGState(ctx);
+	}
+}
+
+static void TUIViewAddFlatteningStatistics(TUIView *view, CGFloat scale, TUIViewFlatteningStatistics *statistics)
+{
+	for(TUIView *subview in view.subviews) {
+		if(subview.hidden)
+			continue;
+		if(subview->_flattenedBackgroundColor != nil || [subview _drawsContent])
+			statistics->layersSaved++;
+		if([subview _drawsContent]) {
+			CGSize s = subview.bounds.size;
+			statistics->bytesSaved += (NSUInteger)ceil(s.width * scale) * (NSUInteger)ceil(s.height * scale) * 4;
+		}
+		TUIViewAddFlatteningStatistics(subview, scale, statistics);
+	}
+}
+
+- (TUIViewFlatteningStatistics)flatteningStatistics
+{
+	TUIViewFlatteningStatistics statistics = {0, 0, 0};
+	if(_viewFlags.flattensSubtree && !_viewFlags.flattened) {
+		CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+		if(_backingStore != nil) {
+			CGSize s = self.bounds.size;
+			statistics.cacheBytes = (NSUInteger)ceil(s.width * scale) * (NSUInteger)ceil(s.height * scale) * 4;
+		}
+		TUIViewAddFlatteningStatistics(self, scale, &statistics);
+	}
+	return statistics;
+}
+
 - (BOOL)clipsToBounds
 {
 	return self.layer.masksToBounds;
@@ -920,6 +1868,9 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setAlpha:(CGFloat)a
 {
 	self.layer.opacity = a;
+	if(_viewFlags.flattened)
+		[[self _flatteningRoot] setNeedsDisplay];
+	TUIViewHitTestingDidChange();
 }
 
 - (BOOL)isOpaque
@@ -940,16 +1891,32 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setHidden:(BOOL)h
 {
 	self.layer.hidden = h;
+	if(_viewFlags.flattened)
+		[[self _flatteningRoot] setNeedsDisplay];
+	if(h) {
+		// purged by the idle check if still hidden by then, so hiding and showing again right away keeps the bitmaps
+		[self _noteBackingStoresHiddenInSubtree];
+		[self _cancelBackgroundDrawsInSubtree];
+	} else {
+		[self _restorePurgedBackingStores];
+	}
+	TUIViewHitTestingDidChange();
 }
 
 - (TUIColor *)backgroundColor
 {
+	if(_viewFlags.flattened)
+		return _flattenedBackgroundColor;
 	return [TUIColor colorWithCGColor:self.layer.backgroundColor];
 }
 
 - (void)setBackgroundColor:(TUIColor *)color
 {
-	self.layer.backgroundColor = color.CGColor;
+	if(_viewFlags.flattened) {
+		_flattenedBackgroundColor = color;
+	} else {
+		self.layer.backgroundColor = color.CGColor;
+	}
 	if(color.alphaComponent < 1.0)
 		self.opaque = NO;
 	[self setNeedsDisplay];
@@ -974,6 +1941,8 @@ else CGContextSetRGBFillColor(context, 1, 0, 0, 0.3); CGContextFillRect(context,
 - (void)setNSView:(TUINSView *)n
 {
 	if(n != _nsView) {
+		if(n == nil && _viewFlags.drawInBackground)
+			[self _cancelBackgroundDraw];
 		[self willMoveToWindow:(TUINSWindow *)[n window]];
 		[[NSNotificationCenter defaultCenter] postNotificationName:TUIViewWillMoveToWindowNotification object:self userInfo:[n window] ? [NSDictionary dictionaryWithObject:[n window] forKey:TUIViewWindow] : nil];
 		_nsView = n;